@@ -58,6 +58,43 @@ if(USE_LMDB)
   endif()
 endif()
 
+# ---[ io_uring
+if(USE_IO_URING)
+  list(APPEND Caffe_DEFINITIONS PUBLIC -DUSE_IO_URING)
+endif()
+
+# ---[ LZ4
+if(USE_LZ4)
+  find_package(LZ4 REQUIRED)
+  list(APPEND Caffe_INCLUDE_DIRS PRIVATE ${LZ4_INCLUDE_DIR})
+  list(APPEND Caffe_LINKER_LIBS PUBLIC ${LZ4_LIBRARIES})
+  list(APPEND Caffe_DEFINITIONS PUBLIC -DUSE_LZ4)
+endif()
+
+# ---[ Zstd
+if(USE_ZSTD)
+  find_package(Zstd REQUIRED)
+  list(APPEND Caffe_INCLUDE_DIRS PRIVATE ${Zstd_INCLUDE_DIR})
+  list(APPEND Caffe_LINKER_LIBS PUBLIC ${Zstd_LIBRARIES})
+  list(APPEND Caffe_DEFINITIONS PUBLIC -DUSE_ZSTD)
+endif()
+
+# ---[ libjpeg-turbo
+if(USE_LIBJPEG_TURBO)
+  find_package(JPEG REQUIRED)
+  list(APPEND Caffe_INCLUDE_DIRS PRIVATE ${JPEG_INCLUDE_DIR})
+  list(APPEND Caffe_LINKER_LIBS PUBLIC ${JPEG_LIBRARIES})
+  list(APPEND Caffe_DEFINITIONS PUBLIC -DUSE_LIBJPEG_TURBO)
+endif()
+
+# ---[ libpng
+if(USE_LIBPNG)
+  find_package(PNG REQUIRED)
+  list(APPEND Caffe_INCLUDE_DIRS PRIVATE ${PNG_INCLUDE_DIRS})
+  list(APPEND Caffe_LINKER_LIBS PUBLIC ${PNG_LIBRARIES})
+  list(APPEND Caffe_DEFINITIONS PUBLIC -DUSE_LIBPNG)
+endif()
+
 # ---[ LevelDB
 if(USE_LEVELDB)
   find_package(LevelDB REQUIRED)
@@ -0,0 +1,27 @@
+# Find the Zstandard libraries
+#
+# The following variables are optionally searched for defaults
+#  Zstd_ROOT_DIR:    Base directory where all Zstd components are found
+#
+# The following are set after configuration is done:
+#  ZSTD_FOUND
+#  Zstd_INCLUDE_DIR
+#  Zstd_LIBRARIES
+
+find_path(Zstd_INCLUDE_DIR NAMES zstd.h
+                           PATHS ${ZSTD_ROOT_DIR} ${ZSTD_ROOT_DIR}/include)
+
+find_library(Zstd_LIBRARIES NAMES zstd
+                            PATHS ${ZSTD_ROOT_DIR} ${ZSTD_ROOT_DIR}/lib)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Zstd DEFAULT_MSG Zstd_INCLUDE_DIR Zstd_LIBRARIES)
+
+if(ZSTD_FOUND)
+  message(STATUS "Found Zstd    (include: ${Zstd_INCLUDE_DIR}, library: ${Zstd_LIBRARIES})")
+  mark_as_advanced(Zstd_INCLUDE_DIR Zstd_LIBRARIES)
+
+  caffe_parse_header(${Zstd_INCLUDE_DIR}/zstd.h
+                     ZSTD_VERSION_LINES ZSTD_VERSION_MAJOR ZSTD_VERSION_MINOR ZSTD_VERSION_RELEASE)
+  set(Zstd_VERSION "${ZSTD_VERSION_MAJOR}.${ZSTD_VERSION_MINOR}.${ZSTD_VERSION_RELEASE}")
+endif()
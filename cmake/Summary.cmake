@@ -119,6 +119,11 @@ function(caffe_print_configuration_summary)
   caffe_status("  USE_LMDB          :   ${USE_LMDB}")
   caffe_status("  USE_NCCL          :   ${USE_NCCL}")
   caffe_status("  ALLOW_LMDB_NOLOCK :   ${ALLOW_LMDB_NOLOCK}")
+  caffe_status("  USE_IO_URING      :   ${USE_IO_URING}")
+  caffe_status("  USE_LZ4           :   ${USE_LZ4}")
+  caffe_status("  USE_ZSTD          :   ${USE_ZSTD}")
+  caffe_status("  USE_LIBJPEG_TURBO :   ${USE_LIBJPEG_TURBO}")
+  caffe_status("  USE_LIBPNG        :   ${USE_LIBPNG}")
   caffe_status("")
   caffe_status("Dependencies:")
   caffe_status("  BLAS              : " APPLE THEN "Yes (vecLib)" ELSE "Yes (${BLAS})")
@@ -133,6 +138,18 @@ function(caffe_print_configuration_summary)
     caffe_status("  LevelDB           : " LEVELDB_FOUND THEN  "Yes (ver. ${LEVELDB_VERSION})" ELSE "No")
     caffe_status("  Snappy            : " SNAPPY_FOUND THEN "Yes (ver. ${Snappy_VERSION})" ELSE "No" )
   endif()
+  if(USE_LZ4)
+    caffe_status("  LZ4               : " LZ4_FOUND THEN "Yes (ver. ${LZ4_VERSION})" ELSE "No")
+  endif()
+  if(USE_ZSTD)
+    caffe_status("  Zstd              : " ZSTD_FOUND THEN "Yes (ver. ${Zstd_VERSION})" ELSE "No")
+  endif()
+  if(USE_LIBJPEG_TURBO)
+    caffe_status("  libjpeg-turbo     : " JPEG_FOUND THEN "Yes" ELSE "No")
+  endif()
+  if(USE_LIBPNG)
+    caffe_status("  libpng            : " PNG_FOUND THEN "Yes (ver. ${PNG_VERSION_STRING})" ELSE "No")
+  endif()
   if(USE_OPENCV)
     caffe_status("  OpenCV            :   Yes (ver. ${OpenCV_VERSION})")
   endif()
@@ -0,0 +1,69 @@
+#ifndef CAFFE_DATA_READER_HPP_
+#define CAFFE_DATA_READER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/datum_cache.hpp"
+#include "caffe/util/db.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Reads Datums from a single DB (one shard of a data source) on its
+ * own thread, and pushes them to a queue that may be shared with the readers
+ * of the other shards.
+ *
+ * Datums are recycled through a free / full queue pair owned by the caller.
+ * A reader can be restricted to every stride-th record of its shard, starting
+ * at record phase, so that several solvers can share a shard when there are
+ * fewer shards than solvers.
+ *
+ * With a cache, encoded Datums are decoded by the reader (following the
+ * force_color / force_gray transformation parameters) and kept in memory by
+ * record key, so that later epochs skip both the read and the decode.
+ */
+class DataReader : public InternalThread {
+ public:
+  DataReader(const LayerParameter& param, const string& source,
+      BlockingQueue<Datum*>* free, BlockingQueue<Datum*>* full,
+      int stride = 1, int phase = 0, size_t cache_bytes = 0);
+  virtual ~DataReader();
+
+  inline const string& source() const { return source_; }
+  /// @brief The decoded Datum cache, or NULL if caching is disabled.
+  inline const DatumCache* cache() const { return cache_.get(); }
+
+  /**
+   * @brief Expands a data source into the list of DBs it names. The source
+   *        is a comma-separated list of DB paths and glob patterns, e.g.
+   *        "train_000,train_001" or "train_*". Glob matches are sorted so
+   *        that every solver sees the same shard order.
+   */
+  static vector<string> ExpandSources(const string& source);
+
+ protected:
+  virtual void InternalThreadEntry();
+  // Reads the current record into datum, through the cache if there is one.
+  void Read(Datum* datum);
+
+  const string source_;
+  const int stride_;
+  const int phase_;
+  const TransformationParameter transform_param_;
+  shared_ptr<DatumCache> cache_;
+  shared_ptr<db::DB> db_;
+  shared_ptr<db::Cursor> cursor_;
+  BlockingQueue<Datum*>* free_;
+  BlockingQueue<Datum*>* full_;
+
+DISABLE_COPY_AND_ASSIGN(DataReader);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DATA_READER_HPP_
@@ -90,6 +90,23 @@ class DataTransformer {
    */
   void Transform(Blob<Dtype>* input_blob, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Applies the augmentations of the transform_param block that work
+   *    on whole batches: color jitter and lighting noise, followed by the
+   *    mean values and the scale.
+   *
+   * When batch_transform() is true, the single item Transform methods only
+   * crop and mirror, and leave the pixel values to this method, which layers
+   * call once their batch is complete. Does nothing otherwise.
+   *
+   * @param batch
+   *    The batch of items produced by Transform, modified in place.
+   */
+  void TransformBatch(Blob<Dtype>* batch);
+
+  /// @brief Whether TransformBatch must be applied to the transformed items.
+  inline bool batch_transform() const { return batch_transform_; }
+
   /**
    * @brief Infers the shape of transformed_blob will have when
    *    the transformation is applied to the data.
@@ -137,8 +154,27 @@ class DataTransformer {
    *    A uniformly random integer value from ({0, 1, ..., n-1}).
    */
   virtual int Rand(int n);
+  // Generates a random float from Uniform([a, b)).
+  float RandUniform(float a, float b);
+  // Generates a random float from Gaussian(0, sigma).
+  float RandGaussian(float sigma);
 
   void Transform(const Datum& datum, Dtype* transformed_data);
+  // Picks the region of a random-resized crop of a height x width image.
+  void RandomResizedCrop(int height, int width, int* h_off, int* w_off,
+      int* crop_height, int* crop_width);
+#ifdef USE_OPENCV
+  // Draws the crop of an encoded Datum from the size in its header, and
+  // decodes and transforms only the crop. Returns false, before drawing
+  // anything, if the image cannot be decoded that way.
+  bool TransformEncodedCrop(const Datum& datum,
+      Blob<Dtype>* transformed_blob);
+  // Transforms cv_cropped_img, the crop at (h_off, w_off) of an
+  // img_height x img_width image, into transformed_blob.
+  void TransformCrop(const cv::Mat& cv_cropped_img, int img_height,
+      int img_width, int h_off, int w_off, bool do_mirror,
+      Blob<Dtype>* transformed_blob);
+#endif  // USE_OPENCV
   // Tranformation parameters
   TransformationParameter param_;
 
@@ -147,6 +183,16 @@ class DataTransformer {
   Phase phase_;
   Blob<Dtype> data_mean_;
   vector<Dtype> mean_values_;
+  // Compressed Datums are decompressed here, reusing its buffers.
+  Datum uncompressed_;
+  // Whether the augmentations of the TRAIN phase are set, see
+  // TransformBatch, and whether they include a random-resized crop.
+  bool batch_transform_;
+  bool random_resized_crop_;
+  vector<Dtype> lighting_eigval_;
+  vector<Dtype> lighting_eigvec_;
+  // Gray level of the pixels of an item, for saturation.
+  Blob<Dtype> gray_;
 };
 
 }  // namespace caffe
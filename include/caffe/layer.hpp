@@ -269,6 +269,15 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Forward may run again on the same bottom blobs, to
+   *        recompute the same top blobs without side effects.
+   *
+   * Nets that checkpoint activations (NetParameter.checkpoint_activations)
+   * keep the tops of the layers that may not, instead of recomputing them.
+   */
+  virtual inline bool AllowRecompute() const { return true; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -9,6 +9,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/data_metrics.hpp"
 
 namespace caffe {
 
@@ -47,6 +48,8 @@ template <typename Dtype>
 class Batch {
  public:
   Blob<Dtype> data_, label_;
+  // Blobs for the tops after data and label, if a layer has more than two.
+  vector<shared_ptr<Blob<Dtype> > > extra_;
 };
 
 template <typename Dtype>
@@ -65,9 +68,29 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
+  /// @brief Throughput and starvation counters of the prefetching.
+  DataMetrics& metrics() { return metrics_; }
+
+  /**
+   * @brief Number of times each record read is emitted, with fresh random
+   *        crops and mirrors, by layers that support data echoing (see
+   *        DataParameter.echo).
+   *
+   * It may be changed at any time, but only has an effect if echo or
+   * echo_max was above 1 when the layer was set up; it is also adjusted
+   * between echo and echo_max from the starvation measured by Forward.
+   */
+  int echo_factor() const;
+  void set_echo_factor(int echo_factor);
+
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Frees prefetch_current_, and waits for the next loaded batch.
+  void NextBatch();
+  // Raises the echo factor while Forward keeps waiting for data, and lowers
+  // it back while loaded batches are queued.
+  void AdjustEchoFactor(int queued);
 
   vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
@@ -75,6 +98,18 @@ class BasePrefetchingDataLayer :
   Batch<Dtype>* prefetch_current_;
 
   Blob<Dtype> transformed_data_;
+  // load_batch records the time of its stages in metrics_.
+  DataMetrics metrics_;
+
+  // Read by the prefetch thread, see echo_factor().
+  int echo_factor_;
+  int echo_min_;
+  int echo_max_;
+  // Forward calls since the echo factor was last adjusted, the calls that
+  // found no loaded batch, and the sum of the loaded batches queued.
+  int echo_forwards_;
+  int echo_starved_;
+  int echo_queued_;
 };
 
 }  // namespace caffe
@@ -49,6 +49,8 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "BatchNorm"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  // Unless it uses the global statistics, Forward updates them.
+  virtual inline bool AllowRecompute() const { return use_global_stats_; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
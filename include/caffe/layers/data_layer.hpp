@@ -4,15 +4,31 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/data_reader.hpp"
 #include "caffe/data_transformer.hpp"
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/db.hpp"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
+/**
+ * @brief Provides data to the Net from one or more DBs.
+ *
+ * DataParameter.source may name several shard DBs (a comma-separated list
+ * and / or glob patterns). Each shard is read by its own DataReader thread
+ * and the readers feed a common queue consumed by the prefetch thread.
+ * With several solvers, whole shards are assigned to each solver so that no
+ * solver reads records it would discard; solvers only share a shard, and
+ * skip each other's records in it, when there are fewer shards than solvers.
+ *
+ * With data echoing (DataParameter.echo), each record read is kept in a
+ * buffer of echo_buffer records and emitted echo_factor() times, drawn at
+ * random from the buffer so that its echoes land in different batches, and
+ * transformed afresh each time.
+ */
 template <typename Dtype>
 class DataLayer : public BasePrefetchingDataLayer<Dtype> {
  public:
@@ -26,13 +42,20 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int MaxTopBlobs() const { return 2; }
 
  protected:
-  void Next();
-  bool Skip();
   virtual void load_batch(Batch<Dtype>* batch);
-
-  shared_ptr<db::DB> db_;
-  shared_ptr<db::Cursor> cursor_;
-  uint64_t offset_;
+  // The next record to emit; last_use is set when it goes back to the
+  // readers after this emission.
+  Datum* NextDatum(bool* last_use);
+
+  // Datums in flight between the readers and the prefetch thread.
+  vector<shared_ptr<Datum> > datums_;
+  BlockingQueue<Datum*> datum_free_;
+  BlockingQueue<Datum*> datum_full_;
+  // Echoed records, with the number of times each is still to be emitted.
+  vector<std::pair<Datum*, int> > echo_buffer_;
+  int echo_buffer_size_;
+  // Declared last so that readers are stopped before the queues go away.
+  vector<shared_ptr<DataReader> > readers_;
 };
 
 }  // namespace caffe
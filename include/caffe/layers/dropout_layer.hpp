@@ -39,6 +39,8 @@ class DropoutLayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Dropout"; }
+  // Each Forward draws a new mask.
+  virtual inline bool AllowRecompute() const { return false; }
 
  protected:
   /**
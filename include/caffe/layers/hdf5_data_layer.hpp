@@ -17,45 +17,53 @@ namespace caffe {
 /**
  * @brief Provides data to the Net from HDF5 files.
  *
- * TODO(dox): thorough documentation for Forward and proto params.
+ * Each top is read from the dataset of the same name. Rows are read on the
+ * prefetch thread in chunks of chunk_size rows, so that files need not fit
+ * in memory and opening and reading the next file overlaps with the
+ * computation of the Net. With shuffle, the order of the files is shuffled
+ * every epoch and rows are drawn at random from a buffer of
+ * shuffle_buffer_size rows, which is refilled in file order.
  */
 template <typename Dtype>
-class HDF5DataLayer : public Layer<Dtype> {
+class HDF5DataLayer : public BasePrefetchingDataLayer<Dtype> {
  public:
   explicit HDF5DataLayer(const LayerParameter& param)
-      : Layer<Dtype>(param), offset_() {}
+      : BasePrefetchingDataLayer<Dtype>(param), file_id_(-1), offset_() {}
   virtual ~HDF5DataLayer();
-  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  // Data layers have no bottoms, so reshaping is trivial.
-  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {}
 
   virtual inline const char* type() const { return "HDF5Data"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int MinTopBlobs() const { return 1; }
 
  protected:
-  void Next();
   bool Skip();
-
-  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
-  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
-  virtual void LoadHDF5FileData(const char* filename);
+  // Opens the current file of file_permutation_.
+  void OpenFile();
+  // Moves to the next file, reshuffling the files after the last one.
+  void NextFile();
+  // Reads the next chunk of rows, moving to the next file as needed.
+  void LoadChunk();
+  // Copies the next row of this solver, in file order, to row "row" of blobs.
+  void NextRow(const vector<Blob<Dtype>*>& blobs, int row);
+  virtual void load_batch(Batch<Dtype>* batch);
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
   unsigned int current_file_;
+  hid_t file_id_;
+  hsize_t file_rows_;
   hsize_t current_row_;
-  std::vector<shared_ptr<Blob<Dtype> > > hdf_blobs_;
-  std::vector<unsigned int> data_permutation_;
+  // The last chunk of rows read, one Blob per top, and the next row in it.
+  vector<shared_ptr<Blob<Dtype> > > chunk_blobs_;
+  int chunk_row_;
+  // Rows waiting to be drawn at random, when shuffling.
+  vector<shared_ptr<Blob<Dtype> > > shuffle_blobs_;
+  int shuffle_capacity_;
+  int shuffle_rows_;
   std::vector<unsigned int> file_permutation_;
+  shared_ptr<Caffe::RNG> prefetch_rng_;
   uint64_t offset_;
 };
 
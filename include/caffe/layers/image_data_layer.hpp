@@ -1,6 +1,10 @@
 #ifndef CAFFE_IMAGE_DATA_LAYER_HPP_
 #define CAFFE_IMAGE_DATA_LAYER_HPP_
 
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -11,6 +15,8 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/async_file_reader.hpp"
+#include "caffe/util/datum_cache.hpp"
 
 namespace caffe {
 
@@ -36,9 +42,26 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Reads and decodes the image of lines_[line_id], or takes it from cache_.
+  void ReadCachedImage(int line_id, Datum* datum);
+  // Moves to the next line, reshuffling at the end of the epoch.
+  void NextLine();
+  // Decodes and resizes an image read by io_reader_.
+  cv::Mat DecodeImage(const string& data, const string& filename);
+  // Reads the images of the batch, and of the next one, on io_reader_.
+  void LoadBatchAsync(Batch<Dtype>* batch);
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  // Decoded and resized images, by file name; NULL unless cache_mb is set.
+  shared_ptr<DatumCache> cache_;
+  // Asynchronous reads; NULL unless io_depth is set. Reads are identified
+  // by the position of their line in the stream of lines of all epochs.
+  shared_ptr<AsyncFileReader> io_reader_;
+  uint64_t next_seq_;
+  uint64_t submitted_seq_;
+  // Reads of the next batch that completed while reading the current one.
+  std::map<uint64_t, string> read_ahead_;
 };
 
 
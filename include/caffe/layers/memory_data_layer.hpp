@@ -8,19 +8,27 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
 /**
  * @brief Provides data to the Net from memory.
  *
- * TODO(dox): thorough documentation for Forward and proto params.
+ * Data is given either with Reset or AddDatumVector / AddMatVector, or, if
+ * num_buffers is set, through buffers of one batch each: a producer takes a
+ * free buffer with AcquireBuffer, fills it (or has FillBuffer transform data
+ * into it), and queues it with ReleaseBuffer. Producers may run on other
+ * threads, and fill the next batches while the Net forwards the current one.
+ * Forward makes the tops point to the next queued buffer, waiting for one if
+ * needed, and frees the buffer of the previous batch.
  */
 template <typename Dtype>
 class MemoryDataLayer : public BaseDataLayer<Dtype> {
  public:
   explicit MemoryDataLayer(const LayerParameter& param)
-      : BaseDataLayer<Dtype>(param), has_new_data_(false) {}
+      : BaseDataLayer<Dtype>(param), has_new_data_(false),
+        forwarded_buffer_(NULL) {}
   virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
@@ -39,6 +47,21 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   void Reset(Dtype* data, Dtype* label, int n);
   void set_batch_size(int new_size);
 
+  /// @brief Waits for a free buffer, shaped as a batch, for the caller to fill.
+  Batch<Dtype>* AcquireBuffer();
+  /// @brief Queues a buffer filled by the caller for Forward.
+  void ReleaseBuffer(Batch<Dtype>* buffer);
+  /**
+   * @brief Transforms a batch of Datums straight into a buffer. As the
+   *        transformations draw from the same random generator, FillBuffer
+   *        must not be called by several threads at once.
+   */
+  void FillBuffer(const vector<Datum>& datum_vector, Batch<Dtype>* buffer);
+#ifdef USE_OPENCV
+  void FillBuffer(const vector<cv::Mat>& mat_vector, const vector<int>& labels,
+      Batch<Dtype>* buffer);
+#endif  // USE_OPENCV
+
   int batch_size() { return batch_size_; }
   int channels() { return channels_; }
   int height() { return height_; }
@@ -56,6 +79,12 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   Blob<Dtype> added_data_;
   Blob<Dtype> added_label_;
   bool has_new_data_;
+  // Buffers for AcquireBuffer and ReleaseBuffer, if num_buffers is set, and
+  // the buffer the tops point to.
+  vector<shared_ptr<Batch<Dtype> > > buffers_;
+  BlockingQueue<Batch<Dtype>*> buffer_free_;
+  BlockingQueue<Batch<Dtype>*> buffer_full_;
+  Batch<Dtype>* forwarded_buffer_;
 };
 
 }  // namespace caffe
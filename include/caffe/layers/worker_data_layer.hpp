@@ -0,0 +1,71 @@
+#ifndef CAFFE_WORKER_DATA_LAYER_HPP_
+#define CAFFE_WORKER_DATA_LAYER_HPP_
+
+#include <sys/types.h>
+
+#include <map>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/shared_batch_ring.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Runs a data layer in worker processes, and provides the batches
+ *        they produce to the Net.
+ *
+ * Each worker process sets up its own copy of worker_data_param.layer and
+ * copies the tops of its Forward into a slot of a ring in shared memory;
+ * the prefetch thread hands the filled slots to Forward without copying
+ * them. A layer that holds a lock while loading data, such as a Python
+ * layer and its interpreter lock, then no longer runs in turn with the
+ * rest of the Net, and several copies of it run in parallel.
+ *
+ * The processes are forked when the layer is set up: the workers start
+ * from a copy of the process at that point, run on CPU, and must not use
+ * CUDA. A supervisor process restarts the workers that die; the workers
+ * stop when the layer is destroyed, after its prefetch thread.
+ */
+template <typename Dtype>
+class WorkerDataLayer : public BasePrefetchingDataLayer<Dtype> {
+ public:
+  explicit WorkerDataLayer(const LayerParameter& param)
+      : BasePrefetchingDataLayer<Dtype>(param), supervisor_() {}
+  virtual ~WorkerDataLayer();
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "WorkerData"; }
+  virtual inline int ExactNumBottomBlobs() const { return 0; }
+  virtual inline int MinTopBlobs() const { return 1; }
+
+  /// @brief The process id of a worker, which changes when it is restarted.
+  pid_t worker_pid(int worker) const { return ring_->worker_pid(worker); }
+
+ protected:
+  virtual void load_batch(Batch<Dtype>* batch);
+  // The parameter of the layer run by the workers.
+  LayerParameter WorkerLayerParam() const;
+  // Starts the workers, and restarts those that die, until shutdown.
+  void Supervise();
+  pid_t StartWorker(int worker);
+  // Fills slots of ring_ with the tops of the layer, until shutdown.
+  void RunWorker(int worker);
+  Blob<Dtype>* batch_blob(Batch<Dtype>* batch, int i);
+
+  // Shapes of the tops, and their offset in a slot.
+  vector<vector<int> > shapes_;
+  vector<size_t> offsets_;
+  shared_ptr<SharedBatchRing> ring_;
+  pid_t supervisor_;
+  // The slot each prefetch batch points to, released when it is reloaded.
+  std::map<Batch<Dtype>*, int> batch_slots_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WORKER_DATA_LAYER_HPP_
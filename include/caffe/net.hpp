@@ -91,6 +91,12 @@ class Net {
 
   /// @brief Updates the network weights based on the diff values computed.
   void Update();
+  /**
+   * @brief Scales the gradients of Backward by scale, through the diffs of the
+   *        blobs in the loss, which hold their loss weight.
+   */
+  void set_loss_scale(Dtype scale);
+  inline Dtype loss_scale() const { return loss_scale_; }
   /**
    * @brief Shares weight data of owner blobs with shared blobs.
    *
@@ -104,6 +110,11 @@ class Net {
    *        additional memory) the pre-trained layers from another Net.
    */
   void ShareTrainedLayersWith(const Net* other);
+  /**
+   * @brief For an already initialized net, copies the values of the
+   *        pre-trained layers from another Net.
+   */
+  void CopyTrainedLayersFrom(const Net* other);
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
@@ -116,8 +127,15 @@ class Net {
   void CopyTrainedLayersFromHDF5(const string trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
+  /// @brief Writes the net to a proto, with the values of params, e.g. a
+  ///        copy of params() taken earlier, instead of its own.
+  void ToProto(NetParameter* param, bool write_diff,
+      const vector<shared_ptr<Blob<Dtype> > >& params) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
+  /// @brief Writes the net to an HDF5 file, with the values of params.
+  void ToHDF5(const string& filename, bool write_diff,
+      const vector<shared_ptr<Blob<Dtype> > >& params) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -177,6 +195,23 @@ class Net {
   inline const vector<Blob<Dtype>*>& learnable_params() const {
     return learnable_params_;
   }
+  /**
+   * @brief Returns a blob whose data and diff hold the data and the diffs of
+   *        learnable_params() one after the other, if contiguous_params, in
+   *        CPU mode, and unless the buffers of the params have been replaced
+   *        since (e.g. by CPUParams); NULL otherwise.
+   */
+  Blob<Dtype>* learnable_params_arena();
+  /// @brief Whether the net frees activations, and recomputes them in Backward
+  inline bool checkpoint_activations() const {
+    return !layer_checkpoint_.empty();
+  }
+  /**
+   * @brief Returns the bytes of the data of the blobs, and at most of those
+   *        allocated at once if checkpoint_activations: the blobs kept, and
+   *        the largest segment of blobs recomputed.
+   */
+  void ActivationMemory(size_t* total, size_t* peak) const;
   /// @brief returns the learnable parameter learning rate multipliers
   inline const vector<float>& params_lr() const { return params_lr_; }
   inline const vector<bool>& has_params_lr() const { return has_params_lr_; }
@@ -265,6 +300,22 @@ class Net {
   /// @brief Append a new parameter blob to the net.
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
+  /// @brief Share, or copy, the blobs of the layers of other.
+  void ShareOrCopyTrainedLayers(const Net* other, bool copy);
+  /// @brief Move the learnable params into param_arena_.
+  void InitParamArena();
+  /// @brief Choose the checkpoints, and the blobs to recompute.
+  void InitCheckpoints();
+  /// @brief Run Forward again on the layers of a segment but its checkpoint.
+  void RecomputeSegment(int segment);
+  /// @brief Round the tops of a layer, or the diffs of its bottoms, to
+  ///        bfloat16 precision.
+  void RoundBF16(int layer_id, bool backward);
+  /// @brief Free the tops of the layers of a segment that are recomputed.
+  void ReleaseSegment(int segment, bool diff);
+  /// @brief Free the blob, if recomputed, unless it shares the memory of a
+  ///        blob kept, or read after layer layer_id.
+  void ReleaseBlob(int blob_id, int layer_id, bool diff);
 
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
@@ -326,6 +377,25 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// The data and the diffs of learnable_params_, if contiguous_params
+  shared_ptr<Blob<Dtype> > param_arena_;
+  /// Whether each layer is a checkpoint, if checkpoint_activations: its tops
+  /// are kept from Forward to Backward, while those of the others are freed
+  /// and recomputed.
+  vector<bool> layer_checkpoint_;
+  /// The first layer of the segment of each layer, which ends with a
+  /// checkpoint
+  vector<int> layer_segment_;
+  /// The last layer reading each blob recomputed, which frees it; -1 for
+  /// the blobs kept
+  vector<int> blob_last_use_;
+  /// The segment Backward last recomputed, -1 if none
+  int recomputed_segment_;
+  /// Whether each layer rounds its tops and its bottom diffs, if
+  /// bf16_activations
+  vector<bool> layer_bf16_;
+  /// The scale of the loss weights in the diffs of the blobs in the loss
+  Dtype loss_scale_;
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
@@ -2,8 +2,8 @@
 #define CAFFE_PARALLEL_HPP_
 
 #ifdef USE_NCCL
-
 #include <boost/thread.hpp>
+#endif  // USE_NCCL
 
 #include <string>
 #include <vector>
@@ -16,7 +16,13 @@
 #include "caffe/solver.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/gradient_compressor.hpp"
 #include "caffe/util/nccl.hpp"
+#include "caffe/util/tcp_ring.hpp"
+
+namespace boost {
+class barrier;
+}
 
 namespace caffe {
 
@@ -48,6 +54,208 @@ class Params {
 DISABLE_COPY_AND_ASSIGN(Params);
 };
 
+// Params stored in host memory.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  explicit CPUParams(shared_ptr<Solver<Dtype> > root_solver);
+  virtual ~CPUParams();
+
+  void Configure(Solver<Dtype>* solver) const;
+
+ protected:
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+template<typename Dtype>
+class CPUReplica;
+
+/**
+ * @brief Synchronous data-parallel training on the CPU, with replicas of the
+ *        train net running forward and backward on threads.
+ *
+ * Replica i is given rank i of Caffe::solver_count(), so that data layers
+ * read its own share of the batches. All replicas read the weights from the
+ * single buffer of CPUParams, and write their gradients to buffers of their
+ * own, which all threads then average into the solver's: each thread sums
+ * the gradients of all replicas over one slice of the buffers, block by
+ * block, as a tree of pairwise sums. The solver alone updates the weights.
+ * Parameters the solver does not update (lr_mult 0, as the statistics of
+ * BatchNorm) stay private to each replica, as layers may write them.
+ */
+template<typename Dtype>
+class CPUParallel : public CPUParams<Dtype>,
+                    public Solver<Dtype>::Callback {
+ public:
+  /**
+   * Trains on Caffe::solver_count() replicas, including the net of solver,
+   * which should be created with that solver count already set.
+   */
+  explicit CPUParallel(shared_ptr<Solver<Dtype> > solver);
+  ~CPUParallel();
+
+  /**
+   * Solves, running the solver on the current thread.
+   */
+  void Run();
+
+ protected:
+  void on_start();
+  void on_gradients_ready();
+  // Averages the gradients of all replicas over slice rank of the buffers.
+  void Reduce(int rank);
+
+  shared_ptr<Solver<Dtype> > solver_;
+  boost::barrier* barrier_;
+  // Gradient buffers of the replicas, by rank
+  vector<Dtype*> diffs_;
+  // Set by the solver when it is done, for the other replicas to exit
+  bool stop_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+
+  friend class CPUReplica<Dtype>;
+};
+
+template<typename Dtype>
+class HogwildWorker;
+
+/**
+ * @brief Asynchronous data-parallel training on the CPU, as in Hogwild [1]:
+ *        workers on threads run solvers of their own, on replicas of the
+ *        train net, and update the weights without locks.
+ *
+ * Worker i is given rank i of Caffe::solver_count(), so that data layers
+ * read its own share of the batches, and runs up to max_iter iterations. All
+ * workers read and update the single weight buffer of CPUParams, racing on
+ * purpose, while each keeps its own gradients and solver history. The
+ * solver given runs as the worker of rank 0, on the current thread, and
+ * alone tests, displays and snapshots. The other workers stop before its
+ * last update, so that the final snapshot is consistent. Parameters the
+ * solvers do not update (lr_mult 0) stay private to each worker.
+ *
+ * [1] F. Niu, B. Recht, C. Re and S. J. Wright, "Hogwild!: A Lock-Free
+ *     Approach to Parallelizing Stochastic Gradient Descent." NIPS 2011.
+ */
+template<typename Dtype>
+class Hogwild : public CPUParams<Dtype>,
+                public Solver<Dtype>::Callback {
+ public:
+  /**
+   * Trains on Caffe::solver_count() workers, including solver, which should
+   * be created with that solver count already set.
+   */
+  explicit Hogwild(shared_ptr<Solver<Dtype> > solver);
+  ~Hogwild();
+
+  /**
+   * Solves, running the solver on the current thread.
+   */
+  void Run();
+
+ protected:
+  void on_start();
+  void on_gradients_ready();
+  // Waits for the other workers to finish their iteration and exit.
+  void StopWorkers();
+
+  shared_ptr<Solver<Dtype> > solver_;
+  vector<shared_ptr<HogwildWorker<Dtype> > > workers_;
+  boost::barrier* barrier_;
+  // Set when the workers should exit
+  bool stop_;
+  // Iterations done by each worker
+  vector<int> iters_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+
+  friend class HogwildWorker<Dtype>;
+};
+
+template<typename Dtype>
+class TCPCommThread;
+
+/**
+ * @brief Synchronous data-parallel training on the CPU, across processes
+ *        connected in a TCPRing, possibly on several machines.
+ *
+ * The process of rank Caffe::solver_rank() among Caffe::solver_count() runs
+ * its own solver, on the weights of rank 0, and with the gradients averaged
+ * over all ranks. With layer_wise_reduce, a thread reduces the gradients of
+ * the layers whose backward is done while the net computes the others, in
+ * buckets of reduce_bucket_size values. With gradient_compression, each
+ * process encodes its buckets, gathers the encodings of all processes and
+ * sums them, instead of reducing them.
+ */
+template<typename Dtype>
+class TCPComm : public CPUParams<Dtype>,
+                public Solver<Dtype>::Callback,
+                public Net<Dtype>::Callback {
+ public:
+  /**
+   * See TCPRing for the rendezvous.
+   */
+  TCPComm(shared_ptr<Solver<Dtype> > solver, const string& rendezvous);
+  ~TCPComm();
+
+  /**
+   * Broadcast weights from rank 0 other solvers.
+   */
+  void Broadcast();
+
+  /**
+   * Broadcasts the weights and solves.
+   */
+  void Run();
+
+  inline TCPRing* ring() { return ring_.get(); }
+
+  // A range of the gradients reduced at once
+  struct Bucket {
+    Dtype* diff;
+    size_t count;
+  };
+
+ protected:
+  void on_start();
+  void run(int layer);  // Net callback
+  void on_gradients_ready();
+  // Queues the gradients gathered since the last bucket for reduction.
+  void Push();
+  // Averages count gradients in place over all ranks.
+  void Reduce(Dtype* diff, size_t count);
+
+  shared_ptr<Solver<Dtype> > solver_;
+  shared_ptr<TCPRing> ring_;
+  shared_ptr<GradientCompressor<Dtype> > compressor_;
+  // Encodings of a bucket gathered from all ranks
+  vector<char> gathered_;
+  // Bytes of gradients reduced, to compare to the bytes sent
+  uint64_t reduced_bytes_;
+  shared_ptr<TCPCommThread<Dtype> > thread_;
+  // Buckets of the current iteration; the last one is being filled.
+  vector<Bucket> buckets_;
+  int num_buckets_;
+  // Backward passes done in the current iteration, see iter_size
+  int backward_passes_;
+  BlockingQueue<Bucket*> pending_;
+  BlockingQueue<Bucket*> reduced_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+
+  friend class TCPCommThread<Dtype>;
+};
+
+#ifdef USE_NCCL
+
 // Params stored in GPU memory.
 template<typename Dtype>
 class GPUParams : public Params<Dtype> {
@@ -117,7 +325,8 @@ class NCCL : public GPUParams<Dtype>,
   using Params<Dtype>::diff_;
 };
 
+#endif  // USE_NCCL
+
 }  // namespace caffe
 
-#endif  // USE_NCCL
 #endif  // header
@@ -19,11 +19,14 @@ class SGDSolver : public Solver<Dtype> {
       : Solver<Dtype>(param) { PreSolve(); }
   explicit SGDSolver(const string& param_file)
       : Solver<Dtype>(param_file) { PreSolve(); }
+  virtual ~SGDSolver() { this->WaitForSnapshot(); }
   virtual inline const char* type() const { return "SGD"; }
 
   const vector<shared_ptr<Blob<Dtype> > >& history() { return history_; }
 
  protected:
+  typedef typename Solver<Dtype>::SnapshotData SnapshotData;
+
   void PreSolve();
   Dtype GetLearningRate();
   virtual void ApplyUpdate();
@@ -31,9 +34,49 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
-  virtual void SnapshotSolverState(const string& model_filename);
-  virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
-  virtual void SnapshotSolverStateToHDF5(const string& model_filename);
+  // Divides the gradients by the loss scale, and adapts it if
+  // dynamic_loss_scale. Returns false if the gradients overflow, to skip the
+  // update.
+  bool UnscaleGradients();
+
+  /**
+   * @brief The pointers and the scalars of the update of a parameter blob,
+   *        taken before the fused update splits the values across threads.
+   */
+  struct FusedParam {
+    int count;
+    Dtype* data;
+    Dtype* diff;
+    // history_[i], and history_[i + learnable_params().size()] if any
+    Dtype* history;
+    Dtype* history2;
+    Dtype normalization;
+    Dtype l1_decay;
+    Dtype l2_decay;
+    Dtype rate;
+  };
+  // The gradient of value i, normalized and regularized.
+  static inline Dtype FusedGradient(const FusedParam& param, int i) {
+    const Dtype w = param.data[i];
+    return param.normalization * param.diff[i] + param.l2_decay * w +
+        param.l1_decay * ((Dtype(0) < w) - (w < Dtype(0)));
+  }
+  // Updates the history of values [begin, end) of param, sets their diff to
+  // the update, and subtracts it from their data.
+  virtual void FusedUpdateValues(const FusedParam& param, int begin, int end);
+  void FusedUpdate(Dtype rate);
+  // Updates the values [begin, end) of the concatenated parameters.
+  void FusedUpdateRange(size_t begin, size_t end);
+
+  virtual vector<shared_ptr<Blob<Dtype> > > SnapshotHistory() {
+    return history_;
+  }
+  virtual void SnapshotSolverState(const string& model_filename,
+      const SnapshotData& data);
+  virtual void SnapshotSolverStateToBinaryProto(const string& model_filename,
+      const SnapshotData& data);
+  virtual void SnapshotSolverStateToHDF5(const string& model_filename,
+      const SnapshotData& data);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file);
   // history maintains the historical momentum data.
@@ -41,6 +84,9 @@ class SGDSolver : public Solver<Dtype> {
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  vector<FusedParam> fused_params_;
+  // The iterations since the loss scale last changed, if dynamic_loss_scale
+  int loss_scale_iters_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -55,7 +101,10 @@ class NesterovSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "Nesterov"; }
 
  protected:
+  typedef typename SGDSolver<Dtype>::FusedParam FusedParam;
+
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdateValues(const FusedParam& param, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -70,7 +119,10 @@ class AdaGradSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "AdaGrad"; }
 
  protected:
+  typedef typename SGDSolver<Dtype>::FusedParam FusedParam;
+
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdateValues(const FusedParam& param, int begin, int end);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -90,7 +142,10 @@ class RMSPropSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "RMSProp"; }
 
  protected:
+  typedef typename SGDSolver<Dtype>::FusedParam FusedParam;
+
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdateValues(const FusedParam& param, int begin, int end);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -113,8 +168,11 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "AdaDelta"; }
 
  protected:
+  typedef typename SGDSolver<Dtype>::FusedParam FusedParam;
+
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdateValues(const FusedParam& param, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -137,8 +195,11 @@ class AdamSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "Adam"; }
 
  protected:
+  typedef typename SGDSolver<Dtype>::FusedParam FusedParam;
+
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdateValues(const FusedParam& param, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
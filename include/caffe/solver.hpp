@@ -32,6 +32,11 @@ namespace caffe {
  */
 typedef boost::function<SolverAction::Enum()> ActionCallback;
 
+template <typename Dtype>
+class SnapshotWriter;
+template <typename Dtype>
+class AsyncTester;
+
 /**
  * @brief An interface for classes that perform optimization on Net%s.
  *
@@ -45,6 +50,8 @@ class Solver {
   explicit Solver(const string& param_file);
   void Init(const SolverParameter& param);
   void InitTrainNet();
+  // Builds the parameters of the train net, as InitTrainNet creates it.
+  void GetTrainNetParam(NetParameter* net_param) const;
   void InitTestNets();
 
   // Client of the Solver optionally may call this in order to set the function
@@ -66,6 +73,13 @@ class Solver {
   // function that produces a SolverState protocol buffer that needs to be
   // written to disk together with the learned net.
   void Snapshot();
+  // Waits for the snapshot written in the background, if any (see
+  // SolverParameter.snapshot_async). Solvers call it in their destructor,
+  // as the writes call SnapshotSolverState.
+  void WaitForSnapshot();
+  // Waits for the test run in the background, if any (see
+  // SolverParameter.test_async).
+  void WaitForTest();
   virtual ~Solver() {}
   inline const SolverParameter& param() const { return param_; }
   inline shared_ptr<Net<Dtype> > net() { return net_; }
@@ -95,15 +109,39 @@ class Solver {
   virtual inline const char* type() const { return ""; }
 
  protected:
+  /**
+   * @brief The values a snapshot writes, either the blobs of the net and of
+   *        the solver, or copies of them written in the background.
+   */
+  struct SnapshotData {
+    int iter;
+    int current_step;
+    // The blobs of net_->params()
+    vector<shared_ptr<Blob<Dtype> > > params;
+    // The blobs of SnapshotHistory()
+    vector<shared_ptr<Blob<Dtype> > > history;
+  };
+
   // Make and apply the update value for the current iteration.
   virtual void ApplyUpdate() = 0;
+  // The state of the solver a snapshot saves with the net, none by default.
+  virtual vector<shared_ptr<Blob<Dtype> > > SnapshotHistory() {
+    return vector<shared_ptr<Blob<Dtype> > >();
+  }
+  void WriteSnapshot(const SnapshotData& data);
   string SnapshotFilename(const string extension);
-  string SnapshotToBinaryProto();
-  string SnapshotToHDF5();
+  string SnapshotFilename(const string extension, int iter);
+  string SnapshotToBinaryProto(const SnapshotData& data);
+  string SnapshotToHDF5(const SnapshotData& data);
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
-  virtual void SnapshotSolverState(const string& model_filename) = 0;
+  // Runs test net test_net_id, which holds the weights of iteration iter, and
+  // logs its outputs. From the thread of test_async, the actions requested
+  // are left to the train loop.
+  void RunTest(const int test_net_id, const int iter, const bool async);
+  virtual void SnapshotSolverState(const string& model_filename,
+      const SnapshotData& data) = 0;
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
@@ -129,6 +167,17 @@ class Solver {
   Timer iteration_timer_;
   float iterations_last_;
 
+  // Writes the snapshots in the background, if snapshot_async
+  shared_ptr<SnapshotWriter<Dtype> > snapshot_writer_;
+  // Runs the test nets in the background, if test_async. Declared after
+  // test_nets_, so that it is destroyed before them.
+  shared_ptr<AsyncTester<Dtype> > async_tester_;
+
+  template <typename T>
+  friend class SnapshotWriter;
+  template <typename T>
+  friend class AsyncTester;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -67,6 +67,9 @@ class SyncedMemory {
   void* mutable_gpu_data();
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; }
+  // Frees the memory it owns, unless it holds memory it does not own. The
+  // memory is allocated again, and zeroed, when next accessed.
+  void release();
   size_t size() { return size_; }
 
 #ifndef CPU_ONLY
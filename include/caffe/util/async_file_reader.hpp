@@ -0,0 +1,98 @@
+#ifndef CAFFE_UTIL_ASYNC_FILE_READER_HPP_
+#define CAFFE_UTIL_ASYNC_FILE_READER_HPP_
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief Reads whole files asynchronously, with up to depth reads in flight,
+ *        so that the latency of many small reads overlaps.
+ *
+ * Reads are submitted to io_uring when Caffe is built with USE_IO_URING and
+ * the kernel allows it, and are otherwise done by a pool of depth threads.
+ * Reads complete in any order and are identified by the id they were
+ * submitted with. Submit and WaitAny must be called from a single thread.
+ */
+class AsyncFileReader {
+ public:
+  explicit AsyncFileReader(int depth);
+  ~AsyncFileReader();
+
+  /// @brief Starts reading the whole of filename.
+  void Submit(uint64_t id, const string& filename);
+  /**
+   * @brief Waits for one of the submitted reads to complete, and returns its
+   *        id. The file contents are swapped into data; ok is set to false
+   *        if the file could not be read.
+   */
+  uint64_t WaitAny(string* data, bool* ok);
+
+  /// @brief The number of submitted reads not yet returned by WaitAny.
+  inline int pending() const { return pending_; }
+  /// @brief "io_uring" or "threads".
+  const char* backend() const;
+
+  struct Request {
+    uint64_t id;
+    string filename;
+    string data;
+    bool ok;
+    int fd;
+    size_t offset;
+    struct iovec iov;
+  };
+
+ protected:
+  // Thread pool worker.
+  void ThreadEntry();
+#ifdef USE_IO_URING
+  bool InitRing();
+  void StartRead(Request* request);
+  void QueueRead(Request* request);
+  void FinishRead(Request* request, bool ok);
+  void ReapCompletion();
+
+  int ring_fd_;
+  unsigned ring_entries_;
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  void* sqes_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  void* cqes_;
+  int in_flight_;
+  // Reads waiting for a free slot, and reads done but not yet returned.
+  std::deque<Request*> backlog_;
+  std::deque<Request*> completed_;
+#endif
+
+  const int depth_;
+  int pending_;
+  bool use_ring_;
+  vector<shared_ptr<boost::thread> > threads_;
+  BlockingQueue<Request*> todo_;
+  BlockingQueue<Request*> done_;
+
+  DISABLE_COPY_AND_ASSIGN(AsyncFileReader);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_ASYNC_FILE_READER_HPP_
@@ -0,0 +1,37 @@
+#ifndef CAFFE_UTIL_COMPRESSION_HPP_
+#define CAFFE_UTIL_COMPRESSION_HPP_
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/// @brief Whether Caffe was built with the given codec.
+bool CompressionAvailable(Datum_Compression compression);
+
+/**
+ * @brief Compresses the pixels, or else the float_data, of a raw Datum into
+ *        its data field, and records the codec in the Datum.
+ *
+ * level is the compression level of the codec, 0 for its default; LZ4 has a
+ * single level. Encoded and already compressed Datums are left untouched.
+ * Returns false if the Datum was not compressed.
+ */
+bool CompressDatum(Datum_Compression compression, int level, Datum* datum);
+
+/**
+ * @brief Sets uncompressed to a copy of a compressed Datum, with its pixels
+ *        or float_data decompressed.
+ *
+ * The buffers of uncompressed are reused, so decompressing into the same
+ * Datum again does not allocate.
+ */
+void DecompressDatum(const Datum& datum, Datum* uncompressed);
+
+/// @brief Decompresses a Datum in place; returns false if it was not
+///        compressed.
+bool DecompressDatum(Datum* datum);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_COMPRESSION_HPP_
@@ -0,0 +1,93 @@
+#ifndef CAFFE_UTIL_DATA_METRICS_HPP_
+#define CAFFE_UTIL_DATA_METRICS_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Histogram of durations, in microseconds, in power of two buckets.
+ */
+class TimeHistogram {
+ public:
+  TimeHistogram();
+  void Add(double us);
+
+  inline int count() const { return count_; }
+  inline double total() const { return total_; }
+  inline double mean() const { return count_ ? total_ / count_ : 0; }
+  inline double max() const { return max_; }
+  /// @brief Upper bound of the bucket holding the p-th percentile.
+  double Percentile(double p) const;
+
+  // Bucket i counts durations in [2^(i-1), 2^i) us; bucket 0 those under 1us.
+  static const int kBuckets = 32;
+
+ protected:
+  int count_;
+  double total_;
+  double max_;
+  int buckets_[kBuckets];
+};
+
+/**
+ * @brief Throughput and starvation counters of a prefetching data layer.
+ *
+ * The prefetch thread records the time it spends in each stage of loading
+ * a batch, and the time it waits for a free batch; Forward records the time
+ * it waits for a loaded batch and how many were queued. Counters cover the
+ * period since the last Reset, and may be read from any thread.
+ */
+class DataMetrics {
+ public:
+  enum Stage { READ = 0, DECODE, TRANSFORM, COPY, NUM_STAGES };
+  static const char* StageName(int stage);
+
+  struct Counters {
+    Counters();
+    int batches;
+    int items;
+    // Forward calls, and the sum of the loaded batches queued at each.
+    int forwards;
+    int queued;
+    TimeHistogram consumer_wait;
+    TimeHistogram producer_wait;
+    TimeHistogram stages[NUM_STAGES];
+    // Wall time since the last Reset.
+    double seconds;
+
+    inline double items_per_second() const {
+      return seconds > 0 ? items / seconds : 0;
+    }
+    inline double mean_queue_depth() const {
+      return forwards ? static_cast<double>(queued) / forwards : 0;
+    }
+  };
+
+  DataMetrics();
+
+  void AddStageTime(Stage stage, double us);
+  void AddBatch(int items, double producer_wait_us);
+  void AddForward(int queue_depth, double consumer_wait_us);
+  /// @brief A consistent copy of the counters.
+  Counters Get() const;
+  void Reset();
+  /// @brief One line summary of the counters.
+  string Summary() const;
+
+ protected:
+  // Holds the mutex and the start time, as BlockingQueue does, to keep
+  // boost/thread.hpp out of headers compiled by NVCC.
+  class sync;
+
+  shared_ptr<sync> sync_;
+  Counters counters_;
+
+  DISABLE_COPY_AND_ASSIGN(DataMetrics);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DATA_METRICS_HPP_
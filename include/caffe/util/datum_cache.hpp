@@ -0,0 +1,64 @@
+#ifndef CAFFE_UTIL_DATUM_CACHE_HPP_
+#define CAFFE_UTIL_DATUM_CACHE_HPP_
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A memory-bounded, least recently used cache of decoded Datums,
+ *        keyed by record.
+ *
+ * Data layers keep the decoded (and resized) pixels of each record here so
+ * that later epochs skip reading and decoding it again; random crops,
+ * mirroring and mean subtraction are still applied to every emission by the
+ * DataTransformer. The cache is not thread-safe.
+ */
+class DatumCache {
+ public:
+  explicit DatumCache(size_t capacity_bytes);
+
+  /// @brief Copies the Datum cached for key into datum, if there is one.
+  bool Get(const string& key, Datum* datum);
+  /// @brief Caches datum under key, evicting the least recently used Datums
+  ///        as needed to stay within capacity.
+  void Put(const string& key, const Datum& datum);
+
+  inline size_t capacity_bytes() const { return capacity_bytes_; }
+  inline size_t size_bytes() const { return size_bytes_; }
+  inline size_t size() const { return entries_.size(); }
+  inline uint64_t hits() const { return hits_; }
+  inline uint64_t misses() const { return misses_; }
+  inline uint64_t evictions() const { return evictions_; }
+
+  /// @brief Logs the hit rate, evictions and memory use.
+  void LogStats(const string& name) const;
+
+ protected:
+  typedef std::list<std::pair<string, Datum> > EntryList;
+
+  static size_t EntryBytes(const string& key, const Datum& datum);
+
+  const size_t capacity_bytes_;
+  size_t size_bytes_;
+  uint64_t hits_;
+  uint64_t misses_;
+  uint64_t evictions_;
+  // Most recently used first.
+  EntryList entries_;
+  std::map<string, EntryList::iterator> index_;
+
+  DISABLE_COPY_AND_ASSIGN(DatumCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DATUM_CACHE_HPP_
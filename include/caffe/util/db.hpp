@@ -47,6 +47,8 @@ class DB {
 
 DB* GetDB(DataParameter::DB backend);
 DB* GetDB(const string& backend);
+// Creates the DB for backend, configured by the backend-specific parameters.
+DB* GetDB(const DataParameter& param);
 
 }  // namespace db
 }  // namespace caffe
@@ -0,0 +1,129 @@
+#ifndef CAFFE_UTIL_DB_PACKED_HPP
+#define CAFFE_UTIL_DB_PACKED_HPP
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/util/db.hpp"
+
+namespace caffe { namespace db {
+
+/**
+ * Packed record file: an append-only DB for datasets that are written once
+ * and read sequentially, without LevelDB compaction or LMDB B-tree overhead.
+ *
+ * A packed DB is a directory with two files:
+ *   data:  a magic number, then one record per Put:
+ *          [uint32 key size][uint32 value size][uint32 crc32c][key][value]
+ *          where the CRC-32C checksum covers the key and the value.
+ *   index: a magic number, then the uint64 offset in data of every record.
+ * Commit appends records to data before appending their offsets to index, so
+ * the index only references complete records. Integers are little endian.
+ */
+uint32_t Crc32c(const char* data, size_t size, uint32_t crc = 0);
+
+class PackedCursor : public Cursor {
+ public:
+  explicit PackedCursor(const string& source);
+  virtual ~PackedCursor() { }
+  virtual void SeekToFirst() { Seek(0); }
+  virtual void Next() { Seek(index_ + 1); }
+  virtual string key() { return string(record_key_, key_size_); }
+  virtual string value() {
+    return string(record_key_ + key_size_, value_size_);
+  }
+  virtual bool valid() { return index_ < offsets_.size(); }
+
+ protected:
+  // Returns a pointer to size bytes of the data file starting at offset.
+  // The pointer stays valid until the next call.
+  virtual const char* Read(uint64_t offset, size_t size) = 0;
+  // Loads and verifies the index-th record.
+  void Seek(size_t index);
+
+  const string source_;
+  vector<uint64_t> offsets_;
+  size_t index_;
+  const char* record_key_;
+  uint32_t key_size_;
+  uint32_t value_size_;
+
+  DISABLE_COPY_AND_ASSIGN(PackedCursor);
+};
+
+// Reads through a read-only memory map of the data file.
+class PackedMmapCursor : public PackedCursor {
+ public:
+  explicit PackedMmapCursor(const string& source);
+  virtual ~PackedMmapCursor();
+
+ protected:
+  virtual const char* Read(uint64_t offset, size_t size);
+
+  char* map_;
+  size_t map_size_;
+};
+
+// Streams the data file through an aligned buffer of large sequential reads,
+// advising the kernel of the access pattern. With direct set, the file is
+// opened with O_DIRECT to bypass the page cache where the platform and file
+// system support it.
+class PackedStreamCursor : public PackedCursor {
+ public:
+  PackedStreamCursor(const string& source, bool direct);
+  virtual ~PackedStreamCursor();
+
+ protected:
+  virtual const char* Read(uint64_t offset, size_t size);
+
+  int fd_;
+  bool direct_;
+  char* buffer_;
+  size_t capacity_;
+  uint64_t buffer_offset_;
+  size_t buffer_size_;
+};
+
+class PackedTransaction : public Transaction {
+ public:
+  PackedTransaction(int data_fd, int index_fd, uint64_t* data_size)
+    : data_fd_(data_fd), index_fd_(index_fd), data_size_(data_size) { }
+  virtual void Put(const string& key, const string& value);
+  virtual void Commit();
+
+ private:
+  int data_fd_;
+  int index_fd_;
+  uint64_t* data_size_;
+  // Records and their offsets relative to the start of the batch.
+  string batch_;
+  vector<uint64_t> offsets_;
+
+  DISABLE_COPY_AND_ASSIGN(PackedTransaction);
+};
+
+class PackedDB : public DB {
+ public:
+  explicit PackedDB(DataParameter::PackedReadMode read_mode =
+      DataParameter_PackedReadMode_MMAP)
+    : read_mode_(read_mode), data_fd_(-1), index_fd_(-1), data_size_(0) { }
+  virtual ~PackedDB() { Close(); }
+  virtual void Open(const string& source, Mode mode);
+  virtual void Close();
+  virtual PackedCursor* NewCursor();
+  virtual PackedTransaction* NewTransaction();
+
+ private:
+  DataParameter::PackedReadMode read_mode_;
+  string source_;
+  int data_fd_;
+  int index_fd_;
+  uint64_t data_size_;
+};
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_PACKED_HPP
@@ -0,0 +1,95 @@
+#ifndef CAFFE_UTIL_GRADIENT_COMPRESSOR_HPP_
+#define CAFFE_UTIL_GRADIENT_COMPRESSOR_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Lossy encoding of the buckets of gradients exchanged between the
+ *        processes of data-parallel training.
+ *
+ * Every process encodes its gradients with Compress, gathers the encodings
+ * of all processes, and sums them with Accumulate. The encoding of a bucket
+ * has a fixed size, a multiple of 8 bytes, so that processes exchange them
+ * without a header.
+ */
+template <typename Dtype>
+class GradientCompressor {
+ public:
+  /// @brief Returns the compressor of param for a net of size gradients, or
+  ///        NULL for NONE.
+  static GradientCompressor<Dtype>* Create(
+      const GradientCompressionParameter& param, size_t size);
+  virtual ~GradientCompressor() {}
+
+  /// @brief Bytes Compress writes for count gradients.
+  virtual size_t CompressedSize(size_t count) const = 0;
+  /**
+   * @brief Encodes the count gradients of diff into data.
+   *
+   * offset is the position of the bucket in the gradients of the net, of
+   * size values, for compressors keeping state about each gradient.
+   */
+  virtual void Compress(const Dtype* diff, size_t count, size_t offset,
+      char* data) = 0;
+  /// @brief Adds to diff the count gradients encoded in data.
+  virtual void Accumulate(const char* data, size_t count, Dtype* diff)
+      const = 0;
+};
+
+/**
+ * @brief Encodes the largest gradients in magnitude, a ratio of each bucket,
+ *        as index and value pairs.
+ *
+ * The gradients left out are not lost: they are added to the gradients of
+ * the next iterations, until they are large enough to be sent.
+ */
+template <typename Dtype>
+class TopKCompressor : public GradientCompressor<Dtype> {
+ public:
+  TopKCompressor(float ratio, size_t size);
+
+  virtual size_t CompressedSize(size_t count) const;
+  virtual void Compress(const Dtype* diff, size_t count, size_t offset,
+      char* data);
+  virtual void Accumulate(const char* data, size_t count, Dtype* diff) const;
+
+ protected:
+  size_t K(size_t count) const;
+
+  const float ratio_;
+  // Gradients not sent yet, for the whole net
+  vector<Dtype> residual_;
+  vector<uint32_t> indices_;
+};
+
+/**
+ * @brief Encodes each gradient on 8 bits, as a multiple of the largest one
+ *        of its bucket divided by 127.
+ *
+ * Gradients are rounded up or down at random, with the probabilities that
+ * make the decoded value exact on average.
+ */
+template <typename Dtype>
+class QuantizeCompressor : public GradientCompressor<Dtype> {
+ public:
+  QuantizeCompressor() {}
+
+  virtual size_t CompressedSize(size_t count) const;
+  virtual void Compress(const Dtype* diff, size_t count, size_t offset,
+      char* data);
+  virtual void Accumulate(const char* data, size_t count, Dtype* diff) const;
+
+ protected:
+  vector<Dtype> random_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_GRADIENT_COMPRESSOR_HPP_
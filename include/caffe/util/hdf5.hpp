@@ -2,14 +2,21 @@
 #define CAFFE_UTIL_HDF5_H_
 
 #include <string>
+#include <vector>
 
 #include "hdf5.h"
 #include "hdf5_hl.h"
 
 #include "caffe/blob.hpp"
 
+namespace boost { class mutex; }
+
 namespace caffe {
 
+// The HDF5 library is usually not built thread-safe: threads calling it,
+// e.g. prefetch threads and snapshot writers, hold this lock.
+boost::mutex& hdf5_mutex();
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -20,6 +27,22 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob, bool reshape = false);
 
+/**
+ * @brief Returns the dimensions of a float or integer dataset, without
+ *        reading it.
+ */
+vector<hsize_t> hdf5_get_dataset_dims(hid_t file_id,
+    const char* dataset_name_);
+
+/**
+ * @brief Reads num_rows rows of a dataset, starting at first_row along its
+ *        first axis, into blob, which is reshaped to num_rows x the other
+ *        dimensions of the dataset. Only the selected rows are read.
+ */
+template <typename Dtype>
+void hdf5_load_nd_dataset_rows(hid_t file_id, const char* dataset_name_,
+    hsize_t first_row, hsize_t num_rows, Blob<Dtype>* blob);
+
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_IMAGE_DECODE_HPP_
+#define CAFFE_UTIL_IMAGE_DECODE_HPP_
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Largest libjpeg scaling denominator (1, 2, 4 or 8) for which both
+ *        sides of a height x width JPEG decode to at least
+ *        max(min_height, min_width) pixels.
+ *
+ * Both sides are compared to the larger target, since EXIF orientation may
+ * transpose the decoded image.
+ */
+int JPEGScaleDenom(int height, int width, int min_height, int min_width);
+
+/**
+ * @brief Reads from the header of an encoded image the size and the number
+ *        of channels it decodes to, if DecodeImageRegion can decode parts
+ *        of it.
+ *
+ * channels is 3 to decode the image in BGR, 1 in gray, or 0 in its own
+ * channels, as cv::imdecode does with CV_LOAD_IMAGE_COLOR,
+ * CV_LOAD_IMAGE_GRAYSCALE and CV_LOAD_IMAGE_UNCHANGED. A JPEG decodes at
+ * 1/2, 1/4 or 1/8 of its size as long as both of its sides stay at least
+ * max(min_height, min_width); 0 keeps the full size.
+ *
+ * Returns false for formats other than JPEG (with USE_LIBJPEG_TURBO) and PNG
+ * (with USE_LIBPNG), and for the images that cv::imdecode would decode
+ * differently: CMYK JPEGs, JPEGs to rotate by their EXIF orientation, and
+ * interlaced, 16 bit, low bit depth or transparent PNGs.
+ */
+bool DecodedImageShape(const char* data, size_t size, int channels,
+    int min_height, int min_width, int* height, int* width,
+    int* decoded_channels);
+
+/**
+ * @brief Decodes the height x width region at (y, x) of an encoded image
+ *        into region, as rows of interleaved channels.
+ *
+ * The arguments and the coordinates are those of DecodedImageShape. A JPEG
+ * is only decoded from the iMCU row holding the top of the region to the
+ * one holding its bottom, and in the iMCU columns the region spans. A PNG is
+ * decoded down to the bottom of the region; the rows above it are inflated,
+ * as the rest of the stream depends on them, but only the region is copied.
+ * Returns false if the image cannot be decoded.
+ */
+bool DecodeImageRegion(const char* data, size_t size, int channels,
+    int min_height, int min_width, int y, int x, int height, int width,
+    unsigned char* region);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IMAGE_DECODE_HPP_
@@ -90,6 +90,12 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+// Flushes the file temp to disk and renames it to filename, so that filename
+// is either left as it was or replaced by the complete file.
+void SyncAndRename(const string& temp, const string& filename);
+
+bool ReadFileToString(const string& filename, string* buffer);
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
@@ -141,8 +147,28 @@ cv::Mat ReadImageToCVMat(const string& filename,
 
 cv::Mat ReadImageToCVMat(const string& filename);
 
-cv::Mat DecodeDatumToCVMatNative(const Datum& datum);
-cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color);
+/**
+ * @brief Reads an image without resizing it, but lets a JPEG be decoded at
+ *        1/2, 1/4 or 1/8 of its size in the DCT domain, as long as both of
+ *        its sides stay at least max(min_height, min_width). The caller is
+ *        expected to resize or crop the result.
+ */
+cv::Mat ReadImageToCVMatAtLeast(const string& filename,
+    const int min_height, const int min_width, const bool is_color);
+
+/**
+ * @brief Decodes an encoded image with the given cv::imdecode flag, at a
+ *        reduced resolution under the same conditions as
+ *        ReadImageToCVMatAtLeast. A min_height or min_width of 0 decodes
+ *        the image at full size.
+ */
+cv::Mat DecodeImageToCVMat(const char* data, const size_t size,
+    const int cv_read_flag, const int min_height = 0, const int min_width = 0);
+
+cv::Mat DecodeDatumToCVMatNative(const Datum& datum,
+    const int min_height = 0, const int min_width = 0);
+cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color,
+    const int min_height = 0, const int min_width = 0);
 
 void CVMatToDatum(const cv::Mat& cv_img, Datum* datum);
 #endif  // USE_OPENCV
@@ -145,6 +145,11 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]))
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Rounds the elements of x in place to the nearest bfloat16, i.e. to 8 bits
+// of mantissa with the exponent range of float, ties to even.
+template <typename Dtype>
+void caffe_cpu_round_bf16(const int n, Dtype* x);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
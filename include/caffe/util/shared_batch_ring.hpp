@@ -0,0 +1,75 @@
+#ifndef CAFFE_UTIL_SHARED_BATCH_RING_HPP_
+#define CAFFE_UTIL_SHARED_BATCH_RING_HPP_
+
+#include <semaphore.h>
+#include <sys/types.h>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A ring of fixed size batch slots in shared memory, filled by
+ *        worker processes forked after its creation, and consumed by the
+ *        process that created it.
+ *
+ * A slot goes from free to filling, owned by the worker process that
+ * acquired it, to full, and is in use by the consumer until it releases it.
+ * Full slots are popped in the order they were filled. The semaphores and
+ * the mutex guarding the slots live in the shared memory too; the mutex is
+ * robust, so a worker dying while holding it does not block the others,
+ * and Reclaim frees the slots a dead worker was filling.
+ */
+class SharedBatchRing {
+ public:
+  SharedBatchRing(int num_slots, size_t slot_bytes, int num_workers);
+  ~SharedBatchRing();
+
+  /// @brief Waits for a free slot and assigns it to the calling process.
+  ///        Returns -1 once Shutdown has been called.
+  int AcquireFree();
+  void PushFull(int slot);
+  /// @brief Waits up to timeout_ms for a full slot; returns -1 on timeout.
+  int PopFull(int timeout_ms);
+  void Release(int slot);
+  /// @brief Frees the slots the process pid was filling when it died.
+  void Reclaim(pid_t pid);
+
+  /// @brief Makes AcquireFree return -1 in every process.
+  void Shutdown();
+  bool shutting_down() const;
+
+  /// @brief Process ids of the workers, as recorded by whoever forks them.
+  void set_worker_pid(int worker, pid_t pid);
+  pid_t worker_pid(int worker) const;
+
+  inline char* slot_data(int slot) { return data_ + slot * slot_bytes_; }
+  inline int num_slots() const { return num_slots_; }
+  inline size_t slot_bytes() const { return slot_bytes_; }
+
+ protected:
+  struct Header;
+  struct Slot;
+
+  Slot* slots() const;
+  pid_t* worker_pids() const;
+  void Lock();
+  void Unlock();
+  // Moves the oldest slot in state to new_state; returns -1 if there is none.
+  int Take(int state, int new_state);
+  void Wait(sem_t* sem, int timeout_ms);
+
+  const int num_slots_;
+  const size_t slot_bytes_;
+  const int num_workers_;
+  const pid_t creator_;
+  size_t mapped_bytes_;
+  Header* header_;
+  char* data_;
+
+  DISABLE_COPY_AND_ASSIGN(SharedBatchRing);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SHARED_BATCH_RING_HPP_
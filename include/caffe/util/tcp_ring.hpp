@@ -0,0 +1,71 @@
+#ifndef CAFFE_UTIL_TCP_RING_HPP_
+#define CAFFE_UTIL_TCP_RING_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief TCP connections between the processes of a distributed job, each
+ *        process sending to the next rank and receiving from the previous
+ *        one, with the collective operations of data-parallel training.
+ *
+ * All processes must call the collectives in the same order, on buffers of
+ * the same size.
+ */
+class TCPRing {
+ public:
+  /**
+   * @brief Connects process rank to the other world - 1 processes.
+   *
+   * rendezvous is either "file:" followed by a path prefix on a file system
+   * all processes share, where each process publishes the address it listens
+   * on, or the host:port addresses of all the processes, by rank, separated
+   * by commas.
+   */
+  TCPRing(int rank, int world, const string& rendezvous);
+  ~TCPRing();
+
+  /// @brief Copies the count values of rank 0 to the other ranks.
+  template <typename Dtype>
+  void Broadcast(Dtype* data, size_t count);
+  /// @brief Replaces the count values of every rank by their sum over all
+  ///        ranks: a reduce-scatter followed by an all-gather, each rank
+  ///        sending 2 (world - 1) / world of the buffer.
+  template <typename Dtype>
+  void AllReduce(Dtype* data, size_t count);
+  /// @brief Copies the size bytes of every rank r to gathered + r * size,
+  ///        on every rank. data may be the block of rank in gathered.
+  void AllGather(const char* data, size_t size, char* gathered);
+
+  inline int rank() const { return rank_; }
+  inline int world() const { return world_; }
+  /// @brief Bytes this process sent so far.
+  inline uint64_t bytes_sent() const { return bytes_sent_; }
+
+ protected:
+  // Sends to the next rank while receiving from the previous one, so that
+  // neither blocks the ring when the socket buffers are full.
+  void SendRecv(const void* send_data, size_t send_size, void* recv_data,
+      size_t recv_size);
+
+  const int rank_;
+  const int world_;
+  int next_;  // Socket to the next rank
+  int prev_;  // Socket from the previous rank
+  string published_;  // Rendezvous file with the address of this process
+  uint64_t bytes_sent_;
+  // Chunks received during AllReduce, before they are summed
+  vector<char> buffer_;
+
+  DISABLE_COPY_AND_ASSIGN(TCPRing);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TCP_RING_HPP_
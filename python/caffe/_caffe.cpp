@@ -15,6 +15,7 @@
 #include <fstream>  // NOLINT
 
 #include "caffe/caffe.hpp"
+#include "caffe/layers/base_data_layer.hpp"
 #include "caffe/layers/memory_data_layer.hpp"
 #include "caffe/layers/python_layer.hpp"
 #include "caffe/sgd_solvers.hpp"
@@ -270,6 +271,48 @@ bp::object BlobVec_add_blob(bp::tuple args, bp::dict kwargs) {
   return bp::object();
 }
 
+bp::dict TimeHistogram_ToDict(const TimeHistogram& histogram) {
+  bp::dict d;
+  d["count"] = histogram.count();
+  d["mean_ms"] = histogram.mean() / 1000;
+  d["p50_ms"] = histogram.Percentile(50) / 1000;
+  d["p90_ms"] = histogram.Percentile(90) / 1000;
+  d["p99_ms"] = histogram.Percentile(99) / 1000;
+  d["max_ms"] = histogram.max() / 1000;
+  return d;
+}
+
+// Returns the counters of a prefetching data layer as a dict, or None for
+// other layers.
+bp::object Layer_DataMetrics(Layer<Dtype>* layer, bool reset) {
+  BasePrefetchingDataLayer<Dtype>* data_layer =
+      dynamic_cast<BasePrefetchingDataLayer<Dtype>*>(layer);
+  if (!data_layer) {
+    return bp::object();
+  }
+  const DataMetrics::Counters counters = data_layer->metrics().Get();
+  if (reset) {
+    data_layer->metrics().Reset();
+  }
+  bp::dict d;
+  d["seconds"] = counters.seconds;
+  d["batches"] = counters.batches;
+  d["items"] = counters.items;
+  d["items_per_second"] = counters.items_per_second();
+  d["mean_queue_depth"] = counters.mean_queue_depth();
+  d["consumer_wait"] = TimeHistogram_ToDict(counters.consumer_wait);
+  d["producer_wait"] = TimeHistogram_ToDict(counters.producer_wait);
+  bp::dict stages;
+  for (int i = 0; i < DataMetrics::NUM_STAGES; ++i) {
+    if (counters.stages[i].count()) {
+      stages[DataMetrics::StageName(i)] =
+          TimeHistogram_ToDict(counters.stages[i]);
+    }
+  }
+  d["stages"] = stages;
+  return d;
+}
+
 template<typename Dtype>
 class SolverCallback: public Solver<Dtype>::Callback {
  protected:
@@ -476,6 +519,8 @@ BOOST_PYTHON_MODULE(_caffe) {
           bp::return_internal_reference<>()))
     .def("setup", &Layer<Dtype>::LayerSetUp)
     .def("reshape", &Layer<Dtype>::Reshape)
+    .def("data_metrics", &Layer_DataMetrics,
+        (bp::arg("self"), bp::arg("reset") = false))
     .add_property("type", bp::make_function(&Layer<Dtype>::type));
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Layer<Dtype>);
 
@@ -67,6 +67,11 @@ class TestNet(unittest.TestCase):
             self.assertEqual(layer_dict[name].type,
                              self.net.layers[i].type)
 
+    def test_data_metrics(self):
+        # only prefetching data layers keep metrics
+        for layer in self.net.layers:
+            self.assertIsNone(layer.data_metrics())
+
     def test_forward_backward(self):
         self.net.forward()
         self.net.backward()
@@ -49,6 +49,11 @@ void GlobalInit(int* pargc, char*** pargv) {
   ::google::InstallFailureSignalHandler();
 }
 
+void Caffe::set_cpu_random_seed(const unsigned int seed) {
+  // RNG seed
+  Get().random_generator_.reset(new RNG(seed));
+}
+
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
@@ -58,8 +63,7 @@ Caffe::Caffe()
 Caffe::~Caffe() { }
 
 void Caffe::set_random_seed(const unsigned int seed) {
-  // RNG seed
-  Get().random_generator_.reset(new RNG(seed));
+  set_cpu_random_seed(seed);
 }
 
 void Caffe::SetDevice(const int device_id) {
@@ -143,8 +147,7 @@ void Caffe::set_random_seed(const unsigned int seed) {
         g_curand_availability_logged = true;
     }
   }
-  // RNG seed
-  Get().random_generator_.reset(new RNG(seed));
+  set_cpu_random_seed(seed);
 }
 
 void Caffe::SetDevice(const int device_id) {
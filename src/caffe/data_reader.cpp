@@ -0,0 +1,120 @@
+#include <glob.h>
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+#include <stdint.h>
+
+#include <boost/thread.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/data_reader.hpp"
+#include "caffe/util/io.hpp"
+
+namespace caffe {
+
+DataReader::DataReader(const LayerParameter& param, const string& source,
+    BlockingQueue<Datum*>* free, BlockingQueue<Datum*>* full,
+    int stride, int phase, size_t cache_bytes)
+    : source_(source), stride_(stride), phase_(phase),
+      transform_param_(param.transform_param()),
+      free_(free), full_(full) {
+  CHECK_GT(stride_, 0);
+  CHECK_GE(phase_, 0);
+  CHECK_LT(phase_, stride_);
+  if (cache_bytes > 0) {
+    cache_.reset(new DatumCache(cache_bytes));
+  }
+  db_.reset(db::GetDB(param.data_param()));
+  db_->Open(source_, db::READ);
+  cursor_.reset(db_->NewCursor());
+  CHECK(cursor_->valid()) << "No records in " << source_;
+  StartInternalThread();
+}
+
+DataReader::~DataReader() {
+  StopInternalThread();
+}
+
+vector<string> DataReader::ExpandSources(const string& source) {
+  vector<string> sources;
+  std::stringstream ss(source);
+  string item;
+  while (std::getline(ss, item, ',')) {
+    if (item.empty()) {
+      continue;
+    }
+    if (item.find_first_of("*?[") == string::npos) {
+      sources.push_back(item);
+      continue;
+    }
+    glob_t matches;
+    const int rc = glob(item.c_str(), 0, NULL, &matches);
+    CHECK_EQ(rc, 0) << "No DB matches " << item;
+    for (size_t i = 0; i < matches.gl_pathc; ++i) {
+      sources.push_back(matches.gl_pathv[i]);
+    }
+    globfree(&matches);
+  }
+  CHECK(!sources.empty()) << "Empty data source: " << source;
+  return sources;
+}
+
+void DataReader::Read(Datum* datum) {
+  if (!cache_) {
+    datum->ParseFromString(cursor_->value());
+    return;
+  }
+  const string key = cursor_->key();
+  if (cache_->Get(key, datum)) {
+    return;
+  }
+  datum->ParseFromString(cursor_->value());
+  if (datum->encoded()) {
+#ifdef USE_OPENCV
+    CHECK(!(transform_param_.force_color() && transform_param_.force_gray()))
+        << "cannot set both force_color and force_gray";
+    const int min_size = transform_param_.decode_min_size();
+    cv::Mat cv_img;
+    if (transform_param_.force_color() || transform_param_.force_gray()) {
+      // If force_color then decode in color otherwise decode in gray.
+      cv_img = DecodeDatumToCVMat(*datum, transform_param_.force_color(),
+          min_size, min_size);
+    } else {
+      cv_img = DecodeDatumToCVMatNative(*datum, min_size, min_size);
+    }
+    CVMatToDatum(cv_img, datum);
+#else
+    LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+  }
+  cache_->Put(key, *datum);
+}
+
+void DataReader::InternalThreadEntry() {
+  uint64_t offset = 0;
+  try {
+    while (!must_stop()) {
+      if (offset % stride_ == phase_) {
+        Datum* datum = free_->pop();
+        Read(datum);
+        full_->push(datum);
+      }
+      cursor_->Next();
+      if (!cursor_->valid()) {
+        LOG_IF(INFO, Caffe::root_solver())
+            << "Restarting data prefetching from start of " << source_;
+        if (cache_ && Caffe::root_solver()) {
+          cache_->LogStats(source_);
+        }
+        cursor_->SeekToFirst();
+      }
+      ++offset;
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+}  // namespace caffe
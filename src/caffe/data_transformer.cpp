@@ -1,17 +1,91 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
+#include <boost/random.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
+#include "caffe/util/compression.hpp"
+#include "caffe/util/image_decode.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
 
+// Weights of the gray level of BGR pixels.
+static const float kGrayWeights[] = {0.114, 0.587, 0.299};
+
+// The principal components of the colors of ImageNet, for BGR pixels in
+// [0, 255]: the eigenvalues, and the eigenvectors as rows.
+static const float kImageNetEigval[] = {55.46, 4.794, 1.148};
+static const float kImageNetEigvec[] = {
+  -0.5836, -0.5808, -0.5675,
+  -0.6948, -0.0045, 0.7192,
+  0.4203, -0.8140, 0.4009,
+};
+
+// Resizes the region (h_off, w_off, crop_height, crop_width) of an image to
+// height x width with bilinear interpolation, mirrored if mirror. Pixel
+// (c, h, w) of the image is src[c * c_step + h * h_step + w * w_step].
+template <typename Dtype, typename T>
+static void ResizeRegion(const T* src, int channels, int c_step, int h_step,
+    int w_step, int h_off, int w_off, int crop_height, int crop_width,
+    bool mirror, int height, int width, Dtype* dst) {
+  // Sources and weights of the columns, shared by all rows.
+  vector<int> x0(width), x1(width);
+  vector<Dtype> fx(width);
+  for (int w = 0; w < width; ++w) {
+    const float x = std::min<float>(std::max<float>(
+        (w + 0.5f) * crop_width / width - 0.5f, 0), crop_width - 1);
+    const int left = static_cast<int>(x);
+    const int out = mirror ? width - 1 - w : w;
+    x0[out] = (w_off + left) * w_step;
+    x1[out] = (w_off + std::min(left + 1, crop_width - 1)) * w_step;
+    fx[out] = x - left;
+  }
+  for (int h = 0; h < height; ++h) {
+    const float y = std::min<float>(std::max<float>(
+        (h + 0.5f) * crop_height / height - 0.5f, 0), crop_height - 1);
+    const int top = static_cast<int>(y);
+    const Dtype fy = y - top;
+    for (int c = 0; c < channels; ++c) {
+      const T* row0 = src + c * c_step + (h_off + top) * h_step;
+      const T* row1 = src + c * c_step +
+          (h_off + std::min(top + 1, crop_height - 1)) * h_step;
+      Dtype* out = dst + (c * height + h) * width;
+      for (int w = 0; w < width; ++w) {
+        const Dtype a = static_cast<Dtype>(row0[x0[w]]);
+        const Dtype b = static_cast<Dtype>(row0[x1[w]]);
+        const Dtype d = static_cast<Dtype>(row1[x0[w]]);
+        const Dtype e = static_cast<Dtype>(row1[x1[w]]);
+        const Dtype upper = a + fx[w] * (b - a);
+        const Dtype lower = d + fx[w] * (e - d);
+        out[w] = upper + fy * (lower - upper);
+      }
+    }
+  }
+}
+
+// Sets gray to the gray level of the pixels of an image, the mean of its
+// channels unless they are BGR.
+template <typename Dtype>
+static void GrayLevel(const Dtype* data, int channels, int size,
+    Dtype* gray) {
+  for (int c = 0; c < channels; ++c) {
+    const Dtype weight = channels == 3 ? kGrayWeights[c] : 1. / channels;
+    if (c == 0) {
+      caffe_cpu_scale(size, weight, data, gray);
+    } else {
+      caffe_axpy(size, weight, data + c * size, gray);
+    }
+  }
+}
+
 template<typename Dtype>
 DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
     Phase phase)
@@ -36,6 +110,39 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
       mean_values_.push_back(param_.mean_value(c));
     }
   }
+  if (param_.decode_min_size() > 0) {
+    CHECK_GE(param_.decode_min_size(), param_.crop_size())
+        << "decode_min_size must be at least crop_size";
+  }
+  // Augmentations of the TRAIN phase.
+  const bool train = phase_ == TRAIN;
+  random_resized_crop_ = train &&
+      (param_.crop_min_area() < 1 || param_.crop_max_aspect() > 1);
+  batch_transform_ = random_resized_crop_ || (train &&
+      (param_.brightness() > 0 || param_.contrast() > 0 ||
+       param_.saturation() > 0 || param_.lighting_std() > 0));
+  if (random_resized_crop_) {
+    CHECK_GT(param_.crop_size(), 0)
+        << "crop_min_area and crop_max_aspect require crop_size";
+    CHECK_GT(param_.crop_min_area(), 0);
+    CHECK_LE(param_.crop_min_area(), 1);
+    CHECK_GE(param_.crop_max_aspect(), 1);
+  }
+  if (batch_transform_) {
+    CHECK(!param_.has_mean_file()) << "mean_file cannot be used with "
+        << "augmentations, use mean_value";
+  }
+  if (param_.lighting_eigval_size() > 0) {
+    lighting_eigval_.assign(param_.lighting_eigval().begin(),
+        param_.lighting_eigval().end());
+    lighting_eigvec_.assign(param_.lighting_eigvec().begin(),
+        param_.lighting_eigvec().end());
+  } else {
+    lighting_eigval_.assign(kImageNetEigval, kImageNetEigval + 3);
+    lighting_eigvec_.assign(kImageNetEigvec, kImageNetEigvec + 9);
+  }
+  CHECK_EQ(lighting_eigvec_.size() % lighting_eigval_.size(), 0)
+      << "lighting_eigvec must hold one row per lighting_eigval";
 }
 
 template<typename Dtype>
@@ -47,13 +154,30 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   const int datum_width = datum.width();
 
   const int crop_size = param_.crop_size();
-  const Dtype scale = param_.scale();
+  // TransformBatch applies the mean and the scale after the augmentations.
+  const Dtype scale = batch_transform_ ? 1 : param_.scale();
   const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
+  const bool has_mean_file = !batch_transform_ && param_.has_mean_file();
   const bool has_uint8 = data.size() > 0;
-  const bool has_mean_values = mean_values_.size() > 0;
+  const bool has_mean_values = !batch_transform_ && mean_values_.size() > 0;
 
   CHECK_GT(datum_channels, 0);
+  if (random_resized_crop_) {
+    int h_off, w_off, crop_height, crop_width;
+    RandomResizedCrop(datum_height, datum_width, &h_off, &w_off,
+        &crop_height, &crop_width);
+    const int size = datum_height * datum_width;
+    if (has_uint8) {
+      ResizeRegion(reinterpret_cast<const uint8_t*>(data.data()),
+          datum_channels, size, datum_width, 1, h_off, w_off, crop_height,
+          crop_width, do_mirror, crop_size, crop_size, transformed_data);
+    } else {
+      ResizeRegion(datum.float_data().data(), datum_channels, size,
+          datum_width, 1, h_off, w_off, crop_height, crop_width, do_mirror,
+          crop_size, crop_size, transformed_data);
+    }
+    return;
+  }
   CHECK_GE(datum_height, crop_size);
   CHECK_GE(datum_width, crop_size);
 
@@ -130,17 +254,28 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Blob<Dtype>* transformed_blob) {
+  // If datum is compressed, decompress it and transform the result.
+  if (datum.compression() != Datum::NONE) {
+    DecompressDatum(datum, &uncompressed_);
+    return Transform(uncompressed_, transformed_blob);
+  }
   // If datum is encoded, decode and transform the cv::image.
   if (datum.encoded()) {
 #ifdef USE_OPENCV
     CHECK(!(param_.force_color() && param_.force_gray()))
         << "cannot set both force_color and force_gray";
+    if (param_.crop_size() && param_.roi_decode() &&
+        TransformEncodedCrop(datum, transformed_blob)) {
+      return;
+    }
+    const int min_size = param_.decode_min_size();
     cv::Mat cv_img;
     if (param_.force_color() || param_.force_gray()) {
     // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
+      cv_img = DecodeDatumToCVMat(datum, param_.force_color(),
+          min_size, min_size);
     } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
+      cv_img = DecodeDatumToCVMatNative(datum, min_size, min_size);
     }
     // Transform the cv::image into blob.
     return Transform(cv_img, transformed_blob);
@@ -165,8 +300,10 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   const int num = transformed_blob->num();
 
   CHECK_EQ(channels, datum_channels);
-  CHECK_LE(height, datum_height);
-  CHECK_LE(width, datum_width);
+  if (!random_resized_crop_) {
+    CHECK_LE(height, datum_height);
+    CHECK_LE(width, datum_width);
+  }
   CHECK_GE(num, 1);
 
   if (crop_size) {
@@ -199,6 +336,11 @@ void DataTransformer<Dtype>::Transform(const vector<Datum> & datum_vector,
     uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
     Transform(datum_vector[item_id], &uni_blob);
   }
+  if (batch_transform_) {
+    Blob<Dtype> items(datum_num, channels, height, width);
+    items.set_cpu_data(transformed_blob->mutable_cpu_data());
+    TransformBatch(&items);
+  }
 }
 
 #ifdef USE_OPENCV
@@ -220,6 +362,7 @@ void DataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
     uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
     Transform(mat_vector[item_id], &uni_blob);
   }
+  TransformBatch(transformed_blob);
 }
 
 template<typename Dtype>
@@ -237,39 +380,30 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
   const int num = transformed_blob->num();
 
   CHECK_EQ(channels, img_channels);
-  CHECK_LE(height, img_height);
-  CHECK_LE(width, img_width);
   CHECK_GE(num, 1);
 
   CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
 
-  const Dtype scale = param_.scale();
   const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
-  const bool has_mean_values = mean_values_.size() > 0;
 
   CHECK_GT(img_channels, 0);
+  if (random_resized_crop_) {
+    CHECK_EQ(crop_size, height);
+    CHECK_EQ(crop_size, width);
+    int h_off, w_off, crop_height, crop_width;
+    RandomResizedCrop(img_height, img_width, &h_off, &w_off, &crop_height,
+        &crop_width);
+    ResizeRegion(cv_img.ptr<uchar>(0), img_channels, 1,
+        static_cast<int>(cv_img.step), img_channels, h_off, w_off,
+        crop_height, crop_width, do_mirror, crop_size, crop_size,
+        transformed_blob->mutable_cpu_data());
+    return;
+  }
+  CHECK_LE(height, img_height);
+  CHECK_LE(width, img_width);
   CHECK_GE(img_height, crop_size);
   CHECK_GE(img_width, crop_size);
 
-  Dtype* mean = NULL;
-  if (has_mean_file) {
-    CHECK_EQ(img_channels, data_mean_.channels());
-    CHECK_EQ(img_height, data_mean_.height());
-    CHECK_EQ(img_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
-  }
-  if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
-     "Specify either 1 mean_value or as many as channels: " << img_channels;
-    if (img_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < img_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
-  }
-
   int h_off = 0;
   int w_off = 0;
   cv::Mat cv_cropped_img = cv_img;
@@ -290,6 +424,93 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
     CHECK_EQ(img_height, height);
     CHECK_EQ(img_width, width);
   }
+  TransformCrop(cv_cropped_img, img_height, img_width, h_off, w_off,
+      do_mirror, transformed_blob);
+}
+
+template<typename Dtype>
+bool DataTransformer<Dtype>::TransformEncodedCrop(const Datum& datum,
+    Blob<Dtype>* transformed_blob) {
+  const string& data = datum.data();
+  const int decode_channels = param_.force_color() ? 3 :
+      param_.force_gray() ? 1 : 0;
+  const int min_size = param_.decode_min_size();
+  int img_height, img_width, img_channels;
+  if (!DecodedImageShape(data.data(), data.size(), decode_channels, min_size,
+      min_size, &img_height, &img_width, &img_channels)) {
+    return false;
+  }
+  const int crop_size = param_.crop_size();
+  CHECK_EQ(transformed_blob->channels(), img_channels);
+  CHECK_GE(transformed_blob->num(), 1);
+  CHECK_EQ(crop_size, transformed_blob->height());
+  CHECK_EQ(crop_size, transformed_blob->width());
+
+  // Draw the crop as Transform(cv_img) does.
+  const bool do_mirror = param_.mirror() && Rand(2);
+  int h_off, w_off;
+  int crop_height = crop_size;
+  int crop_width = crop_size;
+  if (random_resized_crop_) {
+    RandomResizedCrop(img_height, img_width, &h_off, &w_off, &crop_height,
+        &crop_width);
+  } else {
+    CHECK_GE(img_height, crop_size);
+    CHECK_GE(img_width, crop_size);
+    if (phase_ == TRAIN) {
+      h_off = Rand(img_height - crop_size + 1);
+      w_off = Rand(img_width - crop_size + 1);
+    } else {
+      h_off = (img_height - crop_size) / 2;
+      w_off = (img_width - crop_size) / 2;
+    }
+  }
+  cv::Mat cv_cropped_img(crop_height, crop_width, CV_8UC(img_channels));
+  CHECK(DecodeImageRegion(data.data(), data.size(), decode_channels,
+      min_size, min_size, h_off, w_off, crop_height, crop_width,
+      cv_cropped_img.data)) << "Could not decode datum";
+  if (random_resized_crop_) {
+    ResizeRegion(cv_cropped_img.ptr<uchar>(0), img_channels, 1,
+        static_cast<int>(cv_cropped_img.step), img_channels, 0, 0,
+        crop_height, crop_width, do_mirror, crop_size, crop_size,
+        transformed_blob->mutable_cpu_data());
+  } else {
+    TransformCrop(cv_cropped_img, img_height, img_width, h_off, w_off,
+        do_mirror, transformed_blob);
+  }
+  return true;
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformCrop(const cv::Mat& cv_cropped_img,
+    const int img_height, const int img_width, const int h_off,
+    const int w_off, const bool do_mirror, Blob<Dtype>* transformed_blob) {
+  const int img_channels = cv_cropped_img.channels();
+  const int height = transformed_blob->height();
+  const int width = transformed_blob->width();
+
+  // TransformBatch applies the mean and the scale after the augmentations.
+  const Dtype scale = batch_transform_ ? 1 : param_.scale();
+  const bool has_mean_file = !batch_transform_ && param_.has_mean_file();
+  const bool has_mean_values = !batch_transform_ && mean_values_.size() > 0;
+
+  Dtype* mean = NULL;
+  if (has_mean_file) {
+    CHECK_EQ(img_channels, data_mean_.channels());
+    CHECK_EQ(img_height, data_mean_.height());
+    CHECK_EQ(img_width, data_mean_.width());
+    mean = data_mean_.mutable_cpu_data();
+  }
+  if (has_mean_values) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
+     "Specify either 1 mean_value or as many as channels: " << img_channels;
+    if (img_channels > 1 && mean_values_.size() == 1) {
+      // Replicate the mean_value for simplicity
+      for (int c = 1; c < img_channels; ++c) {
+        mean_values_.push_back(mean_values_[0]);
+      }
+    }
+  }
 
   CHECK(cv_cropped_img.data);
 
@@ -357,10 +578,13 @@ void DataTransformer<Dtype>::Transform(Blob<Dtype>* input_blob,
   CHECK_GE(input_width, width);
 
 
-  const Dtype scale = param_.scale();
+  CHECK(!random_resized_crop_)
+      << "Random-resized crops of blobs are not supported";
+  // TransformBatch applies the mean and the scale after the augmentations.
+  const Dtype scale = batch_transform_ ? 1 : param_.scale();
   const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
-  const bool has_mean_values = mean_values_.size() > 0;
+  const bool has_mean_file = !batch_transform_ && param_.has_mean_file();
+  const bool has_mean_values = !batch_transform_ && mean_values_.size() > 0;
 
   int h_off = 0;
   int w_off = 0;
@@ -436,6 +660,87 @@ void DataTransformer<Dtype>::Transform(Blob<Dtype>* input_blob,
     DLOG(INFO) << "Scale: " << scale;
     caffe_scal(size, scale, transformed_data);
   }
+  if (batch_transform_) {
+    Blob<Dtype> items(input_num, channels, height, width);
+    items.set_cpu_data(transformed_data);
+    TransformBatch(&items);
+  }
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformBatch(Blob<Dtype>* batch) {
+  if (!batch_transform_) {
+    return;
+  }
+  const int num = batch->num();
+  const int channels = batch->channels();
+  const int size = batch->count(2);
+  const Dtype scale = param_.scale();
+  const int num_mean_values = mean_values_.size();
+  CHECK(num_mean_values <= 1 || num_mean_values == channels) <<
+     "Specify either 1 mean_value or as many as channels: " << channels;
+  const float brightness = param_.brightness();
+  const float contrast = param_.contrast();
+  const float saturation = param_.saturation();
+  const float lighting_std = param_.lighting_std();
+  if (saturation > 0) {
+    CHECK_EQ(channels, 3) << "saturation requires color images";
+  }
+  if (lighting_std > 0) {
+    CHECK_EQ(lighting_eigvec_.size(), lighting_eigval_.size() * channels)
+        << "lighting_eigvec must have a column per channel";
+  }
+  if (contrast > 0 || saturation > 0) {
+    gray_.Reshape(vector<int>(1, size));
+  }
+  vector<Dtype> ones(contrast > 0 ? size : 0, Dtype(1));
+  vector<Dtype> offsets(channels);
+  for (int n = 0; n < num; ++n) {
+    Dtype* data = batch->mutable_cpu_data() + batch->offset(n);
+    if (brightness > 0) {
+      const Dtype alpha = RandUniform(1 - brightness, 1 + brightness);
+      caffe_scal(channels * size, alpha, data);
+    }
+    if (contrast > 0) {
+      // Blend with the mean gray level of the image.
+      const Dtype alpha = RandUniform(1 - contrast, 1 + contrast);
+      GrayLevel(data, channels, size, gray_.mutable_cpu_data());
+      const Dtype mean = caffe_cpu_dot(size, gray_.cpu_data(), &ones[0]) /
+          size;
+      caffe_scal(channels * size, alpha, data);
+      caffe_add_scalar(channels * size, (1 - alpha) * mean, data);
+    }
+    if (saturation > 0) {
+      // Blend each pixel with its gray level.
+      const Dtype alpha = RandUniform(1 - saturation, 1 + saturation);
+      GrayLevel(data, channels, size, gray_.mutable_cpu_data());
+      for (int c = 0; c < channels; ++c) {
+        caffe_cpu_axpby(size, 1 - alpha, gray_.cpu_data(), alpha,
+            data + c * size);
+      }
+    }
+    // Add the lighting noise and subtract the mean along with the scale.
+    for (int c = 0; c < channels; ++c) {
+      offsets[c] = num_mean_values == 0 ? Dtype(0) :
+          -mean_values_[num_mean_values == 1 ? 0 : c];
+    }
+    if (lighting_std > 0) {
+      for (int i = 0; i < lighting_eigval_.size(); ++i) {
+        const Dtype alpha = RandGaussian(lighting_std) * lighting_eigval_[i];
+        for (int c = 0; c < channels; ++c) {
+          offsets[c] += alpha * lighting_eigvec_[i * channels + c];
+        }
+      }
+    }
+    for (int c = 0; c < channels; ++c) {
+      if (scale != Dtype(1)) {
+        caffe_scal(size, scale, data + c * size);
+      }
+      if (offsets[c] != Dtype(0)) {
+        caffe_add_scalar(size, offsets[c] * scale, data + c * size);
+      }
+    }
+  }
 }
 
 template<typename Dtype>
@@ -444,12 +749,32 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
 #ifdef USE_OPENCV
     CHECK(!(param_.force_color() && param_.force_gray()))
         << "cannot set both force_color and force_gray";
+    const int min_size = param_.decode_min_size();
+    if (param_.crop_size() && param_.roi_decode()) {
+      // The crops are decoded alone: the header gives the shape.
+      int height, width, channels;
+      if (DecodedImageShape(datum.data().data(), datum.data().size(),
+          param_.force_color() ? 3 : param_.force_gray() ? 1 : 0, min_size,
+          min_size, &height, &width, &channels)) {
+        if (!random_resized_crop_) {
+          CHECK_GE(height, param_.crop_size());
+          CHECK_GE(width, param_.crop_size());
+        }
+        vector<int> shape(4);
+        shape[0] = 1;
+        shape[1] = channels;
+        shape[2] = param_.crop_size();
+        shape[3] = param_.crop_size();
+        return shape;
+      }
+    }
     cv::Mat cv_img;
     if (param_.force_color() || param_.force_gray()) {
     // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
+      cv_img = DecodeDatumToCVMat(datum, param_.force_color(),
+          min_size, min_size);
     } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
+      cv_img = DecodeDatumToCVMatNative(datum, min_size, min_size);
     }
     // InferBlobShape using the cv::image.
     return InferBlobShape(cv_img);
@@ -463,8 +788,10 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
   const int datum_width = datum.width();
   // Check dimensions.
   CHECK_GT(datum_channels, 0);
-  CHECK_GE(datum_height, crop_size);
-  CHECK_GE(datum_width, crop_size);
+  if (!random_resized_crop_) {
+    CHECK_GE(datum_height, crop_size);
+    CHECK_GE(datum_width, crop_size);
+  }
   // Build BlobShape.
   vector<int> shape(4);
   shape[0] = 1;
@@ -495,8 +822,10 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(const cv::Mat& cv_img) {
   const int img_width = cv_img.cols;
   // Check dimensions.
   CHECK_GT(img_channels, 0);
-  CHECK_GE(img_height, crop_size);
-  CHECK_GE(img_width, crop_size);
+  if (!random_resized_crop_) {
+    CHECK_GE(img_height, crop_size);
+    CHECK_GE(img_width, crop_size);
+  }
   // Build BlobShape.
   vector<int> shape(4);
   shape[0] = 1;
@@ -522,7 +851,7 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(
 template <typename Dtype>
 void DataTransformer<Dtype>::InitRand() {
   const bool needs_rand = param_.mirror() ||
-      (phase_ == TRAIN && param_.crop_size());
+      (phase_ == TRAIN && param_.crop_size()) || batch_transform_;
   if (needs_rand) {
     const unsigned int rng_seed = caffe_rng_rand();
     rng_.reset(new Caffe::RNG(rng_seed));
@@ -540,6 +869,56 @@ int DataTransformer<Dtype>::Rand(int n) {
   return ((*rng)() % n);
 }
 
+template <typename Dtype>
+float DataTransformer<Dtype>::RandUniform(float a, float b) {
+  CHECK(rng_);
+  if (a >= b) {
+    return a;
+  }
+  caffe::rng_t* rng =
+      static_cast<caffe::rng_t*>(rng_->generator());
+  boost::uniform_real<float> distribution(a, b);
+  boost::variate_generator<caffe::rng_t*, boost::uniform_real<float> >
+      generator(rng, distribution);
+  return generator();
+}
+
+template <typename Dtype>
+float DataTransformer<Dtype>::RandGaussian(float sigma) {
+  CHECK(rng_);
+  caffe::rng_t* rng =
+      static_cast<caffe::rng_t*>(rng_->generator());
+  boost::normal_distribution<float> distribution(0, sigma);
+  boost::variate_generator<caffe::rng_t*, boost::normal_distribution<float> >
+      generator(rng, distribution);
+  return generator();
+}
+
+template <typename Dtype>
+void DataTransformer<Dtype>::RandomResizedCrop(int height, int width,
+    int* h_off, int* w_off, int* crop_height, int* crop_width) {
+  const float area = static_cast<float>(height) * width;
+  const float log_aspect = std::log(param_.crop_max_aspect());
+  for (int attempt = 0; attempt < 10; ++attempt) {
+    const float crop_area = area * RandUniform(param_.crop_min_area(), 1);
+    const float aspect = std::exp(RandUniform(-log_aspect, log_aspect));
+    const int w = static_cast<int>(std::sqrt(crop_area * aspect) + 0.5f);
+    const int h = static_cast<int>(std::sqrt(crop_area / aspect) + 0.5f);
+    if (w > 0 && w <= width && h > 0 && h <= height) {
+      *h_off = Rand(height - h + 1);
+      *w_off = Rand(width - w + 1);
+      *crop_height = h;
+      *crop_width = w;
+      return;
+    }
+  }
+  // Fall back to the whole image.
+  *h_off = 0;
+  *w_off = 0;
+  *crop_height = height;
+  *crop_width = width;
+}
+
 INSTANTIATE_CLASS(DataTransformer);
 
 }  // namespace caffe
@@ -1,4 +1,5 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -7,6 +8,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
@@ -37,7 +39,11 @@ BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
       prefetch_(param.data_param().prefetch()),
-      prefetch_free_(), prefetch_full_(), prefetch_current_() {
+      prefetch_free_(), prefetch_full_(), prefetch_current_(),
+      echo_factor_(std::max<int>(1, param.data_param().echo())),
+      echo_min_(echo_factor_),
+      echo_max_(std::max<int>(echo_min_, param.data_param().echo_max())),
+      echo_forwards_(0), echo_starved_(0), echo_queued_(0) {
   for (int i = 0; i < prefetch_.size(); ++i) {
     prefetch_[i].reset(new Batch<Dtype>());
     prefetch_free_.push(prefetch_[i].get());
@@ -58,6 +64,9 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     if (this->output_labels_) {
       prefetch_[i]->label_.mutable_cpu_data();
     }
+    for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+      prefetch_[i]->extra_[j]->mutable_cpu_data();
+    }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
@@ -66,6 +75,9 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
       if (this->output_labels_) {
         prefetch_[i]->label_.mutable_gpu_data();
       }
+      for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+        prefetch_[i]->extra_[j]->mutable_gpu_data();
+      }
     }
   }
 #endif
@@ -85,18 +97,27 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 
   try {
+    CPUTimer timer;
     while (!must_stop()) {
+      timer.Start();
       Batch<Dtype>* batch = prefetch_free_.pop();
+      const double wait_time = timer.MicroSeconds();
       load_batch(batch);
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
+        timer.Start();
         batch->data_.data().get()->async_gpu_push(stream);
         if (this->output_labels_) {
           batch->label_.data().get()->async_gpu_push(stream);
         }
+        for (int j = 0; j < batch->extra_.size(); ++j) {
+          batch->extra_[j]->data().get()->async_gpu_push(stream);
+        }
         CUDA_CHECK(cudaStreamSynchronize(stream));
+        metrics_.AddStageTime(DataMetrics::COPY, timer.MicroSeconds());
       }
 #endif
+      metrics_.AddBatch(batch->data_.shape(0), wait_time);
       prefetch_full_.push(batch);
     }
   } catch (boost::thread_interrupted&) {
@@ -110,12 +131,63 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 }
 
 template <typename Dtype>
-void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
-    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+void BasePrefetchingDataLayer<Dtype>::NextBatch() {
   if (prefetch_current_) {
     prefetch_free_.push(prefetch_current_);
   }
+  CPUTimer timer;
+  timer.Start();
+  const int queued = prefetch_full_.size();
   prefetch_current_ = prefetch_full_.pop("Waiting for data");
+  metrics_.AddForward(queued, timer.MicroSeconds());
+  if (echo_max_ > echo_min_) {
+    AdjustEchoFactor(queued);
+  }
+}
+
+template <typename Dtype>
+int BasePrefetchingDataLayer<Dtype>::echo_factor() const {
+  return __atomic_load_n(&echo_factor_, __ATOMIC_RELAXED);
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::set_echo_factor(int echo_factor) {
+  CHECK_GE(echo_factor, 1);
+  __atomic_store_n(&echo_factor_, echo_factor, __ATOMIC_RELAXED);
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::AdjustEchoFactor(int queued) {
+  // Forward calls between adjustments.
+  const int kInterval = 20;
+  ++echo_forwards_;
+  echo_starved_ += (queued == 0);
+  echo_queued_ += queued;
+  if (echo_forwards_ < kInterval) {
+    return;
+  }
+  const int echo = echo_factor();
+  if (echo_starved_ * 2 > echo_forwards_ && echo < echo_max_) {
+    set_echo_factor(echo + 1);
+    LOG_IF(INFO, Caffe::root_solver()) << "Waiting for data, raising the "
+        << "echo factor of " << this->layer_param_.name() << " to "
+        << echo + 1;
+  } else if (echo_starved_ == 0 && echo > echo_min_ &&
+      echo_queued_ * 2 >= echo_forwards_ * prefetch_.size()) {
+    set_echo_factor(echo - 1);
+    LOG_IF(INFO, Caffe::root_solver()) << "Data is queued, lowering the "
+        << "echo factor of " << this->layer_param_.name() << " to "
+        << echo - 1;
+  }
+  echo_forwards_ = 0;
+  echo_starved_ = 0;
+  echo_queued_ = 0;
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  NextBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(prefetch_current_->data_);
   top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
@@ -124,6 +196,10 @@ void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     top[1]->ReshapeLike(prefetch_current_->label_);
     top[1]->set_cpu_data(prefetch_current_->label_.mutable_cpu_data());
   }
+  for (int j = 0; j < prefetch_current_->extra_.size(); ++j) {
+    top[j + 2]->ReshapeLike(*prefetch_current_->extra_[j]);
+    top[j + 2]->set_cpu_data(prefetch_current_->extra_[j]->mutable_cpu_data());
+  }
 }
 
 #ifdef CPU_ONLY
@@ -3,26 +3,73 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <algorithm>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+// Records kept for data echoing.
+static int EchoBufferSize(const DataParameter& data_param) {
+  if (std::max(data_param.echo(), data_param.echo_max()) <= 1) {
+    return 0;
+  }
+  return data_param.echo_buffer() ? data_param.echo_buffer() :
+      data_param.batch_size();
+}
+
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    offset_() {
-  db_.reset(db::GetDB(param.data_param().backend()));
-  db_->Open(param.data_param().source(), db::READ);
-  cursor_.reset(db_->NewCursor());
+    datums_(param.data_param().prefetch() * param.data_param().batch_size() +
+        EchoBufferSize(param.data_param())),
+    datum_free_(), datum_full_(),
+    echo_buffer_size_(EchoBufferSize(param.data_param())) {
+  for (int i = 0; i < datums_.size(); ++i) {
+    datums_[i].reset(new Datum());
+    datum_free_.push(datums_[i].get());
+  }
+  const DataParameter& data_param = param.data_param();
+  const vector<string> sources = DataReader::ExpandSources(data_param.source());
+  const int num_shards = sources.size();
+  // In test mode, only rank 0 runs, so it reads every shard
+  const bool test = param.phase() == TEST;
+  const int size = test ? 1 : Caffe::solver_count();
+  const int rank = test ? 0 : Caffe::solver_rank();
+  const size_t cache_bytes = static_cast<size_t>(data_param.cache_mb()) << 20;
+  if (num_shards >= size) {
+    LOG_IF(WARNING, num_shards % size != 0)
+        << num_shards << " shards are not evenly divisible among "
+        << size << " solvers";
+    const int num_readers = (num_shards - rank + size - 1) / size;
+    for (int i = rank; i < num_shards; i += size) {
+      readers_.push_back(shared_ptr<DataReader>(new DataReader(
+          param, sources[i], &datum_free_, &datum_full_, 1, 0,
+          cache_bytes / num_readers)));
+    }
+  } else {
+    // Fewer shards than solvers: the solvers sharing a shard take turns
+    // on its records.
+    const int shard = rank % num_shards;
+    const int stride = (size - shard + num_shards - 1) / num_shards;
+    readers_.push_back(shared_ptr<DataReader>(new DataReader(
+        param, sources[shard], &datum_free_, &datum_full_,
+        stride, rank / num_shards, cache_bytes)));
+  }
+  LOG_IF(INFO, Caffe::root_solver() && num_shards > 1)
+      << "Reading " << readers_.size() << " of " << num_shards << " shards";
 }
 
 template <typename Dtype>
 DataLayer<Dtype>::~DataLayer() {
   this->StopInternalThread();
+  readers_.clear();
 }
 
 template <typename Dtype>
@@ -30,8 +77,7 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const int batch_size = this->layer_param_.data_param().batch_size();
   // Read a data point, and use it to initialize the top blob.
-  Datum datum;
-  datum.ParseFromString(cursor_->value());
+  const Datum& datum = *datum_full_.peek();
 
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
@@ -56,27 +102,6 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
-template <typename Dtype>
-bool DataLayer<Dtype>::Skip() {
-  int size = Caffe::solver_count();
-  int rank = Caffe::solver_rank();
-  bool keep = (offset_ % size) == rank ||
-              // In test mode, only rank 0 runs, so avoid skipping
-              this->layer_param_.phase() == TEST;
-  return !keep;
-}
-
-template<typename Dtype>
-void DataLayer<Dtype>::Next() {
-  cursor_->Next();
-  if (!cursor_->valid()) {
-    LOG_IF(INFO, Caffe::root_solver())
-        << "Restarting data prefetching from start.";
-    cursor_->SeekToFirst();
-  }
-  offset_++;
-}
-
 // This function is called on prefetch thread
 template<typename Dtype>
 void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
@@ -89,20 +114,17 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CHECK(this->transformed_data_.count());
   const int batch_size = this->layer_param_.data_param().batch_size();
 
-  Datum datum;
   for (int item_id = 0; item_id < batch_size; ++item_id) {
     timer.Start();
-    while (Skip()) {
-      Next();
-    }
-    datum.ParseFromString(cursor_->value());
+    bool last_use;
+    Datum* datum = NextDatum(&last_use);
     read_time += timer.MicroSeconds();
 
     if (item_id == 0) {
       // Reshape according to the first datum of each batch
       // on single input batches allows for inputs of varying dimension.
       // Use data_transformer to infer the expected blob shape from datum.
-      vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
+      vector<int> top_shape = this->data_transformer_->InferBlobShape(*datum);
       this->transformed_data_.Reshape(top_shape);
       // Reshape batch according to the batch_size.
       top_shape[0] = batch_size;
@@ -114,20 +136,53 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     int offset = batch->data_.offset(item_id);
     Dtype* top_data = batch->data_.mutable_cpu_data();
     this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
+    this->data_transformer_->Transform(*datum, &(this->transformed_data_));
     // Copy label.
     if (this->output_labels_) {
       Dtype* top_label = batch->label_.mutable_cpu_data();
-      top_label[item_id] = datum.label();
+      top_label[item_id] = datum->label();
     }
     trans_time += timer.MicroSeconds();
-    Next();
+    if (last_use) {
+      datum_free_.push(datum);
+    }
   }
+  // Augmentations of the whole batch, if any.
+  timer.Start();
+  this->data_transformer_->TransformBatch(&batch->data_);
+  trans_time += timer.MicroSeconds();
   timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  this->metrics_.AddStageTime(DataMetrics::READ, read_time);
+  this->metrics_.AddStageTime(DataMetrics::TRANSFORM, trans_time);
+}
+
+// This function is called on prefetch thread
+template<typename Dtype>
+Datum* DataLayer<Dtype>::NextDatum(bool* last_use) {
+  const int echo = this->echo_factor();
+  if (echo_buffer_size_ == 0 || (echo <= 1 && echo_buffer_.empty())) {
+    *last_use = true;
+    return datum_full_.pop();
+  }
+  // Keep the buffer full of fresh records while echoing; otherwise only
+  // drain it.
+  if (echo > 1) {
+    while (echo_buffer_.size() < echo_buffer_size_) {
+      echo_buffer_.push_back(std::make_pair(datum_full_.pop(), echo));
+    }
+  }
+  const int i = caffe_rng_rand() % echo_buffer_.size();
+  Datum* datum = echo_buffer_[i].first;
+  *last_use = --echo_buffer_[i].second == 0;
+  if (*last_use) {
+    echo_buffer_[i] = echo_buffer_.back();
+    echo_buffer_.pop_back();
+  }
+  return datum;
 }
 
 INSTANTIATE_CLASS(DataLayer);
@@ -1,11 +1,5 @@
-/*
-TODO:
-- load file in a separate thread ("prefetch")
-- can be smarter about the memcpy call instead of doing it row-by-row
-  :: use util functions caffe_copy, and Blob->offset()
-  :: don't forget to update hdf5_daa_layer.cu accordingly
-- add ability to shuffle filenames if flag is set
-*/
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -15,68 +9,118 @@ TODO:
 #include "stdint.h"
 
 #include "caffe/layers/hdf5_data_layer.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
+// Copies row src_row of each of the src blobs to row dst_row of dst.
 template <typename Dtype>
-HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
+static void CopyRow(const vector<Blob<Dtype>*>& src, int src_row,
+    const vector<Blob<Dtype>*>& dst, int dst_row) {
+  for (int j = 0; j < src.size(); ++j) {
+    const int row_dim = src[j]->count(1);
+    CHECK_EQ(row_dim, dst[j]->count(1))
+        << "All HDF5 files must have rows of the same shape.";
+    caffe_copy(row_dim, src[j]->cpu_data() + src_row * row_dim,
+        dst[j]->mutable_cpu_data() + dst_row * row_dim);
+  }
+}
 
-// Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
-  DLOG(INFO) << "Loading HDF5 file: " << filename;
-  hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
-  if (file_id < 0) {
-    LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+static vector<Blob<Dtype>*> RawBlobs(
+    const vector<shared_ptr<Blob<Dtype> > >& blobs) {
+  vector<Blob<Dtype>*> raw(blobs.size());
+  for (int j = 0; j < blobs.size(); ++j) {
+    raw[j] = blobs[j].get();
   }
+  return raw;
+}
 
-  int top_size = this->layer_param_.top_size();
-  hdf_blobs_.resize(top_size);
-
-  const int MIN_DATA_DIM = 1;
-  const int MAX_DATA_DIM = INT_MAX;
-
-  for (int i = 0; i < top_size; ++i) {
-    hdf_blobs_[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-    // Allow reshape here, as we are loading data not params
-    hdf5_load_nd_dataset(file_id, this->layer_param_.top(i).c_str(),
-        MIN_DATA_DIM, MAX_DATA_DIM, hdf_blobs_[i].get(), true);
+template <typename Dtype>
+HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() {
+  this->StopInternalThread();
+  if (file_id_ >= 0) {
+    boost::mutex::scoped_lock lock(hdf5_mutex());
+    H5Fclose(file_id_);
   }
+}
 
-  herr_t status = H5Fclose(file_id);
-  CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
-
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::OpenFile() {
+  const char* filename =
+      hdf_filenames_[file_permutation_[current_file_]].c_str();
+  DLOG(INFO) << "Loading HDF5 file: " << filename;
+  boost::mutex::scoped_lock lock(hdf5_mutex());
+  if (file_id_ >= 0) {
+    herr_t status = H5Fclose(file_id_);
+    CHECK_GE(status, 0) << "Failed to close HDF5 file";
+  }
+  file_id_ = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file_id_ < 0) {
+    LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+  }
   // MinTopBlobs==1 guarantees at least one top blob
-  CHECK_GE(hdf_blobs_[0]->num_axes(), 1) << "Input must have at least 1 axis.";
-  const int num = hdf_blobs_[0]->shape(0);
-  for (int i = 1; i < top_size; ++i) {
-    CHECK_EQ(hdf_blobs_[i]->shape(0), num);
+  const int top_size = this->layer_param_.top_size();
+  for (int i = 0; i < top_size; ++i) {
+    vector<hsize_t> dims = hdf5_get_dataset_dims(file_id_,
+        this->layer_param_.top(i).c_str());
+    if (i == 0) {
+      file_rows_ = dims[0];
+      CHECK_GT(file_rows_, 0) << "No rows in HDF5 file: " << filename;
+    }
+    CHECK_EQ(dims[0], file_rows_);
   }
-  // Default to identity permutation.
-  data_permutation_.clear();
-  data_permutation_.resize(hdf_blobs_[0]->shape(0));
-  for (int i = 0; i < hdf_blobs_[0]->shape(0); i++)
-    data_permutation_[i] = i;
+  current_row_ = 0;
+}
 
-  // Shuffle if needed.
-  if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
-    DLOG(INFO) << "Successfully loaded " << hdf_blobs_[0]->shape(0)
-               << " rows (shuffled)";
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::NextFile() {
+  if (++current_file_ == num_files_) {
+    current_file_ = 0;
+    if (this->layer_param_.hdf5_data_param().shuffle()) {
+      caffe::rng_t* prefetch_rng =
+          static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+      shuffle(file_permutation_.begin(), file_permutation_.end(),
+          prefetch_rng);
+    }
+    DLOG(INFO) << "Looping around to first file.";
+  }
+  if (num_files_ > 1) {
+    OpenFile();
   } else {
-    DLOG(INFO) << "Successfully loaded " << hdf_blobs_[0]->shape(0) << " rows";
+    current_row_ = 0;
   }
 }
 
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+void HDF5DataLayer<Dtype>::LoadChunk() {
+  if (current_row_ == file_rows_) {
+    NextFile();
+  }
+  const hsize_t chunk_size = this->layer_param_.hdf5_data_param().chunk_size();
+  const hsize_t num_rows = std::min(chunk_size, file_rows_ - current_row_);
+  boost::mutex::scoped_lock lock(hdf5_mutex());
+  for (int j = 0; j < chunk_blobs_.size(); ++j) {
+    hdf5_load_nd_dataset_rows(file_id_, this->layer_param_.top(j).c_str(),
+        current_row_, num_rows, chunk_blobs_[j].get());
+  }
+  current_row_ += num_rows;
+  chunk_row_ = 0;
+}
+
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   // Refuse transformation parameters since HDF5 is totally generic.
   CHECK(!this->layer_param_.has_transform_param()) <<
       this->type() << " does not transform data.";
+  const HDF5DataParameter& param = this->layer_param_.hdf5_data_param();
+  CHECK_GT(param.chunk_size(), 0) << "chunk_size must be positive";
   // Read the source to parse the filenames.
-  const string& source = this->layer_param_.hdf5_data_param().source();
+  const string& source = param.source();
   LOG(INFO) << "Loading list of HDF5 filenames from: " << source;
   hdf_filenames_.clear();
   std::ifstream source_file(source.c_str());
@@ -103,25 +147,67 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
   // Shuffle if needed.
-  if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
+  const unsigned int prefetch_rng_seed = caffe_rng_rand();
+  prefetch_rng_.reset(new Caffe::RNG(prefetch_rng_seed));
+  if (param.shuffle()) {
+    caffe::rng_t* prefetch_rng =
+        static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+    shuffle(file_permutation_.begin(), file_permutation_.end(), prefetch_rng);
   }
 
-  // Load the first HDF5 file and initialize the line counter.
-  LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
-  current_row_ = 0;
+  // Open the first HDF5 file and read the shape of its rows.
+  OpenFile();
+  const int batch_size = param.batch_size();
+  const int top_size = this->layer_param_.top_size();
+  vector<vector<int> > top_shapes(top_size);
+  {
+    boost::mutex::scoped_lock lock(hdf5_mutex());
+    for (int i = 0; i < top_size; ++i) {
+      vector<hsize_t> dims = hdf5_get_dataset_dims(file_id_,
+          this->layer_param_.top(i).c_str());
+      top_shapes[i].assign(dims.begin(), dims.end());
+      top_shapes[i][0] = batch_size;
+    }
+  }
 
   // Reshape blobs.
-  const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
-  const int top_size = this->layer_param_.top_size();
-  vector<int> top_shape;
   for (int i = 0; i < top_size; ++i) {
-    top_shape.resize(hdf_blobs_[i]->num_axes());
-    top_shape[0] = batch_size;
-    for (int j = 1; j < top_shape.size(); ++j) {
-      top_shape[j] = hdf_blobs_[i]->shape(j);
+    top[i]->Reshape(top_shapes[i]);
+  }
+  for (int j = 0; j < this->prefetch_.size(); ++j) {
+    Batch<Dtype>* batch = this->prefetch_[j].get();
+    batch->data_.Reshape(top_shapes[0]);
+    if (this->output_labels_) {
+      batch->label_.Reshape(top_shapes[1]);
+    }
+    batch->extra_.clear();
+    for (int i = 2; i < top_size; ++i) {
+      batch->extra_.push_back(
+          shared_ptr<Blob<Dtype> >(new Blob<Dtype>(top_shapes[i])));
     }
-    top[i]->Reshape(top_shape);
+  }
+
+  chunk_blobs_.clear();
+  for (int i = 0; i < top_size; ++i) {
+    chunk_blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  chunk_row_ = 0;
+  LoadChunk();
+
+  // The shuffle buffer holds one file's worth of rows unless bounded.
+  shuffle_blobs_.clear();
+  shuffle_capacity_ = 0;
+  shuffle_rows_ = 0;
+  if (param.shuffle()) {
+    shuffle_capacity_ = param.shuffle_buffer_size() > 0 ?
+        param.shuffle_buffer_size() : file_rows_;
+    for (int i = 0; i < top_size; ++i) {
+      vector<int> shape = top_shapes[i];
+      shape[0] = shuffle_capacity_;
+      shuffle_blobs_.push_back(
+          shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
+    }
+    LOG(INFO) << "Shuffling rows in a buffer of " << shuffle_capacity_;
   }
 }
 
@@ -136,50 +222,59 @@ bool HDF5DataLayer<Dtype>::Skip() {
 }
 
 template<typename Dtype>
-void HDF5DataLayer<Dtype>::Next() {
-  if (++current_row_ == hdf_blobs_[0]->shape(0)) {
-    if (num_files_ > 1) {
-      ++current_file_;
-      if (current_file_ == num_files_) {
-        current_file_ = 0;
-        if (this->layer_param_.hdf5_data_param().shuffle()) {
-          std::random_shuffle(file_permutation_.begin(),
-                              file_permutation_.end());
-        }
-        DLOG(INFO) << "Looping around to first file.";
-      }
-      LoadHDF5FileData(
-        hdf_filenames_[file_permutation_[current_file_]].c_str());
+void HDF5DataLayer<Dtype>::NextRow(const vector<Blob<Dtype>*>& blobs,
+    int row) {
+  while (true) {
+    if (chunk_row_ == chunk_blobs_[0]->shape(0)) {
+      LoadChunk();
     }
-    current_row_ = 0;
-    if (this->layer_param_.hdf5_data_param().shuffle())
-      std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
+    if (!Skip()) {
+      break;
+    }
+    ++chunk_row_;
+    ++offset_;
   }
-  offset_++;
+  CopyRow(RawBlobs(chunk_blobs_), chunk_row_, blobs, row);
+  ++chunk_row_;
+  ++offset_;
 }
 
+// This function is called on prefetch thread
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
+void HDF5DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  CPUTimer batch_timer;
+  batch_timer.Start();
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
-  for (int i = 0; i < batch_size; ++i) {
-    while (Skip()) {
-      Next();
+  vector<Blob<Dtype>*> batch_blobs(1, &batch->data_);
+  if (this->output_labels_) {
+    batch_blobs.push_back(&batch->label_);
+  }
+  for (int j = 0; j < batch->extra_.size(); ++j) {
+    batch_blobs.push_back(batch->extra_[j].get());
+  }
+  if (shuffle_capacity_ == 0) {
+    for (int i = 0; i < batch_size; ++i) {
+      NextRow(batch_blobs, i);
     }
-    for (int j = 0; j < this->layer_param_.top_size(); ++j) {
-      int data_dim = top[j]->count() / top[j]->shape(0);
-      caffe_copy(data_dim,
-          &hdf_blobs_[j]->cpu_data()[data_permutation_[current_row_]
-            * data_dim], &top[j]->mutable_cpu_data()[i * data_dim]);
+  } else {
+    const vector<Blob<Dtype>*> shuffle_blobs = RawBlobs(shuffle_blobs_);
+    caffe::rng_t* prefetch_rng =
+        static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+    for (int i = 0; i < batch_size; ++i) {
+      while (shuffle_rows_ < shuffle_capacity_) {
+        NextRow(shuffle_blobs, shuffle_rows_++);
+      }
+      // Draw a random row and replace it with the next one in file order.
+      const int row = (*prefetch_rng)() % shuffle_rows_;
+      CopyRow(shuffle_blobs, row, batch_blobs, i);
+      NextRow(shuffle_blobs, row);
     }
-    Next();
   }
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
+  this->metrics_.AddStageTime(DataMetrics::READ, batch_timer.MicroSeconds());
 }
 
-#ifdef CPU_ONLY
-STUB_GPU_FORWARD(HDF5DataLayer, Forward);
-#endif
-
 INSTANTIATE_CLASS(HDF5DataLayer);
 REGISTER_LAYER_CLASS(HDF5Data);
 
@@ -1,8 +1,11 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui_c.h>
+#include <opencv2/imgproc/imgproc.hpp>
 
 #include <fstream>  // NOLINT(readability/streams)
 #include <iostream>  // NOLINT(readability/streams)
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -71,6 +74,23 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_GT(lines_.size(), skip) << "Not enough points to skip";
     lines_id_ = skip;
   }
+  if (this->layer_param_.image_data_param().cache_mb() > 0) {
+    cache_.reset(new DatumCache(static_cast<size_t>(
+        this->layer_param_.image_data_param().cache_mb()) << 20));
+  }
+  const int io_depth = this->layer_param_.image_data_param().io_depth();
+  if (io_depth > 0) {
+    if (cache_) {
+      LOG(WARNING) << "io_depth is ignored when caching images";
+    } else {
+      io_reader_.reset(new AsyncFileReader(io_depth));
+      LOG(INFO) << "Reading up to " << io_depth << " images at a time with "
+          << io_reader_->backend();
+      next_seq_ = 0;
+      submitted_seq_ = 0;
+      read_ahead_.clear();
+    }
+  }
   // Read an image, and use it to initialize the top blob.
   cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
                                     new_height, new_width, is_color);
@@ -105,12 +125,170 @@ void ImageDataLayer<Dtype>::ShuffleImages() {
   shuffle(lines_.begin(), lines_.end(), prefetch_rng);
 }
 
+template <typename Dtype>
+void ImageDataLayer<Dtype>::ReadCachedImage(int line_id, Datum* datum) {
+  const string& filename = lines_[line_id].first;
+  if (cache_->Get(filename, datum)) {
+    return;
+  }
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  cv::Mat cv_img = ReadImageToCVMat(image_data_param.root_folder() + filename,
+      image_data_param.new_height(), image_data_param.new_width(),
+      image_data_param.is_color());
+  CHECK(cv_img.data) << "Could not load " << filename;
+  CVMatToDatum(cv_img, datum);
+  cache_->Put(filename, *datum);
+}
+
+template <typename Dtype>
+void ImageDataLayer<Dtype>::NextLine() {
+  const int lines_size = lines_.size();
+  lines_id_++;
+  if (lines_id_ >= lines_size) {
+    // We have reached the end. Restart from the first.
+    DLOG(INFO) << "Restarting data prefetching from start.";
+    if (cache_ && Caffe::root_solver()) {
+      cache_->LogStats(this->layer_param_.name());
+    }
+    lines_id_ = 0;
+    if (this->layer_param_.image_data_param().shuffle()) {
+      ShuffleImages();
+    }
+  }
+}
+
+template <typename Dtype>
+cv::Mat ImageDataLayer<Dtype>::DecodeImage(const string& data,
+    const string& filename) {
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  const int new_height = image_data_param.new_height();
+  const int new_width = image_data_param.new_width();
+  const int cv_read_flag = (image_data_param.is_color() ?
+      CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+  cv::Mat cv_img;
+  if (!data.empty()) {
+    cv_img = DecodeImageToCVMat(data.data(), data.size(), cv_read_flag,
+        new_height, new_width);
+  }
+  CHECK(cv_img.data) << "Could not load " << filename;
+  if (new_height > 0 && new_width > 0) {
+    cv::Mat cv_resized;
+    cv::resize(cv_img, cv_resized, cv::Size(new_width, new_height));
+    return cv_resized;
+  }
+  return cv_img;
+}
+
+// This function is called on prefetch thread
+template <typename Dtype>
+void ImageDataLayer<Dtype>::LoadBatchAsync(Batch<Dtype>* batch) {
+  CPUTimer batch_timer;
+  batch_timer.Start();
+  double read_time = 0;
+  double trans_time = 0;
+  CPUTimer timer;
+  const int batch_size = this->layer_param_.image_data_param().batch_size();
+  const string& root_folder =
+      this->layer_param_.image_data_param().root_folder();
+
+  // Submit the reads of this batch that were not read ahead.
+  const uint64_t first_seq = next_seq_;
+  vector<string> filenames(batch_size);
+  Dtype* prefetch_label = batch->label_.mutable_cpu_data();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    filenames[item_id] = lines_[lines_id_].first;
+    prefetch_label[item_id] = lines_[lines_id_].second;
+    if (next_seq_ == submitted_seq_) {
+      io_reader_->Submit(submitted_seq_++, root_folder + filenames[item_id]);
+    }
+    ++next_seq_;
+    NextLine();
+  }
+  // Read the next batch ahead, but not past the end of the epoch, since the
+  // order of the next epoch is not known until it is shuffled.
+  const int lines_size = lines_.size();
+  for (int line_id = lines_id_ + (submitted_seq_ - next_seq_);
+       submitted_seq_ < next_seq_ + batch_size && line_id < lines_size;
+       ++line_id) {
+    io_reader_->Submit(submitted_seq_++, root_folder + lines_[line_id].first);
+  }
+
+  // Decode the images as their reads complete, in any order, starting with
+  // those that completed while the previous batch was read.
+  timer.Start();
+  CPUTimer decode_timer;
+  double decode_time = 0;
+  vector<cv::Mat> cv_imgs(batch_size);
+  int remaining = batch_size;
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    std::map<uint64_t, string>::iterator it =
+        read_ahead_.find(first_seq + item_id);
+    if (it != read_ahead_.end()) {
+      decode_timer.Start();
+      cv_imgs[item_id] = DecodeImage(it->second, filenames[item_id]);
+      decode_time += decode_timer.MicroSeconds();
+      read_ahead_.erase(it);
+      --remaining;
+    }
+  }
+  while (remaining > 0) {
+    string data;
+    bool ok;
+    const uint64_t seq = io_reader_->WaitAny(&data, &ok);
+    if (!ok) {
+      data.clear();
+    }
+    if (seq >= first_seq + batch_size) {
+      read_ahead_[seq].swap(data);
+      continue;
+    }
+    decode_timer.Start();
+    cv_imgs[seq - first_seq] = DecodeImage(data, filenames[seq - first_seq]);
+    decode_time += decode_timer.MicroSeconds();
+    --remaining;
+  }
+  // The rest of the time was spent waiting for reads.
+  read_time += timer.MicroSeconds() - decode_time;
+
+  // Reshape according to the first image of each batch, and transform the
+  // images in order so that random crops and mirrors are reproducible.
+  timer.Start();
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_imgs[0]);
+  this->transformed_data_.Reshape(top_shape);
+  top_shape[0] = batch_size;
+  batch->data_.Reshape(top_shape);
+  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    int offset = batch->data_.offset(item_id);
+    this->transformed_data_.set_cpu_data(prefetch_data + offset);
+    this->data_transformer_->Transform(cv_imgs[item_id],
+        &(this->transformed_data_));
+  }
+  this->data_transformer_->TransformBatch(&batch->data_);
+  trans_time += timer.MicroSeconds();
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
+  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "   Decode time: " << decode_time / 1000 << " ms.";
+  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  this->metrics_.AddStageTime(DataMetrics::READ, read_time);
+  this->metrics_.AddStageTime(DataMetrics::DECODE, decode_time);
+  this->metrics_.AddStageTime(DataMetrics::TRANSFORM, trans_time);
+}
+
 // This function is called on prefetch thread
 template <typename Dtype>
 void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  if (io_reader_) {
+    LoadBatchAsync(batch);
+    return;
+  }
   CPUTimer batch_timer;
   batch_timer.Start();
   double read_time = 0;
+  double decode_time = 0;
   double trans_time = 0;
   CPUTimer timer;
   CHECK(batch->data_.count());
@@ -124,11 +302,18 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
 
   // Reshape according to the first image of each batch
   // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-      new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-  // Use data_transformer to infer the expected blob shape from a cv_img.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
+  vector<int> top_shape;
+  Datum datum;
+  if (cache_) {
+    ReadCachedImage(lines_id_, &datum);
+    top_shape = this->data_transformer_->InferBlobShape(datum);
+  } else {
+    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
+        new_height, new_width, is_color);
+    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+    // Use data_transformer to infer the expected blob shape from a cv_img.
+    top_shape = this->data_transformer_->InferBlobShape(cv_img);
+  }
   this->transformed_data_.Reshape(top_shape);
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
@@ -143,33 +328,44 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     // get a blob
     timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
     int offset = batch->data_.offset(item_id);
     this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
+    if (cache_) {
+      ReadCachedImage(lines_id_, &datum);
+      read_time += timer.MicroSeconds();
+      timer.Start();
+      // Transform the cached pixels afresh, with a new crop and mirror.
+      this->data_transformer_->Transform(datum, &(this->transformed_data_));
+    } else {
+      string buffer;
+      ReadFileToString(root_folder + lines_[lines_id_].first, &buffer);
+      read_time += timer.MicroSeconds();
+      timer.Start();
+      cv::Mat cv_img = DecodeImage(buffer, lines_[lines_id_].first);
+      decode_time += timer.MicroSeconds();
+      timer.Start();
+      // Apply transformations (mirror, crop...) to the image
+      this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
+    }
     trans_time += timer.MicroSeconds();
 
     prefetch_label[item_id] = lines_[lines_id_].second;
     // go to the next iter
-    lines_id_++;
-    if (lines_id_ >= lines_size) {
-      // We have reached the end. Restart from the first.
-      DLOG(INFO) << "Restarting data prefetching from start.";
-      lines_id_ = 0;
-      if (this->layer_param_.image_data_param().shuffle()) {
-        ShuffleImages();
-      }
-    }
+    NextLine();
   }
+  timer.Start();
+  this->data_transformer_->TransformBatch(&batch->data_);
+  trans_time += timer.MicroSeconds();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "   Decode time: " << decode_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  this->metrics_.AddStageTime(DataMetrics::READ, read_time);
+  if (!cache_) {
+    this->metrics_.AddStageTime(DataMetrics::DECODE, decode_time);
+  }
+  this->metrics_.AddStageTime(DataMetrics::TRANSFORM, trans_time);
 }
 
 INSTANTIATE_CLASS(ImageDataLayer);
@@ -28,10 +28,22 @@ void MemoryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   labels_ = NULL;
   added_data_.cpu_data();
   added_label_.cpu_data();
+  const int num_buffers = this->layer_param_.memory_data_param().num_buffers();
+  for (int i = 0; i < num_buffers; ++i) {
+    shared_ptr<Batch<Dtype> > buffer(new Batch<Dtype>());
+    buffer->data_.Reshape(batch_size_, channels_, height_, width_);
+    buffer->label_.Reshape(label_shape);
+    // Allocate now, not on the producer thread.
+    buffer->data_.mutable_cpu_data();
+    buffer->label_.mutable_cpu_data();
+    buffers_.push_back(buffer);
+    buffer_free_.push(buffer.get());
+  }
 }
 
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::AddDatumVector(const vector<Datum>& datum_vector) {
+  CHECK(buffers_.empty()) << "Use FillBuffer when num_buffers is set.";
   CHECK(!has_new_data_) <<
       "Can't add data until current data has been consumed.";
   size_t num = datum_vector.size();
@@ -58,6 +70,7 @@ template <typename Dtype>
 void MemoryDataLayer<Dtype>::AddMatVector(const vector<cv::Mat>& mat_vector,
     const vector<int>& labels) {
   size_t num = mat_vector.size();
+  CHECK(buffers_.empty()) << "Use FillBuffer when num_buffers is set.";
   CHECK(!has_new_data_) <<
       "Can't add mat until current data has been consumed.";
   CHECK_GT(num, 0) << "There is no mat to add";
@@ -79,8 +92,49 @@ void MemoryDataLayer<Dtype>::AddMatVector(const vector<cv::Mat>& mat_vector,
 }
 #endif  // USE_OPENCV
 
+template <typename Dtype>
+Batch<Dtype>* MemoryDataLayer<Dtype>::AcquireBuffer() {
+  CHECK(!buffers_.empty()) << "Set num_buffers to acquire buffers.";
+  return buffer_free_.pop();
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::ReleaseBuffer(Batch<Dtype>* buffer) {
+  buffer_full_.push(buffer);
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::FillBuffer(const vector<Datum>& datum_vector,
+    Batch<Dtype>* buffer) {
+  CHECK_EQ(datum_vector.size(), batch_size_) <<
+      "A buffer holds exactly one batch.";
+  // Apply data transformations (mirror, scale, crop...)
+  this->data_transformer_->Transform(datum_vector, &buffer->data_);
+  Dtype* label = buffer->label_.mutable_cpu_data();
+  for (int item_id = 0; item_id < batch_size_; ++item_id) {
+    label[item_id] = datum_vector[item_id].label();
+  }
+}
+
+#ifdef USE_OPENCV
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::FillBuffer(const vector<cv::Mat>& mat_vector,
+    const vector<int>& labels, Batch<Dtype>* buffer) {
+  CHECK_EQ(mat_vector.size(), batch_size_) <<
+      "A buffer holds exactly one batch.";
+  CHECK_EQ(labels.size(), batch_size_);
+  // Apply data transformations (mirror, scale, crop...)
+  this->data_transformer_->Transform(mat_vector, &buffer->data_);
+  Dtype* label = buffer->label_.mutable_cpu_data();
+  for (int item_id = 0; item_id < batch_size_; ++item_id) {
+    label[item_id] = labels[item_id];
+  }
+}
+#endif  // USE_OPENCV
+
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
+  CHECK(buffers_.empty()) << "Use AcquireBuffer when num_buffers is set.";
   CHECK(data);
   CHECK(labels);
   CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
@@ -99,6 +153,7 @@ template <typename Dtype>
 void MemoryDataLayer<Dtype>::set_batch_size(int new_size) {
   CHECK(!has_new_data_) <<
       "Can't change batch_size until current data has been consumed.";
+  CHECK(buffers_.empty()) << "Can't change batch_size of buffers.";
   batch_size_ = new_size;
   added_data_.Reshape(batch_size_, channels_, height_, width_);
   added_label_.Reshape(batch_size_, 1, 1, 1);
@@ -107,6 +162,18 @@ void MemoryDataLayer<Dtype>::set_batch_size(int new_size) {
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (!buffers_.empty()) {
+    // The tops of the previous batch are no longer used.
+    if (forwarded_buffer_) {
+      buffer_free_.push(forwarded_buffer_);
+    }
+    forwarded_buffer_ = buffer_full_.pop("Waiting for a MemoryData buffer");
+    top[0]->ReshapeLike(forwarded_buffer_->data_);
+    top[1]->ReshapeLike(forwarded_buffer_->label_);
+    top[0]->set_cpu_data(forwarded_buffer_->data_.mutable_cpu_data());
+    top[1]->set_cpu_data(forwarded_buffer_->label_.mutable_cpu_data());
+    return;
+  }
   CHECK(data_) << "MemoryDataLayer needs to be initialized by calling Reset";
   top[0]->Reshape(batch_size_, channels_, height_, width_);
   top[1]->Reshape(batch_size_, 1, 1, 1);
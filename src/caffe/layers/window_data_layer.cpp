@@ -17,6 +17,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/layers/window_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/image_decode.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
@@ -240,6 +241,7 @@ void WindowDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   const int context_pad = this->layer_param_.window_data_param().context_pad();
   const int crop_size = this->transform_param_.crop_size();
   const bool mirror = this->transform_param_.mirror();
+  const bool roi_decode = this->transform_param_.roi_decode();
   const float fg_fraction =
       this->layer_param_.window_data_param().fg_fraction();
   Dtype* mean = NULL;
@@ -284,27 +286,72 @@ void WindowDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       pair<std::string, vector<int> > image =
           image_database_[window[WindowDataLayer<Dtype>::IMAGE_INDEX]];
 
-      cv::Mat cv_img;
+      int x1 = window[WindowDataLayer<Dtype>::X1];
+      int y1 = window[WindowDataLayer<Dtype>::Y1];
+      int x2 = window[WindowDataLayer<Dtype>::X2];
+      int y2 = window[WindowDataLayer<Dtype>::Y2];
+
+      // the window is warped to crop_size x crop_size, so a JPEG may be
+      // decoded at a reduced resolution as long as the window keeps at least
+      // crop_size pixels each way
+      const int image_height = image.second[1];
+      const int image_width = image.second[2];
+      const int min_height =
+          (image_height * crop_size + y2 - y1) / std::max(y2 - y1 + 1, 1);
+      const int min_width =
+          (image_width * crop_size + x2 - x1) / std::max(x2 - x1 + 1, 1);
+
+      // with roi_decode, only the region the window needs is decoded, at
+      // the size given by the image header
+      string buffer;
+      const string* encoded = NULL;
       if (this->cache_images_) {
-        pair<std::string, Datum> image_cached =
-          image_database_cache_[window[WindowDataLayer<Dtype>::IMAGE_INDEX]];
-        cv_img = DecodeDatumToCVMat(image_cached.second, true);
-      } else {
-        cv_img = cv::imread(image.first, CV_LOAD_IMAGE_COLOR);
-        if (!cv_img.data) {
+        encoded = &image_database_cache_[
+            window[WindowDataLayer<Dtype>::IMAGE_INDEX]].second.data();
+      } else if (roi_decode) {
+        if (!ReadFileToString(image.first, &buffer)) {
           LOG(ERROR) << "Could not open or find file " << image.first;
           return;
         }
+        encoded = &buffer;
+      }
+      int img_rows, img_cols, channels;
+      const bool decode_region = roi_decode &&
+          DecodedImageShape(encoded->data(), encoded->size(), 3, min_height,
+              min_width, &img_rows, &img_cols, &channels);
+      cv::Mat cv_img;
+      if (!decode_region) {
+        if (encoded) {
+          cv_img = DecodeImageToCVMat(encoded->data(), encoded->size(),
+              CV_LOAD_IMAGE_COLOR, min_height, min_width);
+          LOG_IF(ERROR, !cv_img.data) << "Could not decode " << image.first;
+        } else {
+          cv_img = ReadImageToCVMatAtLeast(image.first, min_height,
+              min_width, true);
+        }
+        if (!cv_img.data) {
+          return;
+        }
+        img_rows = cv_img.rows;
+        img_cols = cv_img.cols;
+        channels = cv_img.channels();
       }
       read_time += timer.MicroSeconds();
       timer.Start();
-      const int channels = cv_img.channels();
+
+      // map the window to the decoded image if it was reduced
+      if (img_cols != image_width && image_width > 0) {
+        const Dtype image_scale =
+            static_cast<Dtype>(img_cols) / static_cast<Dtype>(image_width);
+        x1 = static_cast<int>(x1 * image_scale);
+        y1 = static_cast<int>(y1 * image_scale);
+        x2 = std::min(static_cast<int>(ceil((x2 + 1) * image_scale)) - 1,
+            img_cols - 1);
+        y2 = std::min(static_cast<int>(ceil((y2 + 1) * image_scale)) - 1,
+            img_rows - 1);
+      }
 
       // crop window out of image and warp it
-      int x1 = window[WindowDataLayer<Dtype>::X1];
-      int y1 = window[WindowDataLayer<Dtype>::Y1];
-      int x2 = window[WindowDataLayer<Dtype>::X2];
-      int y2 = window[WindowDataLayer<Dtype>::Y2];
 
       int pad_w = 0;
       int pad_h = 0;
@@ -339,8 +386,8 @@ void WindowDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
         int unclipped_width = x2-x1+1;
         int pad_x1 = std::max(0, -x1);
         int pad_y1 = std::max(0, -y1);
-        int pad_x2 = std::max(0, x2 - cv_img.cols + 1);
-        int pad_y2 = std::max(0, y2 - cv_img.rows + 1);
+        int pad_x2 = std::max(0, x2 - img_cols + 1);
+        int pad_y2 = std::max(0, y2 - img_rows + 1);
         // clip bounds
         x1 = x1 + pad_x1;
         x2 = x2 - pad_x2;
@@ -348,8 +395,8 @@ void WindowDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
         y2 = y2 - pad_y2;
         CHECK_GT(x1, -1);
         CHECK_GT(y1, -1);
-        CHECK_LT(x2, cv_img.cols);
-        CHECK_LT(y2, cv_img.rows);
+        CHECK_LT(x2, img_cols);
+        CHECK_LT(y2, img_rows);
 
         int clipped_height = y2-y1+1;
         int clipped_width = x2-x1+1;
@@ -390,7 +437,22 @@ void WindowDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       }
 
       cv::Rect roi(x1, y1, x2-x1+1, y2-y1+1);
-      cv::Mat cv_cropped_img = cv_img(roi);
+      cv::Mat cv_cropped_img;
+      if (decode_region) {
+        trans_time += timer.MicroSeconds();
+        timer.Start();
+        cv_cropped_img.create(roi.height, roi.width, CV_8UC3);
+        if (!DecodeImageRegion(encoded->data(), encoded->size(), 3,
+            min_height, min_width, y1, x1, roi.height, roi.width,
+            cv_cropped_img.data)) {
+          LOG(ERROR) << "Could not decode " << image.first;
+          return;
+        }
+        read_time += timer.MicroSeconds();
+        timer.Start();
+      } else {
+        cv_cropped_img = cv_img(roi);
+      }
       cv::resize(cv_cropped_img, cv_cropped_img,
           cv_crop_size, 0, 0, cv::INTER_LINEAR);
 
@@ -467,6 +529,8 @@ void WindowDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  this->metrics_.AddStageTime(DataMetrics::READ, read_time);
+  this->metrics_.AddStageTime(DataMetrics::TRANSFORM, trans_time);
 }
 
 INSTANTIATE_CLASS(WindowDataLayer);
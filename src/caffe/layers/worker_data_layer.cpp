@@ -0,0 +1,243 @@
+#include <boost/thread.hpp>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "caffe/layer_factory.hpp"
+#include "caffe/layers/worker_data_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Top blobs are aligned on cache lines in a slot.
+static size_t AlignedBytes(size_t size) {
+  return (size + 63) / 64 * 64;
+}
+
+// Makes the calling process exit with its parent.
+static void ExitWithParent() {
+#ifdef __linux__
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+}
+
+template <typename Dtype>
+WorkerDataLayer<Dtype>::~WorkerDataLayer<Dtype>() {
+  this->StopInternalThread();
+  if (ring_) {
+    ring_->Shutdown();
+    waitpid(supervisor_, NULL, 0);
+  }
+}
+
+template <typename Dtype>
+LayerParameter WorkerDataLayer<Dtype>::WorkerLayerParam() const {
+  LayerParameter param(this->layer_param_.worker_data_param().layer());
+  if (!param.has_name()) {
+    param.set_name(this->layer_param_.name() + "_worker");
+  }
+  param.set_phase(this->phase_);
+  return param;
+}
+
+template <typename Dtype>
+void WorkerDataLayer<Dtype>::DataLayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const WorkerDataParameter& param = this->layer_param_.worker_data_param();
+  CHECK(param.has_layer()) << "worker_data_param must specify the layer";
+  CHECK_GT(param.workers(), 0);
+  LOG_IF(WARNING, this->phase_ == TEST && param.workers() > 1)
+      << "The " << param.workers() << " workers of "
+      << this->layer_param_.name() << " all read the whole test data";
+
+  // Set up a copy of the layer to learn the shapes of its tops.
+  {
+    shared_ptr<Layer<Dtype> > layer =
+        LayerRegistry<Dtype>::CreateLayer(WorkerLayerParam());
+    vector<shared_ptr<Blob<Dtype> > > blobs;
+    vector<Blob<Dtype>*> layer_top;
+    for (int i = 0; i < top.size(); ++i) {
+      blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      layer_top.push_back(blobs[i].get());
+    }
+    layer->SetUp(vector<Blob<Dtype>*>(), layer_top);
+    shapes_.clear();
+    for (int i = 0; i < top.size(); ++i) {
+      shapes_.push_back(layer_top[i]->shape());
+    }
+  }
+  size_t slot_bytes = 0;
+  offsets_.clear();
+  for (int i = 0; i < top.size(); ++i) {
+    top[i]->Reshape(shapes_[i]);
+    offsets_.push_back(slot_bytes);
+    slot_bytes += AlignedBytes(top[i]->count() * sizeof(Dtype));
+  }
+  for (int j = 0; j < this->prefetch_.size(); ++j) {
+    Batch<Dtype>* batch = this->prefetch_[j].get();
+    batch->data_.Reshape(shapes_[0]);
+    if (this->output_labels_) {
+      batch->label_.Reshape(shapes_[1]);
+    }
+    batch->extra_.clear();
+    for (int i = 2; i < top.size(); ++i) {
+      batch->extra_.push_back(
+          shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shapes_[i])));
+    }
+  }
+
+  // Each worker fills one slot while the prefetch batches hold the others.
+  ring_.reset(new SharedBatchRing(this->prefetch_.size() + param.workers(),
+      slot_bytes, param.workers()));
+  batch_slots_.clear();
+  LOG(INFO) << "Starting " << param.workers() << " workers for "
+      << this->layer_param_.name();
+  // Output buffered in the parent would be written again by the children.
+  fflush(NULL);
+  supervisor_ = fork();
+  CHECK_GE(supervisor_, 0) << "fork failed: " << strerror(errno);
+  if (supervisor_ == 0) {
+    Supervise();
+    _exit(0);
+  }
+}
+
+template <typename Dtype>
+void WorkerDataLayer<Dtype>::Supervise() {
+  ExitWithParent();
+  const int workers = this->layer_param_.worker_data_param().workers();
+  for (int i = 0; i < workers; ++i) {
+    ring_->set_worker_pid(i, StartWorker(i));
+  }
+  while (!ring_->shutting_down()) {
+    int status;
+    const pid_t pid = waitpid(-1, &status, WNOHANG);
+    if (pid <= 0) {
+      usleep(100000);
+      continue;
+    }
+    for (int i = 0; i < workers; ++i) {
+      if (ring_->worker_pid(i) != pid) {
+        continue;
+      }
+      ring_->Reclaim(pid);
+      if (WIFSIGNALED(status)) {
+        LOG(ERROR) << "Worker " << i << " of " << this->layer_param_.name()
+            << " was killed by signal " << WTERMSIG(status)
+            << ", restarting it";
+      } else {
+        LOG(ERROR) << "Worker " << i << " of " << this->layer_param_.name()
+            << " exited with status " << WEXITSTATUS(status)
+            << ", restarting it";
+      }
+      ring_->set_worker_pid(i, StartWorker(i));
+    }
+  }
+  // The workers stop at their next slot; do not wait for a slow Forward.
+  for (int i = 0; i < workers; ++i) {
+    kill(ring_->worker_pid(i), SIGTERM);
+  }
+  for (int i = 0; i < workers; ++i) {
+    waitpid(ring_->worker_pid(i), NULL, 0);
+  }
+}
+
+template <typename Dtype>
+pid_t WorkerDataLayer<Dtype>::StartWorker(int worker) {
+  fflush(NULL);
+  const pid_t pid = fork();
+  CHECK_GE(pid, 0) << "fork failed: " << strerror(errno);
+  if (pid == 0) {
+    RunWorker(worker);
+    _exit(0);
+  }
+  return pid;
+}
+
+template <typename Dtype>
+void WorkerDataLayer<Dtype>::RunWorker(int worker) {
+  ExitWithParent();
+  // Also recorded by the supervisor, possibly after the first batch.
+  ring_->set_worker_pid(worker, getpid());
+  const int workers = this->layer_param_.worker_data_param().workers();
+  // The workers read their part of the data as parallel solvers do, with
+  // their own random numbers.
+  Caffe::set_mode(Caffe::CPU);
+  Caffe::set_solver_count(Caffe::solver_count() * workers);
+  Caffe::set_solver_rank(Caffe::solver_rank() * workers + worker);
+  Caffe::set_multiprocess(true);
+  Caffe::set_cpu_random_seed(caffe_rng_rand() + getpid());
+
+  shared_ptr<Layer<Dtype> > layer =
+      LayerRegistry<Dtype>::CreateLayer(WorkerLayerParam());
+  vector<shared_ptr<Blob<Dtype> > > blobs;
+  vector<Blob<Dtype>*> bottom, top;
+  for (int i = 0; i < shapes_.size(); ++i) {
+    blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    top.push_back(blobs[i].get());
+  }
+  layer->SetUp(bottom, top);
+  for (int slot = ring_->AcquireFree(); slot >= 0;
+      slot = ring_->AcquireFree()) {
+    layer->Forward(bottom, top);
+    char* data = ring_->slot_data(slot);
+    for (int i = 0; i < top.size(); ++i) {
+      CHECK(top[i]->shape() == shapes_[i]) << "Top " << i << " of "
+          << layer->layer_param().name() << " changed shape to "
+          << top[i]->shape_string();
+      memcpy(data + offsets_[i], top[i]->cpu_data(),
+          top[i]->count() * sizeof(Dtype));
+    }
+    ring_->PushFull(slot);
+  }
+}
+
+template <typename Dtype>
+Blob<Dtype>* WorkerDataLayer<Dtype>::batch_blob(Batch<Dtype>* batch, int i) {
+  if (i == 0) {
+    return &batch->data_;
+  }
+  return i == 1 ? &batch->label_ : batch->extra_[i - 2].get();
+}
+
+// This function is called on prefetch thread
+template <typename Dtype>
+void WorkerDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  CPUTimer timer;
+  timer.Start();
+  // The batch is free again, so is the slot it pointed to.
+  typename std::map<Batch<Dtype>*, int>::iterator it =
+      batch_slots_.find(batch);
+  if (it != batch_slots_.end()) {
+    ring_->Release(it->second);
+    batch_slots_.erase(it);
+  }
+  int slot = ring_->PopFull(100);
+  while (slot < 0) {
+    boost::this_thread::interruption_point();
+    CHECK_EQ(waitpid(supervisor_, NULL, WNOHANG), 0)
+        << "The workers of " << this->layer_param_.name() << " have exited";
+    slot = ring_->PopFull(100);
+  }
+  batch_slots_[batch] = slot;
+  char* data = ring_->slot_data(slot);
+  for (int i = 0; i < shapes_.size(); ++i) {
+    batch_blob(batch, i)->set_cpu_data(
+        reinterpret_cast<Dtype*>(data + offsets_[i]));
+  }
+  this->metrics_.AddStageTime(DataMetrics::READ, timer.MicroSeconds());
+}
+
+INSTANTIATE_CLASS(WorkerDataLayer);
+REGISTER_LAYER_CLASS(WorkerData);
+
+}  // namespace caffe
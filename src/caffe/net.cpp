@@ -251,6 +251,26 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  if (param.contiguous_params()) {
+    InitParamArena();
+  }
+  recomputed_segment_ = -1;
+  if (param.checkpoint_activations() && phase_ == TRAIN) {
+    InitCheckpoints();
+  }
+  if (param.bf16_activations()) {
+    // Data layers, and the losses, keep their precision.
+    layer_bf16_.resize(layers_.size());
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      layer_bf16_[layer_id] = !bottom_vecs_[layer_id].empty();
+      for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
+        if (layers_[layer_id]->loss(top_id)) {
+          layer_bf16_[layer_id] = false;
+        }
+      }
+    }
+  }
+  loss_scale_ = 1;
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
@@ -516,6 +536,7 @@ template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  const bool checkpoint = checkpoint_activations();
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
     for (int c = 0; c < before_forward_.size(); ++c) {
@@ -523,10 +544,19 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
     }
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
+    if (layer_bf16_.size() && layer_bf16_[i]) { RoundBF16(i, false); }
     if (debug_info_) { ForwardDebugInfo(i); }
     for (int c = 0; c < after_forward_.size(); ++c) {
       after_forward_[c]->run(i);
     }
+    if (checkpoint) {
+      for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+        const int blob_id = bottom_id_vecs_[i][j];
+        if (blob_last_use_[blob_id] == i) {
+          ReleaseBlob(blob_id, i, false);
+        }
+      }
+    }
   }
   return loss;
 }
@@ -567,19 +597,99 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  const bool checkpoint = checkpoint_activations();
   for (int i = start; i >= end; --i) {
+    if (checkpoint && layer_need_backward_[i] &&
+        layer_segment_[i] != recomputed_segment_) {
+      RecomputeSegment(layer_segment_[i]);
+    }
     for (int c = 0; c < before_backward_.size(); ++c) {
       before_backward_[c]->run(i);
     }
     if (layer_need_backward_[i]) {
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (layer_bf16_.size() && layer_bf16_[i]) { RoundBF16(i, true); }
       if (debug_info_) { BackwardDebugInfo(i); }
     }
     for (int c = 0; c < after_backward_.size(); ++c) {
       after_backward_[c]->run(i);
     }
   }
+  if (checkpoint && recomputed_segment_ >= 0) {
+    // Keep the diffs of a segment Backward did not get through, for the next
+    // call to continue from.
+    ReleaseSegment(recomputed_segment_, end <= recomputed_segment_);
+    recomputed_segment_ = -1;
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::RecomputeSegment(int segment) {
+  if (recomputed_segment_ >= 0) {
+    // Backward is done with the segment above.
+    ReleaseSegment(recomputed_segment_, true);
+  }
+  for (int i = segment; i < layers_.size() && layer_segment_[i] == segment;
+       ++i) {
+    if (!layer_checkpoint_[i]) {
+      layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+      if (layer_bf16_.size() && layer_bf16_[i]) { RoundBF16(i, false); }
+    }
+  }
+  recomputed_segment_ = segment;
+}
+
+template <typename Dtype>
+void Net<Dtype>::RoundBF16(int layer_id, bool backward) {
+  if (backward) {
+    for (int i = 0; i < bottom_vecs_[layer_id].size(); ++i) {
+      if (bottom_need_backward_[layer_id][i]) {
+        Blob<Dtype>* blob = bottom_vecs_[layer_id][i];
+        caffe_cpu_round_bf16(blob->count(), blob->mutable_cpu_diff());
+      }
+    }
+  } else {
+    for (int i = 0; i < top_vecs_[layer_id].size(); ++i) {
+      Blob<Dtype>* blob = top_vecs_[layer_id][i];
+      caffe_cpu_round_bf16(blob->count(), blob->mutable_cpu_data());
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReleaseSegment(int segment, bool diff) {
+  for (int i = segment; i < layers_.size() && layer_segment_[i] == segment;
+       ++i) {
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      ReleaseBlob(top_id_vecs_[i][j], layers_.size(), diff);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReleaseBlob(int blob_id, int layer_id, bool diff) {
+  const Blob<Dtype>* blob = blobs_[blob_id].get();
+  if (blob_last_use_[blob_id] < 0 || blob->count() == 0) {
+    return;
+  }
+  // Layers such as Reshape or Split share the memory of their bottom, with
+  // blobs that may be kept, or still read.
+  bool shared_data = false;
+  bool shared_diff = false;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    if ((blob_last_use_[i] < 0 || blob_last_use_[i] > layer_id) &&
+        blobs_[i]->count() > 0) {
+      shared_data = shared_data || blobs_[i]->data() == blob->data();
+      shared_diff = shared_diff || blobs_[i]->diff() == blob->diff();
+    }
+  }
+  if (!shared_data) {
+    blob->data()->release();
+  }
+  if (diff && !shared_diff) {
+    blob->diff()->release();
+  }
 }
 
 template <typename Dtype>
@@ -663,6 +773,16 @@ void Net<Dtype>::UpdateDebugInfo(const int param_id) {
 
 template <typename Dtype>
 void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
+  ShareOrCopyTrainedLayers(other, false);
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const Net* other) {
+  ShareOrCopyTrainedLayers(other, true);
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareOrCopyTrainedLayers(const Net* other, bool copy) {
   int num_source_layers = other->layers().size();
   for (int i = 0; i < num_source_layers; ++i) {
     Layer<Dtype>* source_layer = other->layers()[i].get();
@@ -684,11 +804,16 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
     for (int j = 0; j < target_blobs.size(); ++j) {
       Blob<Dtype>* source_blob = source_layer->blobs()[j].get();
       CHECK(target_blobs[j]->shape() == source_blob->shape())
-          << "Cannot share param " << j << " weights from layer '"
-          << source_layer_name << "'; shape mismatch.  Source param shape is "
+          << "Cannot " << (copy ? "copy" : "share") << " param " << j
+          << " weights from layer '" << source_layer_name
+          << "'; shape mismatch.  Source param shape is "
           << source_blob->shape_string() << "; target param shape is "
           << target_blobs[j]->shape_string();
-      target_blobs[j]->ShareData(*source_blob);
+      if (copy) {
+        target_blobs[j]->CopyFrom(*source_blob);
+      } else {
+        target_blobs[j]->ShareData(*source_blob);
+      }
     }
   }
 }
@@ -846,8 +971,32 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ToProto(NetParameter* param, bool write_diff,
+    const vector<shared_ptr<Blob<Dtype> > >& params) const {
+  CHECK_EQ(params.size(), params_.size());
+  param->Clear();
+  param->set_name(name_);
+  for (int i = 0; i < layers_.size(); ++i) {
+    LayerParameter* layer_param = param->add_layer();
+    layer_param->CopyFrom(layers_[i]->layer_param());
+    layer_param->clear_blobs();
+    for (int j = 0; j < param_id_vecs_[i].size(); ++j) {
+      params[param_id_vecs_[i][j]]->ToProto(layer_param->add_blobs(),
+          write_diff);
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  ToHDF5(filename, write_diff, params_);
+}
+
+template <typename Dtype>
+void Net<Dtype>::ToHDF5(const string& filename, bool write_diff,
+    const vector<shared_ptr<Blob<Dtype> > >& params) const {
+  CHECK_EQ(params.size(), params_.size());
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -883,12 +1032,12 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
       if (param_owners_[net_param_id] == -1) {
         // Only save params that own themselves
         hdf5_save_nd_dataset<Dtype>(layer_data_hid, dataset_name.str(),
-            *params_[net_param_id]);
+            *params[net_param_id]);
       }
       if (write_diff) {
         // Write diffs regardless of weight-sharing
         hdf5_save_nd_dataset<Dtype>(layer_diff_hid, dataset_name.str(),
-            *params_[net_param_id], true);
+            *params[net_param_id], true);
       }
     }
     H5Gclose(layer_data_hid);
@@ -903,15 +1052,201 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void Net<Dtype>::InitParamArena() {
+  int count = 0;
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    count += learnable_params_[i]->count();
+  }
+  if (count == 0) {
+    return;
+  }
+  param_arena_.reset(new Blob<Dtype>(vector<int>(1, count)));
+  Dtype* data = param_arena_->mutable_cpu_data();
+  Dtype* diff = param_arena_->mutable_cpu_diff();
+  caffe_set(count, Dtype(0), diff);
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    caffe_copy(blob->count(), blob->cpu_data(), data);
+    // The blobs sharing the param share its SyncedMemory, so see the arena.
+    blob->data()->set_cpu_data(data);
+    blob->diff()->set_cpu_data(diff);
+    data += blob->count();
+    diff += blob->count();
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitCheckpoints() {
+  const int num_layers = layers_.size();
+  layer_checkpoint_.assign(num_layers, false);
+  bool chosen = false;
+  for (int i = 0; i < num_layers; ++i) {
+    if (layers_[i]->layer_param().checkpoint()) {
+      layer_checkpoint_[i] = true;
+      chosen = true;
+    }
+  }
+  if (!chosen) {
+    // Segments of sqrt(N) layers balance the blobs kept and those recomputed
+    // at once.
+    int interval = 1;
+    while (interval * interval < num_layers) {
+      ++interval;
+    }
+    for (int i = interval - 1; i < num_layers; i += interval) {
+      layer_checkpoint_[i] = true;
+    }
+  }
+  for (int i = 0; i < num_layers; ++i) {
+    // Data layers would read the next batch.
+    if (bottom_vecs_[i].empty() || !layers_[i]->AllowRecompute()) {
+      layer_checkpoint_[i] = true;
+    }
+  }
+  // Blobs are kept if a checkpoint writes them, or if they are read out of
+  // the segment that writes them. The layers that write blobs kept, e.g. in
+  // place, become checkpoints as well, until the segments settle.
+  layer_segment_.resize(num_layers);
+  vector<bool> blob_kept;
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int i = 0, segment = 0; i < num_layers; ++i) {
+      layer_segment_[i] = segment;
+      if (layer_checkpoint_[i]) {
+        segment = i + 1;
+      }
+    }
+    blob_kept.assign(blobs_.size(), false);
+    for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+      blob_kept[net_output_blob_indices_[i]] = true;
+    }
+    for (int blob_id = 0; blob_id < blob_loss_weights_.size(); ++blob_id) {
+      // The diffs of the blobs in the loss hold their loss weight.
+      if (blob_loss_weights_[blob_id] != 0) {
+        blob_kept[blob_id] = true;
+      }
+    }
+    // The net inputs have no segment, and are kept as read out of it.
+    vector<int> blob_segment(blobs_.size(), -1);
+    for (int i = 0; i < num_layers; ++i) {
+      for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+        const int blob_id = bottom_id_vecs_[i][j];
+        if (blob_segment[blob_id] != layer_segment_[i]) {
+          blob_kept[blob_id] = true;
+        }
+      }
+      for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+        const int blob_id = top_id_vecs_[i][j];
+        if (blob_segment[blob_id] < 0) {
+          blob_segment[blob_id] = layer_segment_[i];
+        }
+        if (layer_checkpoint_[i]) {
+          blob_kept[blob_id] = true;
+        }
+      }
+    }
+    for (int i = 0; i < num_layers; ++i) {
+      for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+        if (!layer_checkpoint_[i] && blob_kept[top_id_vecs_[i][j]]) {
+          layer_checkpoint_[i] = true;
+          changed = true;
+        }
+      }
+    }
+  }
+  blob_last_use_.assign(blobs_.size(), -1);
+  for (int i = 0; i < num_layers; ++i) {
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      const int blob_id = bottom_id_vecs_[i][j];
+      if (!blob_kept[blob_id]) {
+        blob_last_use_[blob_id] = i;
+      }
+    }
+  }
+  size_t total, peak;
+  ActivationMemory(&total, &peak);
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Checkpoints: " << std::count(layer_checkpoint_.begin(),
+          layer_checkpoint_.end(), true) << " of " << num_layers
+      << " layers; memory required for data at once: " << peak
+      << " instead of " << total;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ActivationMemory(size_t* total, size_t* peak) const {
+  size_t kept = 0;
+  // The bytes of the blobs recomputed, by segment
+  vector<size_t> segment_bytes(layers_.size() + 1, 0);
+  *total = 0;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const size_t bytes = blobs_[blob_id]->count() * sizeof(Dtype);
+    *total += bytes;
+    if (blob_last_use_.empty() || blob_last_use_[blob_id] < 0) {
+      kept += bytes;
+    } else {
+      segment_bytes[layer_segment_[blob_last_use_[blob_id]]] += bytes;
+    }
+  }
+  *peak = kept + *std::max_element(segment_bytes.begin(),
+                                   segment_bytes.end());
+}
+
+template <typename Dtype>
+Blob<Dtype>* Net<Dtype>::learnable_params_arena() {
+  if (!param_arena_ || Caffe::mode() != Caffe::CPU) {
+    return NULL;
+  }
+  // The mutable accessors of the blobs also mark their values as changed on
+  // the CPU, as the caller writes them through the arena.
+  const Dtype* data = param_arena_->cpu_data();
+  const Dtype* diff = param_arena_->cpu_diff();
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    if (blob->mutable_cpu_data() != data || blob->mutable_cpu_diff() != diff) {
+      return NULL;
+    }
+    data += blob->count();
+    diff += blob->count();
+  }
+  return param_arena_.get();
+}
+
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  Blob<Dtype>* arena = learnable_params_arena();
+  if (arena) {
+    arena->Update();
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     learnable_params_[i]->Update();
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::set_loss_scale(Dtype scale) {
+  if (scale == loss_scale_) {
+    return;
+  }
+  loss_scale_ = scale;
+  for (int blob_id = 0; blob_id < blob_loss_weights_.size(); ++blob_id) {
+    const Dtype loss_weight = blob_loss_weights_[blob_id];
+    if (loss_weight != 0) {
+      Blob<Dtype>* blob = blobs_[blob_id].get();
+      caffe_set(blob->count(), loss_weight * scale, blob->mutable_cpu_diff());
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  Blob<Dtype>* arena = learnable_params_arena();
+  if (arena) {
+    caffe_set(arena->count(), static_cast<Dtype>(0),
+              arena->mutable_cpu_diff());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
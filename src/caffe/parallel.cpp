@@ -1,8 +1,10 @@
 #ifdef USE_NCCL
-
 #include <cuda_runtime.h>
+#endif  // USE_NCCL
+#include <boost/thread.hpp>
 #include <glog/logging.h>
 #include <stdio.h>
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -72,6 +74,486 @@ Params<Dtype>::Params(shared_ptr<Solver<Dtype> > root_solver)
     diff_() {
 }
 
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(shared_ptr<Solver<Dtype> > root_solver)
+  : Params<Dtype>(root_solver) {
+  bool use_cuda;
+  CaffeMallocHost(reinterpret_cast<void**>(&data_), size_ * sizeof(Dtype),
+                  &use_cuda);
+  CHECK(!use_cuda);
+  const vector<Blob<Dtype>*>& net =
+    root_solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, copy);
+
+  CaffeMallocHost(reinterpret_cast<void**>(&diff_), size_ * sizeof(Dtype),
+                  &use_cuda);
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::~CPUParams() {
+  CaffeFreeHost(data_, false);
+  CaffeFreeHost(diff_, false);
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::Configure(Solver<Dtype>* solver) const {
+  const vector<Blob<Dtype>*>& net =
+    solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, replace_cpu);
+  apply_buffers(net, diff_, size_, replace_cpu_diff);
+}
+
+// Gradients are summed by blocks of that many values, a multiple of the
+// cache line, so that the blocks of all replicas stay in cache.
+static const int kReduceBlock = 4096;
+
+template<typename Dtype>
+class CPUReplica : public InternalThread {
+ public:
+  explicit CPUReplica(CPUParallel<Dtype>* parallel)
+    : parallel_(parallel) {
+  }
+  virtual ~CPUReplica() {}
+
+ protected:
+  void InternalThreadEntry() {
+    const SolverParameter& param = parallel_->solver_->param();
+    if (param.random_seed() >= 0) {
+      Caffe::set_random_seed(param.random_seed() + Caffe::solver_rank());
+    }
+    NetParameter net_param;
+    parallel_->solver_->GetTrainNetParam(&net_param);
+    // The buffers of CPUParams replace those of the params anyway.
+    net_param.set_contiguous_params(false);
+    shared_ptr<Net<Dtype> > net;
+    {
+      // Data layers may open libraries that are not thread-safe, e.g. HDF5.
+      static boost::mutex mutex;
+      boost::mutex::scoped_lock lock(mutex);
+      net.reset(new Net<Dtype>(net_param));
+    }
+    const vector<Blob<Dtype>*>& params = net->learnable_params();
+    const vector<float>& params_lr = net->params_lr();
+    // Share the weights the solver updates, and keep a gradient buffer of
+    // our own.
+    const size_t size = parallel_->size();
+    Dtype* diff;
+    bool use_cuda;
+    CaffeMallocHost(reinterpret_cast<void**>(&diff), size * sizeof(Dtype),
+                    &use_cuda);
+    caffe_set(size, Dtype(0), diff);
+    size_t offset = 0;
+    for (int i = 0; i < params.size(); ++i) {
+      if (params_lr[i] != 0) {
+        params[i]->data()->set_cpu_data(parallel_->data() + offset);
+      } else {
+        caffe_copy(params[i]->count(), parallel_->data() + offset,
+                   params[i]->mutable_cpu_data());
+      }
+      params[i]->diff()->set_cpu_data(diff + offset);
+      offset += params[i]->count();
+    }
+    const int rank = Caffe::solver_rank();
+    parallel_->diffs_[rank] = diff;
+    boost::barrier* barrier = parallel_->barrier_;
+    // Wait for other replicas
+    barrier->wait();
+    while (true) {
+      // Wait for the solver to start an iteration
+      barrier->wait();
+      if (parallel_->stop_) {
+        break;
+      }
+      net->set_loss_scale(parallel_->solver_->net()->loss_scale());
+      net->ClearParamDiffs();
+      for (int i = 0; i < param.iter_size(); ++i) {
+        net->ForwardBackward();
+      }
+      // Wait for all gradients, reduce our slice, and wait for the others
+      barrier->wait();
+      parallel_->Reduce(rank);
+      barrier->wait();
+    }
+    net.reset();
+    CaffeFreeHost(diff, use_cuda);
+    // Only then may the solver interrupt this thread, which would abort the
+    // joins of the prefetch threads of the net.
+    barrier->wait();
+  }
+
+  CPUParallel<Dtype>* parallel_;
+};
+
+template<typename Dtype>
+CPUParallel<Dtype>::CPUParallel(shared_ptr<Solver<Dtype> > solver)
+  : CPUParams<Dtype>(solver), solver_(solver), barrier_(),
+    diffs_(Caffe::solver_count()), stop_(false) {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU);
+  this->Configure(solver.get());
+  diffs_[0] = diff_;
+}
+
+template<typename Dtype>
+CPUParallel<Dtype>::~CPUParallel() {
+}
+
+template<typename Dtype>
+void CPUParallel<Dtype>::Reduce(int rank) {
+  const int count = diffs_.size();
+  // Slices are rounded to cache lines, so that threads do not share any.
+  const int align = 64 / sizeof(Dtype);
+  const size_t slice = ((size_ + count - 1) / count + align - 1)
+      / align * align;
+  const size_t begin = std::min(rank * slice, size_);
+  const size_t end = std::min(begin + slice, size_);
+  const Dtype scale = Dtype(1) / count;
+  for (size_t offset = begin; offset < end; offset += kReduceBlock) {
+    const int n = std::min<size_t>(kReduceBlock, end - offset);
+    for (int step = 1; step < count; step *= 2) {
+      for (int i = 0; i + step < count; i += 2 * step) {
+        caffe_axpy(n, Dtype(1), diffs_[i + step] + offset,
+                   diffs_[i] + offset);
+      }
+    }
+    caffe_scal(n, scale, diffs_[0] + offset);
+  }
+}
+
+template<typename Dtype>
+void CPUParallel<Dtype>::on_start() {
+  // Starts the other replicas on the weights the solver just updated
+  barrier_->wait();
+}
+
+template<typename Dtype>
+void CPUParallel<Dtype>::on_gradients_ready() {
+  barrier_->wait();
+  Reduce(0);
+  barrier_->wait();
+}
+
+template<typename Dtype>
+void CPUParallel<Dtype>::Run() {
+  const int threads = diffs_.size();
+  boost::barrier barrier(threads);
+  barrier_ = &barrier;
+  stop_ = false;
+  vector<shared_ptr<CPUReplica<Dtype> > > replicas(threads);
+  for (int i = 1; i < threads; ++i) {
+    Caffe::set_solver_rank(i);
+    replicas[i].reset(new CPUReplica<Dtype>(this));
+    replicas[i]->StartInternalThread();
+  }
+  Caffe::set_solver_rank(0);
+  solver_->add_callback(this);
+  // Wait for replicas
+  barrier.wait();
+  solver_->Solve();
+  // Release the replicas waiting for the next iteration, and wait for them
+  // to free their nets
+  stop_ = true;
+  barrier.wait();
+  barrier.wait();
+  for (int i = 1; i < threads; ++i) {
+    replicas[i]->StopInternalThread();
+  }
+  barrier_ = NULL;
+}
+
+template<typename Dtype>
+class HogwildWorker : public InternalThread {
+ public:
+  explicit HogwildWorker(Hogwild<Dtype>* hogwild)
+    : hogwild_(hogwild) {
+  }
+  virtual ~HogwildWorker() {}
+
+ protected:
+  void InternalThreadEntry() {
+    // Only the solver of rank 0 tests.
+    SolverParameter param(hogwild_->solver_->param());
+    param.set_type(hogwild_->solver_->type());
+    param.clear_test_net();
+    param.clear_test_net_param();
+    param.clear_test_iter();
+    param.clear_test_state();
+    param.set_test_interval(0);
+    shared_ptr<Solver<Dtype> > solver;
+    {
+      // Data layers may open libraries that are not thread-safe, e.g. HDF5.
+      static boost::mutex mutex;
+      boost::mutex::scoped_lock lock(mutex);
+      solver.reset(SolverRegistry<Dtype>::CreateSolver(param));
+    }
+    // Update the weights of the other workers, with gradients of our own.
+    const vector<Blob<Dtype>*>& params = solver->net()->learnable_params();
+    const vector<float>& params_lr = solver->net()->params_lr();
+    size_t offset = 0;
+    for (int i = 0; i < params.size(); ++i) {
+      if (params_lr[i] != 0) {
+        params[i]->data()->set_cpu_data(hogwild_->data() + offset);
+      } else {
+        caffe_copy(params[i]->count(), hogwild_->data() + offset,
+                   params[i]->mutable_cpu_data());
+      }
+      offset += params[i]->count();
+    }
+    boost::barrier* barrier = hogwild_->barrier_;
+    // Wait for other workers
+    barrier->wait();
+    while (!hogwild_->stop_ && solver->iter() < param.max_iter()) {
+      solver->Step(1);
+    }
+    hogwild_->iters_[Caffe::solver_rank()] = solver->iter();
+    solver.reset();
+    // Only then may the solver interrupt this thread, which would abort the
+    // joins of the prefetch threads of the net.
+    barrier->wait();
+  }
+
+  Hogwild<Dtype>* hogwild_;
+};
+
+template<typename Dtype>
+Hogwild<Dtype>::Hogwild(shared_ptr<Solver<Dtype> > solver)
+  : CPUParams<Dtype>(solver), solver_(solver), barrier_(), stop_(false) {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU);
+  this->Configure(solver.get());
+}
+
+template<typename Dtype>
+Hogwild<Dtype>::~Hogwild() {
+}
+
+template<typename Dtype>
+void Hogwild<Dtype>::on_start() {
+}
+
+template<typename Dtype>
+void Hogwild<Dtype>::on_gradients_ready() {
+  if (solver_->iter() + 1 >= solver_->param().max_iter()) {
+    StopWorkers();
+  }
+}
+
+template<typename Dtype>
+void Hogwild<Dtype>::StopWorkers() {
+  if (stop_) {
+    return;
+  }
+  stop_ = true;
+  barrier_->wait();
+  for (int i = 1; i < workers_.size(); ++i) {
+    workers_[i]->StopInternalThread();
+  }
+}
+
+template<typename Dtype>
+void Hogwild<Dtype>::Run() {
+  const int threads = Caffe::solver_count();
+  boost::barrier barrier(threads);
+  barrier_ = &barrier;
+  stop_ = false;
+  iters_.assign(threads, 0);
+  workers_.resize(threads);
+  for (int i = 1; i < threads; ++i) {
+    Caffe::set_solver_rank(i);
+    workers_[i].reset(new HogwildWorker<Dtype>(this));
+    workers_[i]->StartInternalThread();
+  }
+  Caffe::set_solver_rank(0);
+  solver_->add_callback(this);
+  // Wait for workers
+  barrier.wait();
+  const int start_iter = solver_->iter();
+  CPUTimer timer;
+  timer.Start();
+  solver_->Solve();
+  StopWorkers();
+  iters_[0] = solver_->iter() - start_iter;
+  int iters = 0;
+  for (int i = 0; i < threads; ++i) {
+    iters += iters_[i];
+  }
+  const float seconds = timer.Seconds();
+  LOG(INFO) << "Hogwild: " << threads << " workers did " << iters
+            << " iterations in " << seconds << " s, "
+            << iters / seconds << " iterations per second.";
+  workers_.clear();
+  barrier_ = NULL;
+}
+
+template<typename Dtype>
+class TCPCommThread : public InternalThread {
+ public:
+  explicit TCPCommThread(TCPComm<Dtype>* comm)
+    : comm_(comm) {
+  }
+  virtual ~TCPCommThread() {}
+
+ protected:
+  void InternalThreadEntry() {
+    try {
+      while (!must_stop()) {
+        typename TCPComm<Dtype>::Bucket* bucket = comm_->pending_.pop();
+        comm_->Reduce(bucket->diff, bucket->count);
+        comm_->reduced_.push(bucket);
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  TCPComm<Dtype>* comm_;
+};
+
+template<typename Dtype>
+TCPComm<Dtype>::TCPComm(shared_ptr<Solver<Dtype> > solver,
+                        const string& rendezvous)
+  : CPUParams<Dtype>(solver), solver_(solver),
+    ring_(new TCPRing(Caffe::solver_rank(), Caffe::solver_count(),
+                      rendezvous)),
+    compressor_(GradientCompressor<Dtype>::Create(
+        solver->param().gradient_compression(), size_)),
+    reduced_bytes_(0),
+    buckets_(solver->net()->layers().size() + 2), num_buckets_(0),
+    backward_passes_(0) {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU);
+  this->Configure(solver.get());
+  Caffe::set_multiprocess(true);
+  if (solver->param().layer_wise_reduce()) {
+    CHECK_EQ(solver->net()->params().size(),
+             solver->net()->learnable_params().size())
+      << "Layer-wise reduce is not supported for nets with shared weights.";
+    CHECK_GT(solver->param().reduce_bucket_size(), 0);
+  }
+}
+
+template<typename Dtype>
+TCPComm<Dtype>::~TCPComm() {
+  if (thread_) {
+    thread_->StopInternalThread();
+  }
+}
+
+template<typename Dtype>
+void TCPComm<Dtype>::Broadcast() {
+  ring_->Broadcast(data_, size_);
+}
+
+template<typename Dtype>
+void TCPComm<Dtype>::Reduce(Dtype* diff, size_t count) {
+  if (compressor_) {
+    const size_t size = compressor_->CompressedSize(count);
+    const int world = ring_->world();
+    gathered_.resize(size * world);
+    char* encoded = &gathered_[ring_->rank() * size];
+    compressor_->Compress(diff, count, diff - diff_, encoded);
+    ring_->AllGather(encoded, size, &gathered_[0]);
+    // Every rank sums the encodings in the same order, to the same result.
+    caffe_set(static_cast<int>(count), Dtype(0), diff);
+    for (int i = 0; i < world; ++i) {
+      compressor_->Accumulate(&gathered_[i * size], count, diff);
+    }
+  } else {
+    ring_->AllReduce(diff, count);
+  }
+  reduced_bytes_ += count * sizeof(Dtype);
+  caffe_scal(static_cast<int>(count), Dtype(1) / Caffe::solver_count(),
+             diff);
+}
+
+template<typename Dtype>
+void TCPComm<Dtype>::Push() {
+  Bucket* bucket = &buckets_[num_buckets_];
+  if (bucket->count > 0) {
+    pending_.push(bucket);
+    ++num_buckets_;
+    buckets_[num_buckets_].diff = NULL;
+    buckets_[num_buckets_].count = 0;
+  }
+}
+
+template<typename Dtype>
+void TCPComm<Dtype>::on_start() {
+  backward_passes_ = 0;
+  num_buckets_ = 0;
+  buckets_[0].diff = NULL;
+  buckets_[0].count = 0;
+}
+
+template<typename Dtype>
+void TCPComm<Dtype>::run(int layer) {
+  CHECK(solver_->param().layer_wise_reduce());
+  // With iter_size, gradients are only reduced once accumulated.
+  if (backward_passes_ == solver_->param().iter_size() - 1) {
+    vector<shared_ptr<Blob<Dtype> > >& blobs =
+      solver_->net()->layers()[layer]->blobs();
+    if (blobs.size() > 0) {
+      size_t count = 0;
+      for (int i = 0; i < blobs.size(); ++i) {
+        count += blobs[i]->count();
+      }
+      Dtype* diff = blobs[0]->mutable_cpu_diff();
+      // Layers come in the reverse order of their gradients in the buffer.
+      if (diff + count != buckets_[num_buckets_].diff) {
+        Push();
+      }
+      buckets_[num_buckets_].diff = diff;
+      buckets_[num_buckets_].count += count;
+      if (buckets_[num_buckets_].count >=
+          solver_->param().reduce_bucket_size()) {
+        Push();
+      }
+    }
+  }
+  if (layer == 0) {
+    ++backward_passes_;
+  }
+}
+
+template<typename Dtype>
+void TCPComm<Dtype>::on_gradients_ready() {
+  if (solver_->param().layer_wise_reduce()) {
+    Push();
+    for (int i = 0; i < num_buckets_; ++i) {
+      reduced_.pop();
+    }
+  } else {
+    Reduce(diff_, size_);
+  }
+}
+
+template<typename Dtype>
+void TCPComm<Dtype>::Run() {
+  Broadcast();
+  solver_->add_callback(this);
+  if (solver_->param().layer_wise_reduce()) {
+    solver_->net()->add_after_backward(this);
+    thread_.reset(new TCPCommThread<Dtype>(this));
+    thread_->StartInternalThread();
+  }
+  const int start_iter = solver_->iter();
+  solver_->Solve();
+  const int iters = std::max(solver_->iter() - start_iter, 1);
+  LOG_IF(INFO, Caffe::root_solver()) << "Sent "
+      << ring_->bytes_sent() / iters << " bytes per iteration to the other "
+      << "processes, reducing " << reduced_bytes_ / iters
+      << " bytes of gradients.";
+}
+
+INSTANTIATE_CLASS(Params);
+INSTANTIATE_CLASS(CPUParams);
+INSTANTIATE_CLASS(CPUReplica);
+INSTANTIATE_CLASS(CPUParallel);
+INSTANTIATE_CLASS(HogwildWorker);
+INSTANTIATE_CLASS(Hogwild);
+INSTANTIATE_CLASS(TCPCommThread);
+INSTANTIATE_CLASS(TCPComm);
+
+#ifdef USE_NCCL
+
 template<typename Dtype>
 GPUParams<Dtype>::GPUParams(shared_ptr<Solver<Dtype> > root_solver, int device)
   : Params<Dtype>(root_solver) {
@@ -361,11 +843,10 @@ void NCCL<Dtype>::Run(const vector<int>& gpus, const char* restore) {
   }
 }
 
-INSTANTIATE_CLASS(Params);
 INSTANTIATE_CLASS(GPUParams);
 INSTANTIATE_CLASS(Worker);
 INSTANTIATE_CLASS(NCCL);
 
-}  // namespace caffe
-
 #endif  // USE_NCCL
+
+}  // namespace caffe
@@ -1,8 +1,11 @@
+#include <boost/thread.hpp>
 #include <cstdio>
 
 #include <string>
 #include <vector>
 
+#include "caffe/internal_thread.hpp"
+#include "caffe/layers/base_data_layer.hpp"
 #include "caffe/solver.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
@@ -11,6 +14,147 @@
 
 namespace caffe {
 
+// Writes the snapshots of a solver from a background thread, one at a time,
+// from a copy of the values to write.
+template <typename Dtype>
+class SnapshotWriter : public InternalThread {
+ public:
+  typedef typename Solver<Dtype>::SnapshotData SnapshotData;
+
+  explicit SnapshotWriter(Solver<Dtype>* solver)
+    : solver_(solver), pending_(false) {
+  }
+  virtual ~SnapshotWriter() {
+    StopInternalThread();
+  }
+
+  // Waits for the previous snapshot to be written, and returns its copy for
+  // the next one.
+  SnapshotData* Acquire() {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (pending_) {
+      condition_.wait(lock);
+    }
+    return &data_;
+  }
+  // Writes the values copied in data_.
+  void Write() {
+    boost::mutex::scoped_lock lock(mutex_);
+    pending_ = true;
+    condition_.notify_all();
+  }
+
+ protected:
+  virtual void InternalThreadEntry() {
+    try {
+      while (true) {
+        {
+          boost::mutex::scoped_lock lock(mutex_);
+          while (!pending_) {
+            condition_.wait(lock);
+          }
+        }
+        solver_->WriteSnapshot(data_);
+        boost::mutex::scoped_lock lock(mutex_);
+        pending_ = false;
+        condition_.notify_all();
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  Solver<Dtype>* solver_;
+  SnapshotData data_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  // Whether data_ is waiting for, or being written
+  bool pending_;
+};
+
+// Runs the test nets of a solver from a background thread, one test at a
+// time, on the weights copied into the test nets.
+template <typename Dtype>
+class AsyncTester : public InternalThread {
+ public:
+  explicit AsyncTester(Solver<Dtype>* solver)
+    : solver_(solver), iter_(0), pending_(false) {
+  }
+  virtual ~AsyncTester() {
+    Wait();
+    StopInternalThread();
+  }
+
+  // Waits for the previous test to be done.
+  void Wait() {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (pending_) {
+      condition_.wait(lock);
+    }
+  }
+  // Tests the nets, holding the weights of iteration iter.
+  void Test(int iter) {
+    boost::mutex::scoped_lock lock(mutex_);
+    iter_ = iter;
+    pending_ = true;
+    condition_.notify_all();
+  }
+
+ protected:
+  virtual void InternalThreadEntry() {
+    try {
+      while (true) {
+        {
+          boost::mutex::scoped_lock lock(mutex_);
+          while (!pending_) {
+            condition_.wait(lock);
+          }
+        }
+        for (int i = 0; i < solver_->test_nets_.size(); ++i) {
+          solver_->RunTest(i, iter_, true);
+        }
+        boost::mutex::scoped_lock lock(mutex_);
+        pending_ = false;
+        condition_.notify_all();
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  Solver<Dtype>* solver_;
+  int iter_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  // Whether the nets are waiting for, or being tested
+  bool pending_;
+};
+
+// Copies the values of the blobs in copies, with the sharing of the params
+// of the net of owners, if not NULL.
+template <typename Dtype>
+static void CopyBlobs(const vector<shared_ptr<Blob<Dtype> > >& blobs,
+    const vector<int>* owners, bool copy_diff,
+    vector<shared_ptr<Blob<Dtype> > >* copies) {
+  copies->resize(blobs.size());
+  for (int i = 0; i < blobs.size(); ++i) {
+    shared_ptr<Blob<Dtype> >& copy = (*copies)[i];
+    if (!copy) {
+      copy.reset(new Blob<Dtype>());
+    }
+    if (owners && (*owners)[i] >= 0) {
+      copy->ReshapeLike(*blobs[i]);
+      copy->ShareData(*(*copies)[(*owners)[i]]);
+      copy->ShareDiff(*(*copies)[(*owners)[i]]);
+      continue;
+    }
+    copy->CopyFrom(*blobs[i], false, true);
+    if (copy_diff) {
+      copy->CopyFrom(*blobs[i], true, true);
+    }
+  }
+}
+
 template<typename Dtype>
 void Solver<Dtype>::SetActionFunction(ActionCallback func) {
   action_request_function_ = func;
@@ -61,6 +205,13 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
 
 template <typename Dtype>
 void Solver<Dtype>::InitTrainNet() {
+  NetParameter net_param;
+  GetTrainNetParam(&net_param);
+  net_.reset(new Net<Dtype>(net_param));
+}
+
+template <typename Dtype>
+void Solver<Dtype>::GetTrainNetParam(NetParameter* net_param) const {
   const int num_train_nets = param_.has_net() + param_.has_net_param() +
       param_.has_train_net() + param_.has_train_net_param();
   const string& field_names = "net, net_param, train_net, train_net_param";
@@ -68,25 +219,24 @@ void Solver<Dtype>::InitTrainNet() {
       << "using one of these fields: " << field_names;
   CHECK_LE(num_train_nets, 1) << "SolverParameter must not contain more than "
       << "one of these fields specifying a train_net: " << field_names;
-  NetParameter net_param;
   if (param_.has_train_net_param()) {
     LOG_IF(INFO, Caffe::root_solver())
         << "Creating training net specified in train_net_param.";
-    net_param.CopyFrom(param_.train_net_param());
+    net_param->CopyFrom(param_.train_net_param());
   } else if (param_.has_train_net()) {
     LOG_IF(INFO, Caffe::root_solver())
         << "Creating training net from train_net file: " << param_.train_net();
-    ReadNetParamsFromTextFileOrDie(param_.train_net(), &net_param);
+    ReadNetParamsFromTextFileOrDie(param_.train_net(), net_param);
   }
   if (param_.has_net_param()) {
     LOG_IF(INFO, Caffe::root_solver())
         << "Creating training net specified in net_param.";
-    net_param.CopyFrom(param_.net_param());
+    net_param->CopyFrom(param_.net_param());
   }
   if (param_.has_net()) {
     LOG_IF(INFO, Caffe::root_solver())
         << "Creating training net from net file: " << param_.net();
-    ReadNetParamsFromTextFileOrDie(param_.net(), &net_param);
+    ReadNetParamsFromTextFileOrDie(param_.net(), net_param);
   }
   // Set the correct NetState.  We start with the solver defaults (lowest
   // precedence); then, merge in any NetState specified by the net_param itself;
@@ -94,10 +244,9 @@ void Solver<Dtype>::InitTrainNet() {
   // precedence).
   NetState net_state;
   net_state.set_phase(TRAIN);
-  net_state.MergeFrom(net_param.state());
+  net_state.MergeFrom(net_param->state());
   net_state.MergeFrom(param_.train_state());
-  net_param.mutable_state()->CopyFrom(net_state);
-  net_.reset(new Net<Dtype>(net_param));
+  net_param->mutable_state()->CopyFrom(net_state);
 }
 
 template <typename Dtype>
@@ -239,6 +388,19 @@ void Solver<Dtype>::Step(int iters) {
               << result_vec[k] << loss_msg_stream.str();
         }
       }
+      // Report and restart the counters of the prefetching data layers, to
+      // show whether the net is waiting for data.
+      const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+      for (int j = 0; j < layers.size(); ++j) {
+        BasePrefetchingDataLayer<Dtype>* data_layer =
+            dynamic_cast<BasePrefetchingDataLayer<Dtype>*>(layers[j].get());
+        if (data_layer) {
+          LOG_IF(INFO, Caffe::root_solver()) << "    Data layer "
+              << layers[j]->layer_param().name() << ": "
+              << data_layer->metrics().Summary();
+          data_layer->metrics().Reset();
+        }
+      }
     }
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_gradients_ready();
@@ -290,6 +452,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  WaitForSnapshot();
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -312,11 +475,30 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   if (param_.test_interval() && iter_ % param_.test_interval() == 0) {
     TestAll();
   }
+  WaitForTest();
   LOG(INFO) << "Optimization Done.";
 }
 
 template <typename Dtype>
 void Solver<Dtype>::TestAll() {
+  if (param_.test_async() && !test_nets_.empty()) {
+    if (!async_tester_) {
+      async_tester_.reset(new AsyncTester<Dtype>(this));
+      async_tester_->StartInternalThread();
+    }
+    CPUTimer timer;
+    timer.Start();
+    async_tester_->Wait();
+    const float waited = timer.MilliSeconds();
+    if (waited >= 1) {
+      LOG(INFO) << "Waited " << waited << " ms for the previous test";
+    }
+    for (int i = 0; i < test_nets_.size(); ++i) {
+      test_nets_[i]->CopyTrainedLayersFrom(net_.get());
+    }
+    async_tester_->Test(iter_);
+    return;
+  }
   for (int test_net_id = 0;
        test_net_id < test_nets_.size() && !requested_early_exit_;
        ++test_net_id) {
@@ -331,12 +513,19 @@ void Solver<Dtype>::Test(const int test_net_id) {
             << ", Testing net (#" << test_net_id << ")";
   CHECK_NOTNULL(test_nets_[test_net_id].get())->
       ShareTrainedLayersWith(net_.get());
+  RunTest(test_net_id, iter_, false);
+}
+
+template <typename Dtype>
+void Solver<Dtype>::RunTest(const int test_net_id, const int iter,
+    const bool async) {
   vector<Dtype> test_score;
   vector<int> test_score_output_id;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
   Dtype loss = 0;
   for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
-    SolverAction::Enum request = GetRequestedAction();
+    SolverAction::Enum request = async ? SolverAction::NONE :
+        GetRequestedAction();
     // Check to see if stoppage of testing/training has been requested.
     while (request != SolverAction::NONE) {
         if (SolverAction::SNAPSHOT == request) {
@@ -346,7 +535,7 @@ void Solver<Dtype>::Test(const int test_net_id) {
         }
         request = GetRequestedAction();
     }
-    if (requested_early_exit_) {
+    if (requested_early_exit_ && !async) {
       // break out of test loop.
       break;
     }
@@ -375,10 +564,15 @@ void Solver<Dtype>::Test(const int test_net_id) {
       }
     }
   }
-  if (requested_early_exit_) {
+  if (requested_early_exit_ && !async) {
     LOG(INFO)     << "Test interrupted.";
     return;
   }
+  if (async) {
+    // Logged with the outputs, for them to follow the iteration in the log.
+    LOG(INFO) << "Iteration " << iter << ", Testing net (#" << test_net_id
+              << ") in the background";
+  }
   if (param_.test_compute_loss()) {
     loss /= param_.test_iter(test_net_id);
     LOG(INFO) << "Test loss: " << loss;
@@ -402,19 +596,65 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  if (!param_.snapshot_async()) {
+    SnapshotData data;
+    data.iter = iter_;
+    data.current_step = current_step_;
+    data.params = net_->params();
+    data.history = SnapshotHistory();
+    WriteSnapshot(data);
+    return;
+  }
+  if (!snapshot_writer_) {
+    snapshot_writer_.reset(new SnapshotWriter<Dtype>(this));
+    snapshot_writer_->StartInternalThread();
+  }
+  // Only the copy of the values is left on the training thread, once the
+  // previous snapshot is written.
+  CPUTimer timer;
+  timer.Start();
+  SnapshotData* data = snapshot_writer_->Acquire();
+  const float waited = timer.MilliSeconds();
+  if (waited >= 1) {
+    LOG(INFO) << "Waited " << waited << " ms for the previous snapshot";
+  }
+  data->iter = iter_;
+  data->current_step = current_step_;
+  CopyBlobs(net_->params(), &net_->param_owners(), param_.snapshot_diff(),
+      &data->params);
+  CopyBlobs(SnapshotHistory(), NULL, false, &data->history);
+  snapshot_writer_->Write();
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForSnapshot() {
+  if (snapshot_writer_) {
+    snapshot_writer_->Acquire();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForTest() {
+  if (async_tester_) {
+    async_tester_->Wait();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteSnapshot(const SnapshotData& data) {
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
-    model_filename = SnapshotToBinaryProto();
+    model_filename = SnapshotToBinaryProto(data);
     break;
   case caffe::SolverParameter_SnapshotFormat_HDF5:
-    model_filename = SnapshotToHDF5();
+    model_filename = SnapshotToHDF5(data);
     break;
   default:
     LOG(FATAL) << "Unsupported snapshot format.";
   }
 
-  SnapshotSolverState(model_filename);
+  SnapshotSolverState(model_filename, data);
 }
 
 template <typename Dtype>
@@ -437,25 +677,39 @@ void Solver<Dtype>::CheckSnapshotWritePermissions() {
 
 template <typename Dtype>
 string Solver<Dtype>::SnapshotFilename(const string extension) {
-  return param_.snapshot_prefix() + "_iter_" + caffe::format_int(iter_)
+  return SnapshotFilename(extension, iter_);
+}
+
+template <typename Dtype>
+string Solver<Dtype>::SnapshotFilename(const string extension, int iter) {
+  return param_.snapshot_prefix() + "_iter_" + caffe::format_int(iter)
     + extension;
 }
 
+// Snapshots are written to a temporary file first, and renamed once on disk,
+// so that a crash never leaves a truncated snapshot.
 template <typename Dtype>
-string Solver<Dtype>::SnapshotToBinaryProto() {
-  string model_filename = SnapshotFilename(".caffemodel");
+string Solver<Dtype>::SnapshotToBinaryProto(const SnapshotData& data) {
+  string model_filename = SnapshotFilename(".caffemodel", data.iter);
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
   NetParameter net_param;
-  net_->ToProto(&net_param, param_.snapshot_diff());
-  WriteProtoToBinaryFile(net_param, model_filename);
+  net_->ToProto(&net_param, param_.snapshot_diff(), data.params);
+  const string temp_filename = model_filename + ".tmp";
+  WriteProtoToBinaryFile(net_param, temp_filename);
+  SyncAndRename(temp_filename, model_filename);
   return model_filename;
 }
 
 template <typename Dtype>
-string Solver<Dtype>::SnapshotToHDF5() {
-  string model_filename = SnapshotFilename(".caffemodel.h5");
+string Solver<Dtype>::SnapshotToHDF5(const SnapshotData& data) {
+  string model_filename = SnapshotFilename(".caffemodel.h5", data.iter);
   LOG(INFO) << "Snapshotting to HDF5 file " << model_filename;
-  net_->ToHDF5(model_filename, param_.snapshot_diff());
+  const string temp_filename = model_filename + ".tmp";
+  {
+    boost::mutex::scoped_lock lock(hdf5_mutex());
+    net_->ToHDF5(temp_filename, param_.snapshot_diff(), data.params);
+  }
+  SyncAndRename(temp_filename, model_filename);
   return model_filename;
 }
 
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -106,6 +107,27 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::FusedUpdateValues(const FusedParam& param,
+    int begin, int end) {
+  const Dtype delta = this->param_.delta();
+  const Dtype momentum = this->param_.momentum();
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = this->FusedGradient(param, i);
+    // history of gradients, then of updates
+    const Dtype history = momentum * param.history[i] +
+        (Dtype(1) - momentum) * (gradient * gradient);
+    param.history[i] = history;
+    const Dtype step = gradient *
+        std::sqrt((delta + param.history2[i]) / (delta + history));
+    param.history2[i] = momentum * param.history2[i] +
+        (Dtype(1) - momentum) * (step * step);
+    const Dtype update = param.rate * step;
+    param.diff[i] = update;
+    param.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -63,6 +64,21 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaGradSolver<Dtype>::FusedUpdateValues(const FusedParam& param,
+    int begin, int end) {
+  const Dtype delta = this->param_.delta();
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = this->FusedGradient(param, i);
+    const Dtype history = param.history[i] + gradient * gradient;
+    param.history[i] = history;
+    const Dtype update =
+        param.rate * (gradient / (std::sqrt(history) + delta));
+    param.diff[i] = update;
+    param.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
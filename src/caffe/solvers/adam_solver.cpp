@@ -88,6 +88,28 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::FusedUpdateValues(const FusedParam& param, int begin,
+    int end) {
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const Dtype eps_hat = this->param_.delta();
+  const int t = this->iter_ + 1;
+  const Dtype corrected_rate = param.rate *
+      std::sqrt(Dtype(1) - pow(beta2, t)) / (Dtype(1.) - pow(beta1, t));
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = this->FusedGradient(param, i);
+    const Dtype m = beta1 * param.history[i] + (Dtype(1) - beta1) * gradient;
+    const Dtype v = beta2 * param.history2[i] +
+        (Dtype(1) - beta2) * (gradient * gradient);
+    param.history[i] = m;
+    param.history2[i] = v;
+    const Dtype update = corrected_rate * (m / (std::sqrt(v) + eps_hat));
+    param.diff[i] = update;
+    param.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
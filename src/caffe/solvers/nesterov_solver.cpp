@@ -55,6 +55,22 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void NesterovSolver<Dtype>::FusedUpdateValues(const FusedParam& param,
+    int begin, int end) {
+  const Dtype momentum = this->param_.momentum();
+  for (int i = begin; i < end; ++i) {
+    const Dtype previous = param.history[i];
+    const Dtype history = momentum * previous +
+        param.rate * this->FusedGradient(param, i);
+    param.history[i] = history;
+    // step back then over step
+    const Dtype update = (Dtype(1) + momentum) * history - momentum * previous;
+    param.diff[i] = update;
+    param.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
@@ -1,3 +1,5 @@
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -75,6 +77,51 @@ void SGDSolver<Dtype>::PreSolve() {
     update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
     temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  CHECK_GT(this->param_.loss_scale(), 0);
+  CHECK_GT(this->param_.loss_scale_window(), 0);
+  this->net_->set_loss_scale(this->param_.loss_scale());
+  loss_scale_iters_ = 0;
+}
+
+template <typename Dtype>
+bool SGDSolver<Dtype>::UnscaleGradients() {
+  const Dtype loss_scale = this->net_->loss_scale();
+  const bool dynamic = this->param_.dynamic_loss_scale();
+  if (loss_scale == 1 && !dynamic) { return true; }
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  Blob<Dtype>* arena = this->net_->learnable_params_arena();
+  if (dynamic) {
+    Dtype sumsq_diff = 0;
+    if (arena) {
+      sumsq_diff = arena->sumsq_diff();
+    } else {
+      for (int i = 0; i < net_params.size(); ++i) {
+        sumsq_diff += net_params[i]->sumsq_diff();
+      }
+    }
+    if (isnan(sumsq_diff) || isinf(sumsq_diff)) {
+      this->net_->set_loss_scale(loss_scale / 2);
+      loss_scale_iters_ = 0;
+      LOG_IF(INFO, Caffe::root_solver()) << "Iteration " << this->iter_
+          << ", gradients overflow, skipping the update; loss scale = "
+          << loss_scale / 2;
+      return false;
+    }
+    // The next Backward takes the new scale.
+    if (++loss_scale_iters_ == this->param_.loss_scale_window()) {
+      this->net_->set_loss_scale(loss_scale * 2);
+      loss_scale_iters_ = 0;
+    }
+  }
+  if (loss_scale == 1) { return true; }
+  if (arena) {
+    arena->scale_diff(1 / loss_scale);
+  } else {
+    for (int i = 0; i < net_params.size(); ++i) {
+      net_params[i]->scale_diff(1 / loss_scale);
+    }
+  }
+  return true;
 }
 
 template <typename Dtype>
@@ -82,9 +129,14 @@ void SGDSolver<Dtype>::ClipGradients() {
   const Dtype clip_gradients = this->param_.clip_gradients();
   if (clip_gradients < 0) { return; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  Blob<Dtype>* arena = this->net_->learnable_params_arena();
   Dtype sumsq_diff = 0;
-  for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+  if (arena) {
+    sumsq_diff = arena->sumsq_diff();
+  } else {
+    for (int i = 0; i < net_params.size(); ++i) {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -92,6 +144,10 @@ void SGDSolver<Dtype>::ClipGradients() {
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
+    if (arena) {
+      arena->scale_diff(scale_factor);
+      return;
+    }
     for (int i = 0; i < net_params.size(); ++i) {
       net_params[i]->scale_diff(scale_factor);
     }
@@ -105,7 +161,12 @@ void SGDSolver<Dtype>::ApplyUpdate() {
     LOG_IF(INFO, Caffe::root_solver()) << "Iteration " << this->iter_
         << ", lr = " << rate;
   }
+  if (!UnscaleGradients()) { return; }
   ClipGradients();
+  if (this->param_.fused_update() && Caffe::mode() == Caffe::CPU) {
+    FusedUpdate(rate);
+    return;
+  }
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
     Normalize(param_id);
@@ -115,6 +176,72 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   this->net_->Update();
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedUpdate(Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const vector<float>& net_params_lr = this->net_->params_lr();
+  const vector<float>& net_params_weight_decay =
+      this->net_->params_weight_decay();
+  const string& regularization_type = this->param_.regularization_type();
+  CHECK(regularization_type == "L2" || regularization_type == "L1")
+      << "Unknown regularization type: " << regularization_type;
+  const bool l1 = regularization_type == "L1";
+  // The pointers are taken here, as SyncedMemory is not thread-safe.
+  fused_params_.resize(net_params.size());
+  size_t count = 0;
+  for (int i = 0; i < net_params.size(); ++i) {
+    FusedParam& param = fused_params_[i];
+    param.count = net_params[i]->count();
+    param.data = net_params[i]->mutable_cpu_data();
+    param.diff = net_params[i]->mutable_cpu_diff();
+    param.history = history_[i]->mutable_cpu_data();
+    param.history2 = history_.size() > net_params.size() ?
+        history_[i + net_params.size()]->mutable_cpu_data() : NULL;
+    param.normalization = Dtype(1) / this->param_.iter_size();
+    const Dtype local_decay =
+        this->param_.weight_decay() * net_params_weight_decay[i];
+    param.l1_decay = l1 ? local_decay : Dtype(0);
+    param.l2_decay = l1 ? Dtype(0) : local_decay;
+    param.rate = rate * net_params_lr[i];
+    count += param.count;
+  }
+  const int threads = std::max(1, this->param_.update_threads());
+  boost::thread_group group;
+  for (int t = 1; t < threads; ++t) {
+    group.create_thread(boost::bind(&SGDSolver<Dtype>::FusedUpdateRange,
+        this, count * t / threads, count * (t + 1) / threads));
+  }
+  FusedUpdateRange(0, count / threads);
+  group.join_all();
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedUpdateRange(size_t begin, size_t end) {
+  size_t offset = 0;
+  for (int i = 0; i < fused_params_.size() && offset < end; ++i) {
+    const FusedParam& param = fused_params_[i];
+    const size_t first = std::max(begin, offset);
+    const size_t last = std::min(end, offset + param.count);
+    if (first < last) {
+      FusedUpdateValues(param, first - offset, last - offset);
+    }
+    offset += param.count;
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedUpdateValues(const FusedParam& param, int begin,
+    int end) {
+  const Dtype momentum = this->param_.momentum();
+  for (int i = begin; i < end; ++i) {
+    const Dtype update = momentum * param.history[i] +
+        param.rate * this->FusedGradient(param, i);
+    param.history[i] = update;
+    param.diff[i] = update;
+    param.data[i] -= update;
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -243,13 +370,14 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
+void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename,
+    const SnapshotData& data) {
   switch (this->param_.snapshot_format()) {
     case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
-      SnapshotSolverStateToBinaryProto(model_filename);
+      SnapshotSolverStateToBinaryProto(model_filename, data);
       break;
     case caffe::SolverParameter_SnapshotFormat_HDF5:
-      SnapshotSolverStateToHDF5(model_filename);
+      SnapshotSolverStateToHDF5(model_filename, data);
       break;
     default:
       LOG(FATAL) << "Unsupported snapshot format.";
@@ -258,47 +386,55 @@ void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
 
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
-    const string& model_filename) {
+    const string& model_filename, const SnapshotData& data) {
   SolverState state;
-  state.set_iter(this->iter_);
+  state.set_iter(data.iter);
   state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
+  state.set_current_step(data.current_step);
   state.clear_history();
-  for (int i = 0; i < history_.size(); ++i) {
+  for (int i = 0; i < data.history.size(); ++i) {
     // Add history
     BlobProto* history_blob = state.add_history();
-    history_[i]->ToProto(history_blob);
+    data.history[i]->ToProto(history_blob);
   }
-  string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
+  string snapshot_filename =
+      Solver<Dtype>::SnapshotFilename(".solverstate", data.iter);
   LOG(INFO)
     << "Snapshotting solver state to binary proto file " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+  const string temp_filename = snapshot_filename + ".tmp";
+  WriteProtoToBinaryFile(state, temp_filename);
+  SyncAndRename(temp_filename, snapshot_filename);
 }
 
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
-    const string& model_filename) {
+    const string& model_filename, const SnapshotData& data) {
   string snapshot_filename =
-      Solver<Dtype>::SnapshotFilename(".solverstate.h5");
+      Solver<Dtype>::SnapshotFilename(".solverstate.h5", data.iter);
   LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
-  hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
-      H5P_DEFAULT, H5P_DEFAULT);
-  CHECK_GE(file_hid, 0)
-      << "Couldn't open " << snapshot_filename << " to save solver state.";
-  hdf5_save_int(file_hid, "iter", this->iter_);
-  hdf5_save_string(file_hid, "learned_net", model_filename);
-  hdf5_save_int(file_hid, "current_step", this->current_step_);
-  hid_t history_hid = H5Gcreate2(file_hid, "history", H5P_DEFAULT, H5P_DEFAULT,
-      H5P_DEFAULT);
-  CHECK_GE(history_hid, 0)
-      << "Error saving solver state to " << snapshot_filename << ".";
-  for (int i = 0; i < history_.size(); ++i) {
-    ostringstream oss;
-    oss << i;
-    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history_[i]);
+  const string temp_filename = snapshot_filename + ".tmp";
+  {
+    boost::mutex::scoped_lock lock(hdf5_mutex());
+    hid_t file_hid = H5Fcreate(temp_filename.c_str(), H5F_ACC_TRUNC,
+        H5P_DEFAULT, H5P_DEFAULT);
+    CHECK_GE(file_hid, 0)
+        << "Couldn't open " << temp_filename << " to save solver state.";
+    hdf5_save_int(file_hid, "iter", data.iter);
+    hdf5_save_string(file_hid, "learned_net", model_filename);
+    hdf5_save_int(file_hid, "current_step", data.current_step);
+    hid_t history_hid = H5Gcreate2(file_hid, "history", H5P_DEFAULT,
+        H5P_DEFAULT, H5P_DEFAULT);
+    CHECK_GE(history_hid, 0)
+        << "Error saving solver state to " << temp_filename << ".";
+    for (int i = 0; i < data.history.size(); ++i) {
+      ostringstream oss;
+      oss << i;
+      hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *data.history[i]);
+    }
+    H5Gclose(history_hid);
+    H5Fclose(file_hid);
   }
-  H5Gclose(history_hid);
-  H5Fclose(file_hid);
+  SyncAndRename(temp_filename, snapshot_filename);
 }
 
 template <typename Dtype>
@@ -107,6 +107,26 @@ void SyncedMemory::set_cpu_data(void* data) {
   own_cpu_data_ = false;
 }
 
+void SyncedMemory::release() {
+  check_device();
+  if ((cpu_ptr_ && !own_cpu_data_) || (gpu_ptr_ && !own_gpu_data_)) {
+    return;
+  }
+  if (cpu_ptr_) {
+    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    cpu_ptr_ = NULL;
+    own_cpu_data_ = false;
+  }
+#ifndef CPU_ONLY
+  if (gpu_ptr_) {
+    CUDA_CHECK(cudaFree(gpu_ptr_));
+    gpu_ptr_ = NULL;
+    own_gpu_data_ = false;
+  }
+#endif  // CPU_ONLY
+  head_ = UNINITIALIZED;
+}
+
 const void* SyncedMemory::gpu_data() {
   check_device();
 #ifndef CPU_ONLY
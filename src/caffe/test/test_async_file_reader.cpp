@@ -0,0 +1,84 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/async_file_reader.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class AsyncFileReaderTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    MakeTempDir(&dir_);
+    // Files of different sizes, including an empty one and one larger than
+    // a typical read.
+    for (int i = 0; i < 10; ++i) {
+      const string filename = dir_ + "/" + format_int(i);
+      contents_[filename] = string(i == 9 ? (3 << 20) : i * 100,
+          static_cast<char>('a' + i));
+      std::ofstream file(filename.c_str(), std::ios::binary);
+      file << contents_[filename];
+    }
+  }
+
+  void TestRead(int depth) {
+    AsyncFileReader reader(depth);
+    std::map<uint64_t, string> filenames;
+    uint64_t id = 0;
+    for (std::map<string, string>::const_iterator it = contents_.begin();
+         it != contents_.end(); ++it) {
+      filenames[id] = it->first;
+      reader.Submit(id++, it->first);
+    }
+    filenames[id] = dir_ + "/missing";
+    reader.Submit(id++, dir_ + "/missing");
+    EXPECT_EQ(static_cast<int>(id), reader.pending());
+    std::map<uint64_t, bool> seen;
+    while (reader.pending() > 0) {
+      string data;
+      bool ok;
+      const uint64_t done = reader.WaitAny(&data, &ok);
+      ASSERT_TRUE(filenames.count(done));
+      EXPECT_FALSE(seen[done]);
+      seen[done] = true;
+      if (contents_.count(filenames[done])) {
+        EXPECT_TRUE(ok);
+        EXPECT_EQ(contents_[filenames[done]], data);
+      } else {
+        EXPECT_FALSE(ok);
+      }
+    }
+    EXPECT_EQ(id, seen.size());
+  }
+
+  string dir_;
+  std::map<string, string> contents_;
+};
+
+TEST_F(AsyncFileReaderTest, TestRead) {
+  TestRead(16);
+}
+
+TEST_F(AsyncFileReaderTest, TestReadMoreThanDepth) {
+  TestRead(2);
+}
+
+TEST_F(AsyncFileReaderTest, TestDestroyWithPendingReads) {
+  AsyncFileReader reader(2);
+  for (std::map<string, string>::const_iterator it = contents_.begin();
+       it != contents_.end(); ++it) {
+    reader.Submit(0, it->first);
+  }
+  string data;
+  bool ok;
+  reader.WaitAny(&data, &ok);
+  EXPECT_TRUE(ok);
+}
+
+}  // namespace caffe
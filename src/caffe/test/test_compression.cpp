@@ -0,0 +1,104 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/compression.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CompressionTest : public ::testing::Test {
+ protected:
+  CompressionTest() {
+    compressions_.push_back(Datum::LZ4);
+    compressions_.push_back(Datum::ZSTD);
+  }
+
+  void FillDatum(bool is_float, Datum* datum) {
+    datum->set_channels(3);
+    datum->set_height(8);
+    datum->set_width(6);
+    datum->set_label(5);
+    const int count = 3 * 8 * 6;
+    for (int i = 0; i < count; ++i) {
+      // Repetitive enough to compress.
+      if (is_float) {
+        datum->add_float_data((i % 7) * 0.5);
+      } else {
+        datum->mutable_data()->push_back(static_cast<char>(i % 7));
+      }
+    }
+  }
+
+  vector<Datum_Compression> compressions_;
+};
+
+TEST_F(CompressionTest, TestRoundTrip) {
+  for (int c = 0; c < compressions_.size(); ++c) {
+    if (!CompressionAvailable(compressions_[c])) {
+      continue;
+    }
+    for (int is_float = 0; is_float < 2; ++is_float) {
+      Datum datum;
+      FillDatum(is_float, &datum);
+      Datum compressed = datum;
+      EXPECT_TRUE(CompressDatum(compressions_[c], 0, &compressed));
+      EXPECT_EQ(compressions_[c], compressed.compression());
+      EXPECT_EQ(0, compressed.float_data_size());
+      EXPECT_LT(compressed.data().size(), datum.SerializeAsString().size());
+      // Already compressed.
+      EXPECT_FALSE(CompressDatum(compressions_[c], 0, &compressed));
+      Datum uncompressed;
+      DecompressDatum(compressed, &uncompressed);
+      EXPECT_EQ(datum.SerializeAsString(), uncompressed.SerializeAsString());
+      EXPECT_TRUE(DecompressDatum(&compressed));
+      EXPECT_EQ(datum.SerializeAsString(), compressed.SerializeAsString());
+      EXPECT_FALSE(DecompressDatum(&compressed));
+    }
+  }
+}
+
+TEST_F(CompressionTest, TestNotCompressed) {
+  Datum datum;
+  FillDatum(false, &datum);
+  const string original = datum.SerializeAsString();
+  EXPECT_FALSE(CompressDatum(Datum::NONE, 0, &datum));
+  datum.set_encoded(true);
+  EXPECT_FALSE(CompressDatum(Datum::ZSTD, 0, &datum));
+  datum.clear_encoded();
+  EXPECT_EQ(original, datum.SerializeAsString());
+}
+
+TEST_F(CompressionTest, TestTransform) {
+  TransformationParameter transform_param;
+  transform_param.set_scale(0.5);
+  DataTransformer<float> transformer(transform_param, TEST);
+  for (int c = 0; c < compressions_.size(); ++c) {
+    if (!CompressionAvailable(compressions_[c])) {
+      continue;
+    }
+    for (int is_float = 0; is_float < 2; ++is_float) {
+      Datum datum;
+      FillDatum(is_float, &datum);
+      Datum compressed = datum;
+      CompressDatum(compressions_[c], 0, &compressed);
+      EXPECT_EQ(transformer.InferBlobShape(datum),
+          transformer.InferBlobShape(compressed));
+      Blob<float> expected(transformer.InferBlobShape(datum));
+      Blob<float> blob(transformer.InferBlobShape(compressed));
+      transformer.Transform(datum, &expected);
+      transformer.Transform(compressed, &blob);
+      for (int i = 0; i < blob.count(); ++i) {
+        EXPECT_EQ(expected.cpu_data()[i], blob.cpu_data()[i]);
+      }
+    }
+  }
+}
+
+}  // namespace caffe
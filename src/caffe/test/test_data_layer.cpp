@@ -41,20 +41,27 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
   // all images are the same; else each image is unique but all pixels within
   // an image are the same.
   void Fill(const bool unique_pixels, DataParameter_DB backend) {
+    FillShard(unique_pixels, backend, *filename_, 0);
+  }
+
+  // Fill the DB at path with num datums labeled first_label,
+  // first_label + 1...
+  void FillShard(const bool unique_pixels, DataParameter_DB backend,
+      const string& path, const int first_label, const int num = 5) {
     backend_ = backend;
-    LOG(INFO) << "Using temporary dataset " << *filename_;
+    LOG(INFO) << "Using temporary dataset " << path;
     scoped_ptr<db::DB> db(db::GetDB(backend));
-    db->Open(*filename_, db::NEW);
+    db->Open(path, db::NEW);
     scoped_ptr<db::Transaction> txn(db->NewTransaction());
-    for (int i = 0; i < 5; ++i) {
+    for (int i = 0; i < num; ++i) {
       Datum datum;
-      datum.set_label(i);
+      datum.set_label(first_label + i);
       datum.set_channels(2);
       datum.set_height(3);
       datum.set_width(4);
       std::string* data = datum.mutable_data();
       for (int j = 0; j < 24; ++j) {
-        int datum = unique_pixels ? j : i;
+        int datum = unique_pixels ? j : first_label + i;
         data->push_back(static_cast<uint8_t>(datum));
       }
       stringstream ss;
@@ -131,6 +138,114 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     Caffe::set_solver_rank(0);
   }
 
+  void TestReadEcho() {
+    const int num = 50;
+    FillShard(false, backend_, *filename_, 0, num);
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    const int batch_size = 5;
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_echo(3);
+    data_param->set_echo_buffer(batch_size);
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(3, layer.echo_factor());
+    vector<int> count(num);
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        ASSERT_LT(label, num);
+        ++count[label];
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(label, blob_top_data_->cpu_data()[i * 24 + j]);
+        }
+      }
+    }
+    // Records leave the buffer after 3 emissions, so the 50 emissions come
+    // from at most 50 / 3 + 5 records read in order.
+    int echoed = 0;
+    for (int label = 0; label < num; ++label) {
+      EXPECT_LE(count[label], 3);
+      if (label > 20) {
+        EXPECT_EQ(0, count[label]);
+      }
+      echoed += count[label] > 1;
+    }
+    EXPECT_GT(echoed, 0);
+  }
+
+  // Fill num_shards DBs named <filename_>_<shard>, where shard s holds
+  // labels 5 * s to 5 * s + 4.
+  void FillShards(DataParameter_DB backend, const int num_shards) {
+    for (int s = 0; s < num_shards; ++s) {
+      stringstream ss;
+      ss << *filename_ << "_" << s;
+      FillShard(false, backend, ss.str(), 5 * s);
+    }
+  }
+
+  void TestReadShards() {
+    const int num_shards = 3;
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    int batch_size = 5;
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(*filename_ + "_*");
+    data_param->set_backend(backend_);
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    // Every shard is read in order, though shards interleave arbitrarily.
+    vector<int> next_label(num_shards);
+    for (int s = 0; s < num_shards; ++s) {
+      next_label[s] = 5 * s;
+    }
+    for (int iter = 0; iter < 12; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        const int shard = label / 5;
+        ASSERT_LT(shard, num_shards);
+        EXPECT_EQ(next_label[shard], label);
+        next_label[shard] = label % 5 == 4 ? 5 * shard : label + 1;
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(label, blob_top_data_->cpu_data()[i * 24 + j]);
+        }
+      }
+    }
+  }
+
+  void TestSkipShards() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    int batch_size = 5;
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(*filename_ + "_0," + *filename_ + "_1,"
+        + *filename_ + "_2," + *filename_ + "_3");
+    data_param->set_backend(backend_);
+    Caffe::set_solver_count(2);
+    for (int dev = 0; dev < Caffe::solver_count(); ++dev) {
+      Caffe::set_solver_rank(dev);
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      for (int iter = 0; iter < 10; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        for (int i = 0; i < batch_size; ++i) {
+          // Solver dev only reads shards dev and dev + 2.
+          const int shard = blob_top_label_->cpu_data()[i] / 5;
+          EXPECT_EQ(dev, shard % Caffe::solver_count());
+        }
+      }
+    }
+    Caffe::set_solver_count(1);
+    Caffe::set_solver_rank(0);
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -387,6 +502,16 @@ TYPED_TEST(DataLayerTest, TestSkipLevelDB) {
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestReadShardsLevelDB) {
+  this->FillShards(DataParameter_DB_LEVELDB, 3);
+  this->TestReadShards();
+}
+
+TYPED_TEST(DataLayerTest, TestSkipShardsLevelDB) {
+  this->FillShards(DataParameter_DB_LEVELDB, 4);
+  this->TestSkipShards();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -432,6 +557,16 @@ TYPED_TEST(DataLayerTest, TestSkipLMDB) {
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestReadShardsLMDB) {
+  this->FillShards(DataParameter_DB_LMDB, 3);
+  this->TestReadShards();
+}
+
+TYPED_TEST(DataLayerTest, TestSkipShardsLMDB) {
+  this->FillShards(DataParameter_DB_LMDB, 4);
+  this->TestSkipShards();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -465,5 +600,47 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
 }
 
 #endif  // USE_LMDB
+
+TYPED_TEST(DataLayerTest, TestReadPacked) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_PACKED);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestSkipPacked) {
+  this->Fill(false, DataParameter_DB_PACKED);
+  this->TestSkip();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardsPacked) {
+  this->FillShards(DataParameter_DB_PACKED, 3);
+  this->TestReadShards();
+}
+
+TYPED_TEST(DataLayerTest, TestSkipShardsPacked) {
+  this->FillShards(DataParameter_DB_PACKED, 4);
+  this->TestSkipShards();
+}
+
+TYPED_TEST(DataLayerTest, TestReadEchoPacked) {
+  this->backend_ = DataParameter_DB_PACKED;
+  this->TestReadEcho();
+}
+
+TYPED_TEST(DataLayerTest, TestReshapePacked) {
+  this->TestReshape(DataParameter_DB_PACKED);
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTrainPacked) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_PACKED);
+  this->TestReadCrop(TRAIN);
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTestPacked) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_PACKED);
+  this->TestReadCrop(TEST);
+}
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -0,0 +1,57 @@
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/data_metrics.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class DataMetricsTest : public ::testing::Test {};
+
+TEST_F(DataMetricsTest, TestHistogram) {
+  TimeHistogram histogram;
+  EXPECT_EQ(0, histogram.count());
+  EXPECT_EQ(0, histogram.mean());
+  for (int i = 0; i < 9; ++i) {
+    histogram.Add(10);
+  }
+  histogram.Add(1000);
+  EXPECT_EQ(10, histogram.count());
+  EXPECT_EQ(1090, histogram.total());
+  EXPECT_EQ(109, histogram.mean());
+  EXPECT_EQ(1000, histogram.max());
+  // 10 is in the [8, 16) bucket, 1000 in the [512, 1024) one.
+  EXPECT_EQ(16, histogram.Percentile(50));
+  EXPECT_EQ(16, histogram.Percentile(90));
+  EXPECT_EQ(1000, histogram.Percentile(100));
+}
+
+TEST_F(DataMetricsTest, TestCounters) {
+  DataMetrics metrics;
+  metrics.AddStageTime(DataMetrics::READ, 100);
+  metrics.AddStageTime(DataMetrics::TRANSFORM, 200);
+  metrics.AddBatch(8, 5);
+  metrics.AddStageTime(DataMetrics::READ, 300);
+  metrics.AddBatch(8, 0);
+  metrics.AddForward(2, 0);
+  metrics.AddForward(1, 50);
+  DataMetrics::Counters counters = metrics.Get();
+  EXPECT_EQ(2, counters.batches);
+  EXPECT_EQ(16, counters.items);
+  EXPECT_EQ(2, counters.forwards);
+  EXPECT_EQ(1.5, counters.mean_queue_depth());
+  EXPECT_EQ(50, counters.consumer_wait.total());
+  EXPECT_EQ(5, counters.producer_wait.total());
+  EXPECT_EQ(200, counters.stages[DataMetrics::READ].mean());
+  EXPECT_EQ(1, counters.stages[DataMetrics::TRANSFORM].count());
+  EXPECT_EQ(0, counters.stages[DataMetrics::DECODE].count());
+  EXPECT_GE(counters.seconds, 0);
+  metrics.Reset();
+  counters = metrics.Get();
+  EXPECT_EQ(0, counters.batches);
+  EXPECT_EQ(0, counters.forwards);
+  EXPECT_EQ(0, counters.stages[DataMetrics::READ].count());
+}
+
+}  // namespace caffe
@@ -340,5 +340,145 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestRandomResizedCrop) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = false;  // pixels are equal to label
+  const int label = 5;
+  const int channels = 3;
+  const int crop_size = 8;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_crop_min_area(0.2);
+  transform_param.set_crop_max_aspect(1.5);
+  transform_param.set_mirror(true);
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+  EXPECT_TRUE(transformer.batch_transform());
+  // Images larger and smaller than the crop are resized to it.
+  const int sizes[] = {4, 10, 13};
+  for (int i = 0; i < 3; ++i) {
+    Datum datum;
+    FillDatum(label, channels, sizes[i], sizes[i] + 1, unique_pixels, &datum);
+    vector<int> shape = transformer.InferBlobShape(datum);
+    EXPECT_EQ(crop_size, shape[2]);
+    EXPECT_EQ(crop_size, shape[3]);
+    Blob<TypeParam> blob(shape);
+    for (int iter = 0; iter < this->num_iter_; ++iter) {
+      transformer.Transform(datum, &blob);
+      for (int j = 0; j < blob.count(); ++j) {
+        EXPECT_EQ(label, blob.cpu_data()[j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestRandomResizedCropUniquePixels) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = true;  // pixels are consecutive ints [0,size]
+  const int label = 0;
+  const int channels = 1;
+  const int height = 12;
+  const int width = 12;
+  const int crop_size = 6;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_crop_min_area(0.1);
+  Datum datum;
+  FillDatum(label, channels, height, width, unique_pixels, &datum);
+  // Interpolated pixels stay within the image, and crops vary.
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+  Blob<TypeParam> blob(1, channels, crop_size, crop_size);
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.Transform(datum, &blob);
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_GE(blob.cpu_data()[j], 0);
+      EXPECT_LE(blob.cpu_data()[j], height * width - 1);
+    }
+  }
+  const int num_matches = this->NumSequenceMatches(transform_param, datum,
+      TRAIN);
+  EXPECT_LT(num_matches, crop_size * crop_size * this->num_iter_);
+}
+
+TYPED_TEST(DataTransformTest, TestColorJitter) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = false;  // pixels are equal to label
+  const int label = 100;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+  const int num = 8;
+  const int mean_value = 10;
+  const TypeParam scale = 0.5;
+
+  transform_param.set_brightness(0.5);
+  transform_param.set_contrast(0.5);
+  transform_param.set_saturation(0.5);
+  transform_param.add_mean_value(mean_value);
+  transform_param.set_scale(scale);
+  vector<Datum> datums(num);
+  for (int n = 0; n < num; ++n) {
+    FillDatum(label, channels, height, width, unique_pixels, &datums[n]);
+  }
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+  Blob<TypeParam> blob(num, channels, height, width);
+  transformer.Transform(datums, &blob);
+  // Contrast and saturation leave gray images unchanged, brightness scales
+  // each image by its own factor.
+  int num_different = 0;
+  for (int n = 0; n < num; ++n) {
+    const TypeParam* data = blob.cpu_data() + blob.offset(n);
+    EXPECT_GE(data[0], (label * 0.5 - mean_value) * scale - 1e-3);
+    EXPECT_LE(data[0], (label * 1.5 - mean_value) * scale + 1e-3);
+    for (int j = 1; j < channels * height * width; ++j) {
+      EXPECT_NEAR(data[0], data[j], 1e-3);
+    }
+    num_different += data[0] != blob.cpu_data()[0];
+  }
+  EXPECT_GT(num_different, 0);
+
+  // Augmentations only apply in the TRAIN phase.
+  DataTransformer<TypeParam> test_transformer(transform_param, TEST);
+  test_transformer.InitRand();
+  EXPECT_FALSE(test_transformer.batch_transform());
+  test_transformer.Transform(datums, &blob);
+  for (int j = 0; j < blob.count(); ++j) {
+    EXPECT_EQ((label - mean_value) * scale, blob.cpu_data()[j]);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestLighting) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = false;  // pixels are equal to label
+  const int label = 100;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+  const int num = 4;
+  const int size = height * width;
+
+  transform_param.set_lighting_std(0.1);
+  vector<Datum> datums(num);
+  for (int n = 0; n < num; ++n) {
+    FillDatum(label, channels, height, width, unique_pixels, &datums[n]);
+  }
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+  Blob<TypeParam> blob(num, channels, height, width);
+  transformer.Transform(datums, &blob);
+  // Each channel of each image is shifted by its own color.
+  for (int n = 0; n < num; ++n) {
+    const TypeParam* data = blob.cpu_data() + blob.offset(n);
+    EXPECT_NE(data[0], data[size]);
+    for (int c = 0; c < channels; ++c) {
+      for (int j = 1; j < size; ++j) {
+        EXPECT_NEAR(data[c * size], data[c * size + j], 1e-3);
+      }
+    }
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -0,0 +1,73 @@
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/datum_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class DatumCacheTest : public ::testing::Test {
+ protected:
+  // A 1x10x10 Datum filled with value.
+  Datum MakeDatum(const int value) {
+    Datum datum;
+    datum.set_channels(1);
+    datum.set_height(10);
+    datum.set_width(10);
+    datum.set_label(value);
+    datum.set_data(string(100, static_cast<char>(value)));
+    return datum;
+  }
+};
+
+TEST_F(DatumCacheTest, TestGetPut) {
+  DatumCache cache(1 << 20);
+  Datum datum;
+  EXPECT_FALSE(cache.Get("a", &datum));
+  cache.Put("a", MakeDatum(1));
+  cache.Put("b", MakeDatum(2));
+  ASSERT_TRUE(cache.Get("a", &datum));
+  EXPECT_EQ(1, datum.label());
+  EXPECT_EQ(string(100, 1), datum.data());
+  ASSERT_TRUE(cache.Get("b", &datum));
+  EXPECT_EQ(2, datum.label());
+  EXPECT_EQ(2, cache.size());
+  EXPECT_EQ(2, cache.hits());
+  EXPECT_EQ(1, cache.misses());
+  EXPECT_EQ(0, cache.evictions());
+}
+
+TEST_F(DatumCacheTest, TestEvictLeastRecentlyUsed) {
+  Datum datum = MakeDatum(0);
+  // Room for two Datums but not three.
+  DatumCache probe(1 << 20);
+  probe.Put("a", datum);
+  DatumCache cache(probe.size_bytes() * 5 / 2);
+  cache.Put("a", MakeDatum(1));
+  cache.Put("b", MakeDatum(2));
+  // Use a, so that b is the least recently used.
+  EXPECT_TRUE(cache.Get("a", &datum));
+  cache.Put("c", MakeDatum(3));
+  EXPECT_EQ(2, cache.size());
+  EXPECT_EQ(1, cache.evictions());
+  EXPECT_LE(cache.size_bytes(), cache.capacity_bytes());
+  EXPECT_TRUE(cache.Get("a", &datum));
+  EXPECT_FALSE(cache.Get("b", &datum));
+  EXPECT_TRUE(cache.Get("c", &datum));
+  EXPECT_EQ(3, datum.label());
+}
+
+TEST_F(DatumCacheTest, TestTooLarge) {
+  DatumCache cache(50);
+  Datum datum;
+  cache.Put("a", MakeDatum(1));
+  EXPECT_EQ(0, cache.size());
+  EXPECT_EQ(0, cache.size_bytes());
+  EXPECT_FALSE(cache.Get("a", &datum));
+}
+
+}  // namespace caffe
@@ -57,8 +57,13 @@ struct TypeLMDB {
 };
 DataParameter_DB TypeLMDB::backend = DataParameter_DB_LMDB;
 
+struct TypePacked {
+  static DataParameter_DB backend;
+};
+DataParameter_DB TypePacked::backend = DataParameter_DB_PACKED;
+
 // typedef ::testing::Types<TypeLmdb> TestTypes;
-typedef ::testing::Types<TypeLevelDB, TypeLMDB> TestTypes;
+typedef ::testing::Types<TypeLevelDB, TypeLMDB, TypePacked> TestTypes;
 
 TYPED_TEST_CASE(DBTest, TestTypes);
 
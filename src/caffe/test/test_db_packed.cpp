@@ -0,0 +1,115 @@
+#include <string>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/db_packed.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+class PackedDBTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    MakeTempDir(&source_);
+    source_ += "/db";
+    scoped_ptr<db::DB> db(db::GetDB("packed"));
+    db->Open(source_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    // Two commits, the second with a value larger than a read chunk.
+    txn->Put("a", "first");
+    txn->Put("b", "");
+    txn->Commit();
+    txn->Put("c", string(5 << 20, 'x'));
+    txn->Commit();
+  }
+
+  void TestRead(DataParameter::PackedReadMode read_mode) {
+    DataParameter param;
+    param.set_backend(DataParameter_DB_PACKED);
+    param.set_packed_read_mode(read_mode);
+    scoped_ptr<db::DB> db(db::GetDB(param));
+    db->Open(source_, db::READ);
+    scoped_ptr<db::Cursor> cursor(db->NewCursor());
+    for (int pass = 0; pass < 2; ++pass) {
+      ASSERT_TRUE(cursor->valid());
+      EXPECT_EQ("a", cursor->key());
+      EXPECT_EQ("first", cursor->value());
+      cursor->Next();
+      ASSERT_TRUE(cursor->valid());
+      EXPECT_EQ("b", cursor->key());
+      EXPECT_EQ("", cursor->value());
+      cursor->Next();
+      ASSERT_TRUE(cursor->valid());
+      EXPECT_EQ("c", cursor->key());
+      EXPECT_EQ(string(5 << 20, 'x'), cursor->value());
+      cursor->Next();
+      EXPECT_FALSE(cursor->valid());
+      cursor->SeekToFirst();
+    }
+  }
+
+  string source_;
+};
+
+TEST_F(PackedDBTest, TestCrc32c) {
+  // Check value from RFC 3720.
+  EXPECT_EQ(0xE3069283, db::Crc32c("123456789", 9));
+  // Checksums can be extended.
+  EXPECT_EQ(db::Crc32c("123456789", 9),
+      db::Crc32c("6789", 4, db::Crc32c("12345", 5)));
+}
+
+TEST_F(PackedDBTest, TestReadMmap) {
+  this->TestRead(DataParameter_PackedReadMode_MMAP);
+}
+
+TEST_F(PackedDBTest, TestReadStream) {
+  this->TestRead(DataParameter_PackedReadMode_STREAM);
+}
+
+TEST_F(PackedDBTest, TestReadDirect) {
+  this->TestRead(DataParameter_PackedReadMode_DIRECT);
+}
+
+TEST_F(PackedDBTest, TestAppend) {
+  scoped_ptr<db::DB> db(db::GetDB("packed"));
+  db->Open(source_, db::WRITE);
+  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  txn->Put("d", "appended");
+  txn->Commit();
+  db->Close();
+  db->Open(source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  int count = 0;
+  for (; cursor->valid(); cursor->Next()) {
+    ++count;
+    if (count == 4) {
+      EXPECT_EQ("d", cursor->key());
+      EXPECT_EQ("appended", cursor->value());
+    }
+  }
+  EXPECT_EQ(4, count);
+}
+
+TEST_F(PackedDBTest, TestUncommittedPutsAreNotVisible) {
+  scoped_ptr<db::DB> db(db::GetDB("packed"));
+  db->Open(source_, db::WRITE);
+  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  txn->Put("d", "pending");
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  int count = 0;
+  for (; cursor->valid(); cursor->Next()) {
+    ++count;
+  }
+  EXPECT_EQ(3, count);
+}
+
+}  // namespace caffe
@@ -0,0 +1,92 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/gradient_compressor.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class GradientCompressorTest : public ::testing::Test {
+ protected:
+  GradientCompressorTest() : diff_(100) {
+    for (int i = 0; i < diff_.size(); ++i) {
+      // Distinct magnitudes, of both signs
+      diff_[i] = (i % 2 ? -1 : 1) * Dtype(i + 1) / 100;
+    }
+  }
+
+  vector<Dtype> diff_;
+};
+
+TYPED_TEST_CASE(GradientCompressorTest, TestDtypes);
+
+TYPED_TEST(GradientCompressorTest, TestNone) {
+  GradientCompressionParameter param;
+  EXPECT_TRUE(GradientCompressor<TypeParam>::Create(param, 100) == NULL);
+}
+
+TYPED_TEST(GradientCompressorTest, TestTopK) {
+  const vector<TypeParam>& diff = this->diff_;
+  // The net has 110 gradients, the bucket is the last 100.
+  TopKCompressor<TypeParam> compressor(0.1, 110);
+  vector<char> data(compressor.CompressedSize(100));
+  EXPECT_EQ(0, data.size() % 8);
+  compressor.Compress(&diff[0], 100, 10, &data[0]);
+  vector<TypeParam> decoded(100);
+  compressor.Accumulate(&data[0], 100, &decoded[0]);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(i >= 90 ? diff[i] : 0, decoded[i]);
+  }
+  // With no new gradients, the next largest ones come from the residual.
+  vector<TypeParam> zero(100);
+  compressor.Compress(&zero[0], 100, 10, &data[0]);
+  compressor.Accumulate(&data[0], 100, &decoded[0]);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(i >= 80 ? diff[i] : 0, decoded[i]);
+  }
+  // New gradients add to the residual.
+  compressor.Compress(&diff[0], 100, 10, &data[0]);
+  decoded.assign(100, 0);
+  compressor.Accumulate(&data[0], 100, &decoded[0]);
+  for (int i = 0; i < 100; ++i) {
+    // Twice the gradients left, which now exceed the ones just sent
+    const TypeParam expected = i < 70 || i >= 80 ? 0 : 2 * diff[i];
+    EXPECT_NEAR(expected, decoded[i], 1e-6);
+  }
+}
+
+TYPED_TEST(GradientCompressorTest, TestQuantize) {
+  const vector<TypeParam>& diff = this->diff_;
+  GradientCompressionParameter param;
+  param.set_method(GradientCompressionParameter_Method_QUANTIZE_8BIT);
+  shared_ptr<GradientCompressor<TypeParam> > compressor(
+      GradientCompressor<TypeParam>::Create(param, 100));
+  ASSERT_TRUE(compressor.get());
+  vector<char> data(compressor->CompressedSize(100));
+  EXPECT_EQ(0, data.size() % 8);
+  EXPECT_LE(data.size(), sizeof(TypeParam) + 100 + 7);
+  // Each decoded gradient is within a step of the gradient, and exact on
+  // average.
+  const TypeParam step = std::fabs(diff[99]) / 127;
+  const int kRounds = 1000;
+  vector<TypeParam> sum(100);
+  for (int r = 0; r < kRounds; ++r) {
+    compressor->Compress(&diff[0], 100, 0, &data[0]);
+    vector<TypeParam> decoded(100);
+    compressor->Accumulate(&data[0], 100, &decoded[0]);
+    for (int i = 0; i < 100; ++i) {
+      EXPECT_LE(std::fabs(decoded[i] - diff[i]), step * 1.0001);
+      sum[i] += decoded[i];
+    }
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_NEAR(diff[i], sum[i] / kRounds, step / 10);
+  }
+}
+
+}  // namespace caffe
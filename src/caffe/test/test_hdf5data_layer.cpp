@@ -1,3 +1,4 @@
+#include <set>
 #include <string>
 #include <vector>
 
@@ -85,8 +86,6 @@ TYPED_TEST(HDF5DataLayerTest, TestRead) {
   EXPECT_EQ(this->blob_top_label2_->shape(0), batch_size);
   EXPECT_EQ(this->blob_top_label2_->shape(1), 1);
 
-  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
-
   // Go through the data 10 times (5 batches).
   const int data_size = num_cols * height * width;
   for (int iter = 0; iter < 10; ++iter) {
@@ -132,6 +131,85 @@ TYPED_TEST(HDF5DataLayerTest, TestRead) {
   }
 }
 
+TYPED_TEST(HDF5DataLayerTest, TestReadChunked) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+
+  // Chunks of 3 rows do not divide the 10 rows of each file.
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_chunk_size(3);
+  hdf5_data_param->set_source(*(this->filename));
+  const int data_size = 8 * 6 * 5;
+
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int iter = 0; iter < 10; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    int row_offset = (iter % 2 == 0) ? 0 : batch_size;
+    int file_offset = (iter % 4 < 2) ? 0 : 2400;
+    for (int i = 0; i < batch_size; ++i) {
+      EXPECT_EQ(1 + row_offset + i, this->blob_top_label_->cpu_data()[i]);
+      EXPECT_EQ(2 + row_offset + i, this->blob_top_label2_->cpu_data()[i]);
+      for (int j = 0; j < data_size; ++j) {
+        EXPECT_EQ(file_offset + (row_offset + i) * data_size + j,
+            this->blob_top_data_->cpu_data()[i * data_size + j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestShuffle) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  int batch_size = 5;
+  int buffer_size = 4;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_chunk_size(3);
+  hdf5_data_param->set_shuffle(true);
+  hdf5_data_param->set_shuffle_buffer_size(buffer_size);
+  hdf5_data_param->set_source(*(this->filename));
+  const int data_size = 8 * 6 * 5;
+  const int file_rows = 10;
+
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Rows are unique, and drawn from the rows read so far, within the first
+  // pass over the two files. The first row comes from the first file.
+  int first_file_offset = -1;
+  std::set<int> rows_seen;
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < batch_size; ++i) {
+      const Dtype* data = this->blob_top_data_->cpu_data() + i * data_size;
+      const int file_offset = data[0] >= 2400 ? 2400 : 0;
+      const int row = (static_cast<int>(data[0]) - file_offset) / data_size;
+      if (first_file_offset < 0) {
+        first_file_offset = file_offset;
+      }
+      // The tops stay aligned.
+      EXPECT_EQ(1 + row, this->blob_top_label_->cpu_data()[i]);
+      EXPECT_EQ(2 + row, this->blob_top_label2_->cpu_data()[i]);
+      for (int j = 0; j < data_size; ++j) {
+        EXPECT_EQ(file_offset + row * data_size + j, data[j]);
+      }
+      const int position =
+          (file_offset == first_file_offset ? 0 : file_rows) + row;
+      EXPECT_LT(position, iter * batch_size + i + buffer_size);
+      EXPECT_TRUE(rows_seen.insert(position).second);
+    }
+  }
+}
+
 TYPED_TEST(HDF5DataLayerTest, TestSkip) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
@@ -186,6 +186,38 @@ TYPED_TEST(ImageDataLayerTest, TestShuffle) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestReadAsync) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  // Batches of 3 of the 5 images cross the end of the epoch.
+  image_data_param->set_batch_size(3);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_shuffle(false);
+  vector<vector<Dtype> > data;
+  for (int io_depth = 0; io_depth <= 2; io_depth += 2) {
+    image_data_param->set_io_depth(io_depth);
+    ImageDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int iter = 0; iter < 4; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ((iter * 3 + i) % 5, this->blob_top_label_->cpu_data()[i]);
+      }
+      const Dtype* top_data = this->blob_top_data_->cpu_data();
+      if (io_depth == 0) {
+        data.push_back(vector<Dtype>(top_data,
+            top_data + this->blob_top_data_->count()));
+      } else {
+        // Images read asynchronously are the same as those read in turn.
+        for (int j = 0; j < this->blob_top_data_->count(); ++j) {
+          EXPECT_EQ(data[iter][j], top_data[j]);
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestSpace) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
@@ -0,0 +1,174 @@
+#ifdef USE_LIBPNG
+#include <png.h>
+#endif  // USE_LIBPNG
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_decode.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ImageDecodeTest : public ::testing::Test {
+ protected:
+  // Decodes the whole image, and regions of it, which should match.
+  void CheckRegions(const string& image, int channels, int min_size) {
+    int height, width, decoded_channels;
+    ASSERT_TRUE(DecodedImageShape(image.data(), image.size(), channels,
+        min_size, min_size, &height, &width, &decoded_channels));
+    vector<unsigned char> full(height * width * decoded_channels);
+    ASSERT_TRUE(DecodeImageRegion(image.data(), image.size(), channels,
+        min_size, min_size, 0, 0, height, width, &full[0]));
+    const int regions[][4] = {
+      {0, 0, 1, 1},
+      {height - 7, width - 5, 7, 5},
+      {height / 3, width / 4, height / 2, width / 3},
+      {17, 9, 31, 29},
+      {0, 1, height, width - 2},
+    };
+    for (int r = 0; r < sizeof(regions) / sizeof(regions[0]); ++r) {
+      const int y = regions[r][0];
+      const int x = regions[r][1];
+      const int region_height = regions[r][2];
+      const int region_width = regions[r][3];
+      vector<unsigned char> region(
+          region_height * region_width * decoded_channels);
+      ASSERT_TRUE(DecodeImageRegion(image.data(), image.size(), channels,
+          min_size, min_size, y, x, region_height, region_width,
+          &region[0]));
+      int mismatches = 0;
+      for (int h = 0; h < region_height; ++h) {
+        for (int w = 0; w < region_width * decoded_channels; ++w) {
+          mismatches += region[h * region_width * decoded_channels + w] !=
+              full[((y + h) * width + x) * decoded_channels + w];
+        }
+      }
+      EXPECT_EQ(0, mismatches) << "Region " << region_width << "x"
+          << region_height << "+" << x << "+" << y;
+    }
+  }
+};
+
+TEST_F(ImageDecodeTest, TestJPEGScaleDenom) {
+  EXPECT_EQ(2, JPEGScaleDenom(360, 480, 100, 100));
+  EXPECT_EQ(4, JPEGScaleDenom(360, 480, 90, 50));
+  EXPECT_EQ(8, JPEGScaleDenom(360, 480, 45, 45));
+  EXPECT_EQ(1, JPEGScaleDenom(360, 480, 256, 256));
+}
+
+TEST_F(ImageDecodeTest, TestUnsupported) {
+  const string data = "not an image";
+  int height, width, channels;
+  EXPECT_FALSE(DecodedImageShape(data.data(), data.size(), 3, 0, 0, &height,
+      &width, &channels));
+  unsigned char pixel[3];
+  EXPECT_FALSE(DecodeImageRegion(data.data(), data.size(), 3, 0, 0, 0, 0, 1,
+      1, pixel));
+}
+
+#ifdef USE_LIBJPEG_TURBO
+TEST_F(ImageDecodeTest, TestJPEGShape) {
+  string image;
+  ASSERT_TRUE(ReadFileToString(EXAMPLES_SOURCE_DIR "images/cat.jpg",
+      &image));
+  int height, width, channels;
+  ASSERT_TRUE(DecodedImageShape(image.data(), image.size(), 3, 0, 0,
+      &height, &width, &channels));
+  EXPECT_EQ(360, height);
+  EXPECT_EQ(480, width);
+  EXPECT_EQ(3, channels);
+  ASSERT_TRUE(DecodedImageShape(image.data(), image.size(), 1, 0, 0,
+      &height, &width, &channels));
+  EXPECT_EQ(1, channels);
+  ASSERT_TRUE(DecodedImageShape(image.data(), image.size(), 0, 100, 100,
+      &height, &width, &channels));
+  EXPECT_EQ(180, height);
+  EXPECT_EQ(240, width);
+  EXPECT_EQ(3, channels);
+}
+
+TEST_F(ImageDecodeTest, TestJPEGRegion) {
+  // The chroma of fish-bike.jpg is subsampled, and upsampled at the edges
+  // of the regions.
+  const char* files[] = {"images/cat.jpg", "images/fish-bike.jpg"};
+  for (int i = 0; i < 2; ++i) {
+    string image;
+    ASSERT_TRUE(ReadFileToString(string(EXAMPLES_SOURCE_DIR) + files[i],
+        &image));
+    this->CheckRegions(image, 3, 0);
+    this->CheckRegions(image, 1, 0);
+    this->CheckRegions(image, 0, 100);
+  }
+}
+#endif  // USE_LIBJPEG_TURBO
+
+#ifdef USE_LIBPNG
+TEST_F(ImageDecodeTest, TestPNGRegion) {
+  const int height = 64;
+  const int width = 48;
+  vector<unsigned char> rgb(height * width * 3);
+  for (int i = 0; i < rgb.size(); ++i) {
+    rgb[i] = (i * 37) % 251;
+  }
+  png_image png;
+  memset(&png, 0, sizeof(png));
+  png.version = PNG_IMAGE_VERSION;
+  png.width = width;
+  png.height = height;
+  png.format = PNG_FORMAT_RGB;
+  png_alloc_size_t size = 0;
+  ASSERT_TRUE(png_image_write_to_memory(&png, NULL, &size, 0, &rgb[0], 0,
+      NULL));
+  string image(size, 0);
+  ASSERT_TRUE(png_image_write_to_memory(&png, &image[0], &size, 0, &rgb[0],
+      0, NULL));
+
+  int decoded_height, decoded_width, channels;
+  ASSERT_TRUE(DecodedImageShape(image.data(), image.size(), 0, 10, 10,
+      &decoded_height, &decoded_width, &channels));
+  EXPECT_EQ(height, decoded_height);
+  EXPECT_EQ(width, decoded_width);
+  EXPECT_EQ(3, channels);
+  vector<unsigned char> region(20 * 10 * 3);
+  ASSERT_TRUE(DecodeImageRegion(image.data(), image.size(), 3, 0, 0, 21, 13,
+      20, 10, &region[0]));
+  for (int h = 0; h < 20; ++h) {
+    for (int w = 0; w < 10; ++w) {
+      for (int c = 0; c < 3; ++c) {
+        // Decoded in BGR.
+        EXPECT_EQ(rgb[((21 + h) * width + 13 + w) * 3 + 2 - c],
+            region[(h * 10 + w) * 3 + c]);
+      }
+    }
+  }
+  this->CheckRegions(image, 1, 0);
+}
+
+TEST_F(ImageDecodeTest, TestPNGAlphaUnsupported) {
+  vector<unsigned char> rgba(4 * 4 * 4, 128);
+  png_image png;
+  memset(&png, 0, sizeof(png));
+  png.version = PNG_IMAGE_VERSION;
+  png.width = 4;
+  png.height = 4;
+  png.format = PNG_FORMAT_RGBA;
+  png_alloc_size_t size = 0;
+  ASSERT_TRUE(png_image_write_to_memory(&png, NULL, &size, 0, &rgba[0], 0,
+      NULL));
+  string image(size, 0);
+  ASSERT_TRUE(png_image_write_to_memory(&png, &image[0], &size, 0, &rgba[0],
+      0, NULL));
+  int height, width, channels;
+  EXPECT_FALSE(DecodedImageShape(image.data(), image.size(), 3, 0, 0,
+      &height, &width, &channels));
+}
+#endif  // USE_LIBPNG
+
+}  // namespace caffe
@@ -420,5 +420,59 @@ TEST_F(IOTest, TestDecodeDatumToCVMatContentNative) {
   }
 }
 
+// JPEGs are decoded in the DCT domain at the largest reduction that keeps
+// both sides at least as large as requested (requires OpenCV 3.2).
+#if CV_MAJOR_VERSION > 3 || (CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 2)
+#define REDUCED(full, denom) (((full) + (denom) - 1) / (denom))
+#else
+#define REDUCED(full, denom) (full)
+#endif
+
+TEST_F(IOTest, TestReadImageToCVMatAtLeast) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  cv::Mat cv_img = ReadImageToCVMatAtLeast(filename, 100, 100, true);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, REDUCED(360, 2));
+  EXPECT_EQ(cv_img.cols, REDUCED(480, 2));
+  cv_img = ReadImageToCVMatAtLeast(filename, 0, 0, true);
+  EXPECT_EQ(cv_img.rows, 360);
+  EXPECT_EQ(cv_img.cols, 480);
+  cv_img = ReadImageToCVMatAtLeast(filename, 200, 100, true);
+  EXPECT_EQ(cv_img.rows, 360);
+  EXPECT_EQ(cv_img.cols, 480);
+}
+
+TEST_F(IOTest, TestReadImageToCVMatResizedReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  cv::Mat cv_img = ReadImageToCVMat(filename, 40, 50);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 40);
+  EXPECT_EQ(cv_img.cols, 50);
+}
+
+TEST_F(IOTest, TestDecodeDatumToCVMatReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  Datum datum;
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum));
+  cv::Mat cv_img = DecodeDatumToCVMat(datum, true, 40, 40);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, REDUCED(360, 8));
+  EXPECT_EQ(cv_img.cols, REDUCED(480, 8));
+  cv_img = DecodeDatumToCVMat(datum, false, 60, 60);
+  EXPECT_EQ(cv_img.channels(), 1);
+  EXPECT_EQ(cv_img.rows, REDUCED(360, 4));
+  EXPECT_EQ(cv_img.cols, REDUCED(480, 4));
+}
+
+TEST_F(IOTest, TestDecodeDatumToCVMatNativeGrayReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat_gray.jpg";
+  Datum datum;
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum));
+  cv::Mat cv_img = DecodeDatumToCVMatNative(datum, 40, 40);
+  EXPECT_EQ(cv_img.channels(), 1);
+  EXPECT_EQ(cv_img.rows, REDUCED(360, 8));
+  EXPECT_EQ(cv_img.cols, REDUCED(480, 8));
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -119,6 +119,28 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestRoundBF16) {
+  // Exact values, and ties to even, between 1 and 1 + 2^-7 then between
+  // 1 + 2^-7 and 1 + 2^-6
+  TypeParam x[] = {1, -2.5, 0, 1 + 1. / 256, 1 + 3. / 256, 1 + 1.5 / 256};
+  caffe_cpu_round_bf16<TypeParam>(6, x);
+  EXPECT_EQ(1, x[0]);
+  EXPECT_EQ(-2.5, x[1]);
+  EXPECT_EQ(0, x[2]);
+  EXPECT_EQ(1, x[3]);
+  EXPECT_EQ(1 + 4. / 256, x[4]);
+  EXPECT_EQ(1 + 2. / 256, x[5]);
+  const int n = this->blob_bottom_->count();
+  const TypeParam* bottom_data = this->blob_bottom_->cpu_data();
+  TypeParam* top_data = this->blob_top_->mutable_cpu_data();
+  caffe_copy(n, bottom_data, top_data);
+  caffe_cpu_round_bf16(n, top_data);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_LE(std::fabs(top_data[i] - bottom_data[i]),
+              std::fabs(bottom_data[i]) / 256);
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -2,11 +2,13 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <boost/thread.hpp>
 #include <string>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/memory_data_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -115,6 +117,54 @@ TYPED_TEST(MemoryDataLayerTest, TestForward) {
   }
 }
 
+// Fills the buffers of layer with the batches of data and labels, in turn.
+template <typename Dtype>
+static void FillBuffers(MemoryDataLayer<Dtype>* layer, const Blob<Dtype>* data,
+    const Blob<Dtype>* labels, int batches) {
+  const int batch_size = layer->batch_size();
+  for (int i = 0; i < batches; ++i) {
+    Batch<Dtype>* buffer = layer->AcquireBuffer();
+    caffe_copy(buffer->data_.count(),
+        data->cpu_data() + data->offset(batch_size * i),
+        buffer->data_.mutable_cpu_data());
+    caffe_copy(batch_size, labels->cpu_data() + batch_size * i,
+        buffer->label_.mutable_cpu_data());
+    layer->ReleaseBuffer(buffer);
+  }
+}
+
+TYPED_TEST(MemoryDataLayerTest, TestForwardBuffered) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_num_buffers(2);
+  shared_ptr<MemoryDataLayer<Dtype> > layer(
+      new MemoryDataLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The producer runs ahead of Forward by at most one batch.
+  boost::thread producer(&FillBuffers<Dtype>, layer.get(), this->data_,
+      this->labels_, this->batches_);
+  for (int batch_num = 0; batch_num < this->batches_; ++batch_num) {
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(this->batch_size_, this->data_blob_->num());
+    for (int j = 0; j < this->data_blob_->count(); ++j) {
+      EXPECT_EQ(this->data_blob_->cpu_data()[j],
+          this->data_->cpu_data()[
+              this->data_->offset(1) * this->batch_size_ * batch_num + j]);
+    }
+    for (int j = 0; j < this->label_blob_->count(); ++j) {
+      EXPECT_EQ(this->label_blob_->cpu_data()[j],
+          this->labels_->cpu_data()[this->batch_size_ * batch_num + j]);
+    }
+  }
+  producer.join();
+}
+
 #ifdef USE_OPENCV
 TYPED_TEST(MemoryDataLayerTest, AddDatumVectorDefaultTransform) {
   typedef typename TypeParam::Dtype Dtype;
@@ -22,11 +22,12 @@ class NetTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
 
  protected:
-  NetTest() : seed_(1701) {}
+  NetTest() : seed_(1701), contiguous_params_(false) {}
 
   virtual void InitNetFromProtoString(const string& proto) {
     NetParameter param;
     CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.set_contiguous_params(contiguous_params_);
     net_.reset(new Net<Dtype>(param));
   }
 
@@ -840,6 +841,7 @@ class NetTest : public MultiDeviceTest<TypeParam> {
   }
 
   int seed_;
+  bool contiguous_params_;
   shared_ptr<Net<Dtype> > net_;
 };
 
@@ -1297,6 +1299,240 @@ TYPED_TEST(NetTest, TestSharedWeightsUpdate) {
   }
 }
 
+TYPED_TEST(NetTest, TestContiguousParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kBiasTerm = true;
+  // Update the params, as separate blobs and then in the arena.
+  vector<shared_ptr<Blob<Dtype> > > expected_params;
+  for (int contiguous = 0; contiguous < 2; ++contiguous) {
+    Caffe::set_random_seed(this->seed_);
+    this->contiguous_params_ = contiguous;
+    this->InitUnsharedWeightsNet(NULL, NULL, false, kBiasTerm);
+    const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+    ASSERT_EQ(4, params.size());
+    Blob<Dtype>* arena = this->net_->learnable_params_arena();
+    if (!contiguous || Caffe::mode() == Caffe::GPU) {
+      EXPECT_TRUE(arena == NULL);
+    } else {
+      ASSERT_TRUE(arena != NULL);
+      int offset = 0;
+      for (int i = 0; i < params.size(); ++i) {
+        EXPECT_EQ(arena->cpu_data() + offset, params[i]->cpu_data());
+        EXPECT_EQ(arena->cpu_diff() + offset, params[i]->cpu_diff());
+        offset += params[i]->count();
+      }
+      EXPECT_EQ(offset, arena->count());
+    }
+    this->net_->Forward();
+    this->net_->Backward();
+    this->net_->Update();
+    for (int i = 0; i < params.size(); ++i) {
+      if (!contiguous) {
+        expected_params.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        expected_params[i]->CopyFrom(*params[i], false, true);
+        expected_params[i]->CopyFrom(*params[i], true, true);
+        continue;
+      }
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_EQ(expected_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+        EXPECT_EQ(expected_params[i]->cpu_diff()[j], params[i]->cpu_diff()[j]);
+      }
+    }
+  }
+  this->net_->ClearParamDiffs();
+  const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(0, params[i]->cpu_diff()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestCheckpointActivations) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Without checkpoints, then every sqrt(N) layers, then after ip2 only.
+  vector<shared_ptr<Blob<Dtype> > > expected_diffs;
+  Dtype expected_loss = 0;
+  for (int run = 0; run < 3; ++run) {
+    ostringstream proto;
+    proto <<
+        "name: 'CheckpointNetwork' "
+        "checkpoint_activations: " << (run > 0 ? "true " : "false ") <<
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 6 } "
+        "    shape { dim: 4 dim: 2 } "
+        "    data_filler { type: 'gaussian' } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'target' "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'ip1' "
+        "  top: 'ip2' "
+        "  checkpoint: " << (run == 2 ? "true " : "false ") <<
+        "} "
+        "layer { "
+        "  name: 'sigmoid' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip2' "
+        "  top: 'sigmoid' "
+        "} "
+        "layer { "
+        "  name: 'reshape' "
+        "  type: 'Reshape' "
+        "  reshape_param { shape { dim: 0 dim: 2 dim: 4 } } "
+        "  bottom: 'sigmoid' "
+        "  top: 'reshape' "
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 2 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'reshape' "
+        "  top: 'ip3' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip3' "
+        "  bottom: 'target' "
+        "} ";
+    Caffe::set_random_seed(this->seed_);
+    this->InitNetFromProtoString(proto.str());
+    EXPECT_EQ(run > 0, this->net_->checkpoint_activations());
+    Dtype loss;
+    this->net_->Forward(&loss);
+    // The blobs recomputed are freed once read.
+    const shared_ptr<Blob<Dtype> > ip1 = this->net_->blob_by_name("ip1");
+    const shared_ptr<Blob<Dtype> > ip2 = this->net_->blob_by_name("ip2");
+    EXPECT_EQ(run == 1, ip2->data()->head() == SyncedMemory::UNINITIALIZED);
+    EXPECT_EQ(run == 2, ip1->data()->head() == SyncedMemory::UNINITIALIZED);
+    // Reshape shares the memory of its bottom, kept if its top is.
+    EXPECT_EQ(run == 2, SyncedMemory::UNINITIALIZED ==
+        this->net_->blob_by_name("sigmoid")->data()->head());
+    size_t total, peak;
+    this->net_->ActivationMemory(&total, &peak);
+    EXPECT_EQ(run == 0, total == peak);
+    this->net_->ClearParamDiffs();
+    this->net_->Backward();
+    EXPECT_EQ(run == 1, ip2->data()->head() == SyncedMemory::UNINITIALIZED);
+    EXPECT_EQ(run == 2, ip1->data()->head() == SyncedMemory::UNINITIALIZED);
+    // The gradients match those of the net that keeps its activations.
+    const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+    ASSERT_EQ(6, params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      if (run == 0) {
+        expected_loss = loss;
+        expected_diffs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        expected_diffs[i]->CopyFrom(*params[i], true, true);
+        continue;
+      }
+      EXPECT_EQ(expected_loss, loss);
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_EQ(expected_diffs[i]->cpu_diff()[j], params[i]->cpu_diff()[j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestBF16Activations) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'BF16Network' "
+      "bf16_activations: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 4 dim: 6 } "
+      "    shape { dim: 4 dim: 2 } "
+      "    data_filler { type: 'gaussian' } "
+      "  } "
+      "  top: 'data' "
+      "  top: 'target' "
+      "} "
+      "layer { "
+      "  name: 'ip1' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 8 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'ip1' "
+      "} "
+      "layer { "
+      "  name: 'ip2' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 2 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'ip1' "
+      "  top: 'ip2' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'ip2' "
+      "  bottom: 'target' "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  this->net_->Forward();
+  this->net_->Backward();
+  // The tops of the inner products, and the diff of ip1, hold bfloat16
+  // values, unlike the data and the params.
+  const shared_ptr<Blob<Dtype> > data = this->net_->blob_by_name("data");
+  const shared_ptr<Blob<Dtype> > ip1 = this->net_->blob_by_name("ip1");
+  const shared_ptr<Blob<Dtype> > ip2 = this->net_->blob_by_name("ip2");
+  const Blob<Dtype>* blobs[] = {data.get(), ip1.get(), ip2.get(),
+      this->net_->learnable_params()[0]};
+  for (int i = 0; i < 4; ++i) {
+    Blob<Dtype> rounded;
+    rounded.CopyFrom(*blobs[i], false, true);
+    caffe_cpu_round_bf16(rounded.count(), rounded.mutable_cpu_data());
+    int changed = 0;
+    for (int j = 0; j < rounded.count(); ++j) {
+      changed += rounded.cpu_data()[j] != blobs[i]->cpu_data()[j];
+    }
+    EXPECT_EQ(i == 1 || i == 2, changed == 0);
+  }
+  Blob<Dtype> rounded;
+  rounded.CopyFrom(*ip1, true, true);
+  caffe_cpu_round_bf16(rounded.count(), rounded.mutable_cpu_diff());
+  for (int j = 0; j < rounded.count(); ++j) {
+    EXPECT_EQ(rounded.cpu_diff()[j], ip1->cpu_diff()[j]);
+  }
+}
+
 TYPED_TEST(NetTest, TestSharedWeightsResume) {
   typedef typename TypeParam::Dtype Dtype;
 
@@ -6,6 +6,7 @@
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
+#include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/solver.hpp"
@@ -106,4 +107,191 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestAsyncTest) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+     "base_lr: 0.1 "
+     "lr_policy: 'fixed' "
+     "max_iter: 3 "
+     "snapshot_after_train: false "
+     "test_interval: 1 "
+     "test_iter: 2 "
+     "test_async: true "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { dim: 5 dim: 2 dim: 3 dim: 4 } "
+     "      shape { dim: 5 } "
+     "      data_filler { type: 'gaussian' } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 10 "
+     "      weight_filler { type: 'gaussian' } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'SoftmaxWithLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "  } "
+     "} ";
+  this->InitSolverFromProtoString(proto);
+  this->solver_->Solve();
+  // The test net was last run on a copy of the final weights.
+  ASSERT_EQ(1, this->solver_->test_nets().size());
+  const vector<shared_ptr<Blob<Dtype> > >& params =
+      this->solver_->net()->params();
+  const vector<shared_ptr<Blob<Dtype> > >& test_params =
+      this->solver_->test_nets()[0]->params();
+  ASSERT_EQ(params.size(), test_params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_NE(params[i]->cpu_data(), test_params[i]->cpu_data());
+    ASSERT_EQ(params[i]->count(), test_params[i]->count());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(params[i]->cpu_data()[j], test_params[i]->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(SolverTest, TestHogwild) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Hogwild is CPU only.
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  // Regress to zero, from weights far from it.
+  const string& proto =
+     "base_lr: 0.05 "
+     "lr_policy: 'fixed' "
+     "max_iter: 20 "
+     "snapshot_after_train: false "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { dim: 5 dim: 10 } "
+     "      shape { dim: 5 dim: 1 } "
+     "      data_filler { type: 'gaussian' } "
+     "      data_filler { type: 'constant' value: 0 } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'target' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 1 "
+     "      weight_filler { type: 'constant' value: 1 } "
+     "      bias_filler { type: 'constant' value: 1 } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'EuclideanLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'target' "
+     "  } "
+     "} ";
+  // As in tools/caffe, the solver count is set before creating the solver.
+  Caffe::set_solver_count(3);
+  this->InitSolverFromProtoString(proto);
+  Hogwild<Dtype> hogwild(this->solver_);
+  hogwild.Run();
+  Caffe::set_solver_count(1);
+  EXPECT_EQ(20, this->solver_->iter());
+  // The solver updated the shared weights, which all workers moved closer
+  // to zero.
+  const vector<Blob<Dtype>*>& params =
+      this->solver_->net()->learnable_params();
+  ASSERT_EQ(2, params.size());
+  EXPECT_EQ(hogwild.data(), params[0]->cpu_data());
+  const Dtype sumsq = params[0]->sumsq_data() + params[1]->sumsq_data();
+  EXPECT_LT(sumsq, 11. / 2);
+}
+
+TYPED_TEST(SolverTest, TestDynamicLossScale) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A loss scale that overflows the bfloat16 gradients of ip1, until it is
+  // halved enough.
+  const string& proto =
+     "base_lr: 0.0001 "
+     "lr_policy: 'fixed' "
+     "max_iter: 20 "
+     "snapshot_after_train: false "
+     "loss_scale: 3e38 "
+     "dynamic_loss_scale: true "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  bf16_activations: true "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { dim: 5 dim: 10 } "
+     "      shape { dim: 5 dim: 1 } "
+     "      data_filler { type: 'gaussian' } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'target' "
+     "  } "
+     "  layer { "
+     "    name: 'ip1' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 10 "
+     "      weight_filler { type: 'gaussian' } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'ip1' "
+     "  } "
+     "  layer { "
+     "    name: 'ip2' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 1 "
+     "      weight_filler { type: 'constant' value: 10 } "
+     "    } "
+     "    bottom: 'ip1' "
+     "    top: 'ip2' "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'EuclideanLoss' "
+     "    bottom: 'ip2' "
+     "    bottom: 'target' "
+     "  } "
+     "} ";
+  this->InitSolverFromProtoString(proto);
+  this->solver_->Solve();
+  const Dtype loss_scale = this->solver_->net()->loss_scale();
+  EXPECT_LT(loss_scale, 3e38 / 2);
+  EXPECT_GT(loss_scale, 1);
+  // The updates of the iterations that overflowed were skipped.
+  const vector<Blob<Dtype>*>& params =
+      this->solver_->net()->learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_FALSE(isnan(params[i]->cpu_data()[j]));
+      EXPECT_FALSE(isinf(params[i]->cpu_data()[j]));
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,109 @@
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/tcp_ring.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class TCPRingTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    MakeTempDir(&dir_);
+  }
+
+  // Runs the collectives in world threads standing for the processes.
+  void Run(int world, const string& rendezvous, size_t count) {
+    count_ = count;
+    rendezvous_ = rendezvous;
+    broadcast_.assign(world, vector<Dtype>());
+    reduced_.assign(world, vector<Dtype>());
+    gathered_.assign(world, vector<char>());
+    boost::thread_group threads;
+    for (int rank = 0; rank < world; ++rank) {
+      threads.create_thread(boost::bind(&TCPRingTest::Process, this, rank,
+          world));
+    }
+    threads.join_all();
+    for (int rank = 0; rank < world; ++rank) {
+      ASSERT_EQ(count, broadcast_[rank].size());
+      ASSERT_EQ(count, reduced_[rank].size());
+      for (int i = 0; i < count; ++i) {
+        EXPECT_EQ(Dtype(i % 7), broadcast_[rank][i]);
+        // Sum over ranks r of (r + 1) * (i % 5)
+        EXPECT_EQ(Dtype(world * (world + 1) / 2 * (i % 5)),
+            reduced_[rank][i]);
+      }
+      ASSERT_EQ(world * 3, gathered_[rank].size());
+      for (int i = 0; i < world * 3; ++i) {
+        EXPECT_EQ('a' + i / 3, gathered_[rank][i]);
+      }
+    }
+  }
+
+  void Process(int rank, int world) {
+    TCPRing ring(rank, world, rendezvous_);
+    vector<Dtype>& broadcast = broadcast_[rank];
+    broadcast.resize(count_);
+    for (int i = 0; i < count_; ++i) {
+      broadcast[i] = rank == 0 ? i % 7 : -1;
+    }
+    ring.Broadcast(count_ ? &broadcast[0] : NULL, count_);
+    vector<Dtype>& reduced = reduced_[rank];
+    reduced.resize(count_);
+    for (int i = 0; i < count_; ++i) {
+      reduced[i] = (rank + 1) * (i % 5);
+    }
+    ring.AllReduce(count_ ? &reduced[0] : NULL, count_);
+    // Gathers the rank of each process, in place.
+    vector<char>& gathered = gathered_[rank];
+    gathered.resize(world * 3);
+    memset(&gathered[rank * 3], 'a' + rank, 3);
+    ring.AllGather(&gathered[rank * 3], 3, &gathered[0]);
+  }
+
+  string dir_;
+  string rendezvous_;
+  size_t count_;
+  vector<vector<Dtype> > broadcast_;
+  vector<vector<Dtype> > reduced_;
+  vector<vector<char> > gathered_;
+};
+
+TYPED_TEST_CASE(TCPRingTest, TestDtypes);
+
+TYPED_TEST(TCPRingTest, TestSingleProcess) {
+  this->Run(1, "", 10);
+}
+
+TYPED_TEST(TCPRingTest, TestFileRendezvous) {
+  const string rendezvous = "file:" + this->dir_ + "/ring";
+  this->Run(2, rendezvous, 1001);
+  this->Run(3, rendezvous, 1001);
+  // Fewer values than processes, and a broadcast of several chunks
+  this->Run(4, rendezvous, 2);
+  this->Run(3, rendezvous, 300000);
+}
+
+TYPED_TEST(TCPRingTest, TestAddresses) {
+  // Ports depending on the process, not to collide with other test runs.
+  string rendezvous;
+  for (int rank = 0; rank < 3; ++rank) {
+    const int port = 40000 + (getpid() * 3 + rank) % 20000;
+    rendezvous += (rank ? ",localhost:" : "localhost:") + format_int(port);
+  }
+  this->Run(3, rendezvous, 1001);
+}
+
+}  // namespace caffe
@@ -0,0 +1,136 @@
+#include <signal.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/worker_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class WorkerDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  WorkerDataLayerTest()
+      : blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()),
+        blob_top_extra_(new Blob<Dtype>()) {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    blob_top_vec_.push_back(blob_top_extra_);
+  }
+  virtual ~WorkerDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+    delete blob_top_extra_;
+  }
+
+  // Workers running a DummyData layer with constant tops 7, 1 and 3.
+  LayerParameter WorkerParam() {
+    LayerParameter param;
+    param.mutable_data_param()->set_prefetch(2);
+    WorkerDataParameter* worker_param = param.mutable_worker_data_param();
+    worker_param->set_workers(2);
+    LayerParameter* layer = worker_param->mutable_layer();
+    layer->set_type("DummyData");
+    DummyDataParameter* dummy_param = layer->mutable_dummy_data_param();
+    BlobShape* shape = dummy_param->add_shape();
+    shape->add_dim(2);
+    shape->add_dim(3);
+    shape->add_dim(4);
+    dummy_param->add_shape()->add_dim(2);
+    shape = dummy_param->add_shape();
+    shape->add_dim(2);
+    shape->add_dim(5);
+    const float values[] = {7, 1, 3};
+    for (int i = 0; i < 3; ++i) {
+      FillerParameter* filler = dummy_param->add_data_filler();
+      filler->set_type("constant");
+      filler->set_value(values[i]);
+    }
+    return param;
+  }
+
+  void CheckTops() {
+    EXPECT_EQ(2 * 3 * 4, blob_top_data_->count());
+    EXPECT_EQ(2, blob_top_label_->count());
+    EXPECT_EQ(2 * 5, blob_top_extra_->count());
+    for (int i = 0; i < blob_top_data_->count(); ++i) {
+      EXPECT_EQ(7, blob_top_data_->cpu_data()[i]);
+    }
+    for (int i = 0; i < blob_top_label_->count(); ++i) {
+      EXPECT_EQ(1, blob_top_label_->cpu_data()[i]);
+    }
+    for (int i = 0; i < blob_top_extra_->count(); ++i) {
+      EXPECT_EQ(3, blob_top_extra_->cpu_data()[i]);
+    }
+  }
+
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  Blob<Dtype>* const blob_top_extra_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(WorkerDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(WorkerDataLayerTest, TestRead) {
+  typedef typename TypeParam::Dtype Dtype;
+  pid_t worker;
+  {
+    WorkerDataLayer<Dtype> layer(this->WorkerParam());
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(2, this->blob_top_data_->num());
+    EXPECT_EQ(3, this->blob_top_data_->channels());
+    EXPECT_EQ(4, this->blob_top_data_->height());
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      this->CheckTops();
+    }
+    for (int i = 0; i < 100 && layer.worker_pid(1) == 0; ++i) {
+      usleep(10000);
+    }
+    worker = layer.worker_pid(1);
+    ASSERT_GT(worker, 0);
+    EXPECT_EQ(0, kill(worker, 0));
+  }
+  // The workers exit with the layer.
+  EXPECT_EQ(-1, kill(worker, 0));
+}
+
+TYPED_TEST(WorkerDataLayerTest, TestRestartWorker) {
+  typedef typename TypeParam::Dtype Dtype;
+  WorkerDataLayer<Dtype> layer(this->WorkerParam());
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckTops();
+  for (int i = 0; i < 100 && layer.worker_pid(0) == 0; ++i) {
+    usleep(10000);
+  }
+  const pid_t worker = layer.worker_pid(0);
+  ASSERT_GT(worker, 0);
+  ASSERT_EQ(0, kill(worker, SIGKILL));
+  // Wait for the supervisor to notice, while the other worker keeps
+  // loading batches.
+  for (int i = 0; i < 100 && layer.worker_pid(0) == worker; ++i) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    this->CheckTops();
+    usleep(10000);
+  }
+  EXPECT_NE(worker, layer.worker_pid(0));
+  for (int iter = 0; iter < 10; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    this->CheckTops();
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,268 @@
+#include <errno.h>
+#include <fcntl.h>
+#ifdef USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif  // USE_IO_URING
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+#include <cstring>
+#include <string>
+
+#include "caffe/util/async_file_reader.hpp"
+#include "caffe/util/io.hpp"
+
+namespace caffe {
+
+#ifdef USE_IO_URING
+// liburing is not required: the three system calls are used directly.
+static int io_uring_setup(unsigned entries, struct io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+    unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+      min_complete, flags, NULL, 0));
+}
+#endif  // USE_IO_URING
+
+AsyncFileReader::AsyncFileReader(int depth)
+    : depth_(depth), pending_(0), use_ring_(false) {
+  CHECK_GT(depth_, 0);
+#ifdef USE_IO_URING
+  ring_fd_ = -1;
+  in_flight_ = 0;
+  use_ring_ = InitRing();
+#endif  // USE_IO_URING
+  if (!use_ring_) {
+    for (int i = 0; i < depth_; ++i) {
+      threads_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &AsyncFileReader::ThreadEntry, this)));
+    }
+  }
+}
+
+AsyncFileReader::~AsyncFileReader() {
+  // Workers exit when they pop NULL, after the reads queued before it.
+  for (int i = 0; i < threads_.size(); ++i) {
+    todo_.push(NULL);
+  }
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+  Request* request;
+  while (done_.try_pop(&request)) {
+    delete request;
+  }
+#ifdef USE_IO_URING
+  if (use_ring_) {
+    // The kernel may still write to the buffers of reads in flight.
+    while (in_flight_ > 0) {
+      ReapCompletion();
+    }
+    for (int i = 0; i < backlog_.size(); ++i) {
+      delete backlog_[i];
+    }
+    for (int i = 0; i < completed_.size(); ++i) {
+      delete completed_[i];
+    }
+    munmap(sqes_, ring_entries_ * sizeof(struct io_uring_sqe));
+    munmap(cq_ring_, cq_ring_size_);
+    munmap(sq_ring_, sq_ring_size_);
+    close(ring_fd_);
+  }
+#endif  // USE_IO_URING
+}
+
+const char* AsyncFileReader::backend() const {
+  return use_ring_ ? "io_uring" : "threads";
+}
+
+void AsyncFileReader::ThreadEntry() {
+  while (true) {
+    Request* request = todo_.pop();
+    if (!request) {
+      break;
+    }
+    request->ok = ReadFileToString(request->filename, &request->data);
+    done_.push(request);
+  }
+}
+
+void AsyncFileReader::Submit(uint64_t id, const string& filename) {
+  Request* request = new Request();
+  request->id = id;
+  request->filename = filename;
+  request->ok = false;
+  request->fd = -1;
+  request->offset = 0;
+  ++pending_;
+#ifdef USE_IO_URING
+  if (use_ring_) {
+    if (in_flight_ < static_cast<int>(ring_entries_)) {
+      StartRead(request);
+    } else {
+      backlog_.push_back(request);
+    }
+    return;
+  }
+#endif  // USE_IO_URING
+  todo_.push(request);
+}
+
+uint64_t AsyncFileReader::WaitAny(string* data, bool* ok) {
+  CHECK_GT(pending_, 0) << "No reads pending";
+  Request* request;
+#ifdef USE_IO_URING
+  if (use_ring_) {
+    while (completed_.empty()) {
+      boost::this_thread::interruption_point();
+      ReapCompletion();
+    }
+    request = completed_.front();
+    completed_.pop_front();
+  } else {
+    request = done_.pop();
+  }
+#else
+  request = done_.pop();
+#endif  // USE_IO_URING
+  --pending_;
+  const uint64_t id = request->id;
+  data->swap(request->data);
+  *ok = request->ok;
+  delete request;
+  return id;
+}
+
+#ifdef USE_IO_URING
+bool AsyncFileReader::InitRing() {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = io_uring_setup(depth_, &params);
+  if (ring_fd_ < 0) {
+    LOG(WARNING) << "io_uring is not available (" << strerror(errno)
+        << "), reading files on " << depth_ << " threads";
+    return false;
+  }
+  ring_entries_ = params.sq_entries;
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes +
+      params.cq_entries * sizeof(struct io_uring_cqe);
+  sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+  sqes_ = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+      IORING_OFF_SQES);
+  CHECK(sq_ring_ != MAP_FAILED && cq_ring_ != MAP_FAILED &&
+      sqes_ != MAP_FAILED) << "Failed to map io_uring: " << strerror(errno);
+  char* sq = static_cast<char*>(sq_ring_);
+  char* cq = static_cast<char*>(cq_ring_);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_ = cq + params.cq_off.cqes;
+  return true;
+}
+
+void AsyncFileReader::StartRead(Request* request) {
+  request->fd = open(request->filename.c_str(), O_RDONLY);
+  struct stat st;
+  if (request->fd < 0 || fstat(request->fd, &st) != 0) {
+    FinishRead(request, false);
+    return;
+  }
+  request->data.resize(st.st_size);
+  if (st.st_size == 0) {
+    FinishRead(request, true);
+    return;
+  }
+  ++in_flight_;
+  QueueRead(request);
+}
+
+void AsyncFileReader::QueueRead(Request* request) {
+  request->iov.iov_base = &request->data[request->offset];
+  request->iov.iov_len = request->data.size() - request->offset;
+  // Only this thread produces submissions, so the tail is ours to read.
+  const unsigned tail = *sq_tail_;
+  const unsigned index = tail & *sq_mask_;
+  struct io_uring_sqe* sqe =
+      static_cast<struct io_uring_sqe*>(sqes_) + index;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = request->fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&request->iov);
+  sqe->len = 1;
+  sqe->off = request->offset;
+  sqe->user_data = reinterpret_cast<uint64_t>(request);
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  int ret;
+  do {
+    ret = io_uring_enter(ring_fd_, 1, 0, 0);
+  } while (ret < 0 && errno == EINTR);
+  CHECK_GE(ret, 0) << "io_uring_enter failed: " << strerror(errno);
+}
+
+void AsyncFileReader::FinishRead(Request* request, bool ok) {
+  if (request->fd >= 0) {
+    close(request->fd);
+    request->fd = -1;
+  }
+  request->ok = ok;
+  if (!ok) {
+    request->data.clear();
+  }
+  completed_.push_back(request);
+}
+
+void AsyncFileReader::ReapCompletion() {
+  unsigned head = *cq_head_;
+  while (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+    const int ret = io_uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+    CHECK(ret >= 0 || errno == EINTR)
+        << "io_uring_enter failed: " << strerror(errno);
+  }
+  const struct io_uring_cqe* cqe =
+      static_cast<struct io_uring_cqe*>(cqes_) + (head & *cq_mask_);
+  Request* request = reinterpret_cast<Request*>(cqe->user_data);
+  const int res = cqe->res;
+  __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+
+  if (res == -EINTR || res == -EAGAIN) {
+    QueueRead(request);
+    return;
+  }
+  if (res > 0) {
+    request->offset += res;
+    if (request->offset < request->data.size()) {
+      // Short read: queue the rest.
+      QueueRead(request);
+      return;
+    }
+  } else if (res == 0) {
+    // The file was truncated since it was opened.
+    request->data.resize(request->offset);
+  }
+  --in_flight_;
+  FinishRead(request, res >= 0);
+  // Reads that fail to open finish at once, without taking a slot.
+  while (!backlog_.empty() && in_flight_ < static_cast<int>(ring_entries_)) {
+    Request* next = backlog_.front();
+    backlog_.pop_front();
+    StartRead(next);
+  }
+}
+#endif  // USE_IO_URING
+
+}  // namespace caffe
@@ -0,0 +1,157 @@
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif  // USE_LZ4
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif  // USE_ZSTD
+
+#include <string>
+
+#include "caffe/util/compression.hpp"
+
+namespace caffe {
+
+bool CompressionAvailable(Datum_Compression compression) {
+  switch (compression) {
+  case Datum::NONE:
+    return true;
+  case Datum::LZ4:
+#ifdef USE_LZ4
+    return true;
+#else
+    return false;
+#endif  // USE_LZ4
+  case Datum::ZSTD:
+#ifdef USE_ZSTD
+    return true;
+#else
+    return false;
+#endif  // USE_ZSTD
+  default:
+    LOG(FATAL) << "Unknown compression: " << compression;
+  }
+  return false;
+}
+
+bool CompressDatum(Datum_Compression compression, int level, Datum* datum) {
+  if (compression == Datum::NONE || datum->encoded() ||
+      datum->compression() != Datum::NONE) {
+    return false;
+  }
+  const int count = datum->channels() * datum->height() * datum->width();
+  const bool is_float = datum->data().empty();
+  const char* src;
+  size_t size;
+  if (is_float) {
+    CHECK_EQ(datum->float_data_size(), count) << "Incorrect float_data size";
+    src = reinterpret_cast<const char*>(datum->float_data().data());
+    size = count * sizeof(float);
+  } else {
+    CHECK_EQ(datum->data().size(), count) << "Incorrect data size";
+    src = datum->data().data();
+    size = count;
+  }
+  if (size == 0) {
+    return false;
+  }
+  string compressed;
+  size_t compressed_size = 0;
+  switch (compression) {
+  case Datum::LZ4: {
+#ifdef USE_LZ4
+    compressed.resize(LZ4_compressBound(size));
+    const int result = LZ4_compress_default(src, &compressed[0], size,
+        compressed.size());
+    CHECK_GT(result, 0) << "LZ4 compression failed";
+    compressed_size = result;
+#else
+    LOG(FATAL) << "LZ4 compression requires USE_LZ4.";
+#endif  // USE_LZ4
+    break;
+  }
+  case Datum::ZSTD: {
+#ifdef USE_ZSTD
+    compressed.resize(ZSTD_compressBound(size));
+    compressed_size = ZSTD_compress(&compressed[0], compressed.size(), src,
+        size, level);
+    CHECK(!ZSTD_isError(compressed_size)) << "Zstd compression failed: "
+        << ZSTD_getErrorName(compressed_size);
+#else
+    LOG(FATAL) << "Zstd compression requires USE_ZSTD.";
+#endif  // USE_ZSTD
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown compression: " << compression;
+  }
+  compressed.resize(compressed_size);
+  datum->mutable_data()->swap(compressed);
+  datum->clear_float_data();
+  datum->set_compression(compression);
+  datum->set_compressed_float_data(is_float);
+  return true;
+}
+
+void DecompressDatum(const Datum& datum, Datum* uncompressed) {
+  CHECK_NE(uncompressed, &datum);
+  const int count = datum.channels() * datum.height() * datum.width();
+  uncompressed->set_channels(datum.channels());
+  uncompressed->set_height(datum.height());
+  uncompressed->set_width(datum.width());
+  uncompressed->set_label(datum.label());
+  uncompressed->clear_encoded();
+  uncompressed->clear_compression();
+  uncompressed->clear_compressed_float_data();
+  char* dst;
+  size_t size;
+  if (datum.compressed_float_data()) {
+    uncompressed->clear_data();
+    uncompressed->mutable_float_data()->Resize(count, 0);
+    dst = reinterpret_cast<char*>(
+        uncompressed->mutable_float_data()->mutable_data());
+    size = count * sizeof(float);
+  } else {
+    uncompressed->clear_float_data();
+    uncompressed->mutable_data()->resize(count);
+    dst = &(*uncompressed->mutable_data())[0];
+    size = count;
+  }
+  const string& src = datum.data();
+  switch (datum.compression()) {
+  case Datum::LZ4: {
+#ifdef USE_LZ4
+    const int result = LZ4_decompress_safe(src.data(), dst, src.size(), size);
+    CHECK_EQ(result, static_cast<int>(size))
+        << "Corrupt LZ4 compressed Datum";
+#else
+    LOG(FATAL) << "LZ4 compressed Datum requires USE_LZ4.";
+#endif  // USE_LZ4
+    break;
+  }
+  case Datum::ZSTD: {
+#ifdef USE_ZSTD
+    const size_t result = ZSTD_decompress(dst, size, src.data(), src.size());
+    CHECK(!ZSTD_isError(result)) << "Corrupt Zstd compressed Datum: "
+        << ZSTD_getErrorName(result);
+    CHECK_EQ(result, size) << "Corrupt Zstd compressed Datum";
+#else
+    LOG(FATAL) << "Zstd compressed Datum requires USE_ZSTD.";
+#endif  // USE_ZSTD
+    break;
+  }
+  default:
+    LOG(FATAL) << "Datum is not compressed";
+  }
+}
+
+bool DecompressDatum(Datum* datum) {
+  if (datum->compression() == Datum::NONE) {
+    return false;
+  }
+  Datum uncompressed;
+  DecompressDatum(*datum, &uncompressed);
+  datum->Swap(&uncompressed);
+  return true;
+}
+
+}  // namespace caffe
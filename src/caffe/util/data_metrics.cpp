@@ -0,0 +1,123 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+
+#include "caffe/util/data_metrics.hpp"
+
+namespace caffe {
+
+TimeHistogram::TimeHistogram()
+    : count_(0), total_(0), max_(0) {
+  std::fill(buckets_, buckets_ + kBuckets, 0);
+}
+
+void TimeHistogram::Add(double us) {
+  int bucket = 0;
+  if (us >= 1) {
+    bucket = std::min(static_cast<int>(std::log(us) / std::log(2.)) + 1,
+        kBuckets - 1);
+  }
+  ++buckets_[bucket];
+  ++count_;
+  total_ += us;
+  max_ = std::max(max_, us);
+}
+
+double TimeHistogram::Percentile(double p) const {
+  const double rank = p / 100 * count_;
+  int seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += buckets_[i];
+    if (seen > 0 && seen >= rank) {
+      return std::min(std::ldexp(1., i), max_);
+    }
+  }
+  return max_;
+}
+
+const char* DataMetrics::StageName(int stage) {
+  switch (stage) {
+  case READ:
+    return "read";
+  case DECODE:
+    return "decode";
+  case TRANSFORM:
+    return "transform";
+  case COPY:
+    return "copy";
+  default:
+    LOG(FATAL) << "Unknown stage: " << stage;
+  }
+  return "";
+}
+
+DataMetrics::Counters::Counters()
+    : batches(0), items(0), forwards(0), queued(0), seconds(0) {
+}
+
+class DataMetrics::sync {
+ public:
+  sync() : start_(boost::posix_time::microsec_clock::local_time()) {}
+
+  mutable boost::mutex mutex_;
+  boost::posix_time::ptime start_;
+};
+
+DataMetrics::DataMetrics()
+    : sync_(new sync()) {
+}
+
+void DataMetrics::AddStageTime(Stage stage, double us) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  counters_.stages[stage].Add(us);
+}
+
+void DataMetrics::AddBatch(int items, double producer_wait_us) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  ++counters_.batches;
+  counters_.items += items;
+  counters_.producer_wait.Add(producer_wait_us);
+}
+
+void DataMetrics::AddForward(int queue_depth, double consumer_wait_us) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  ++counters_.forwards;
+  counters_.queued += queue_depth;
+  counters_.consumer_wait.Add(consumer_wait_us);
+}
+
+DataMetrics::Counters DataMetrics::Get() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  Counters counters = counters_;
+  counters.seconds = (boost::posix_time::microsec_clock::local_time() -
+      sync_->start_).total_microseconds() / 1e6;
+  return counters;
+}
+
+void DataMetrics::Reset() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  counters_ = Counters();
+  sync_->start_ = boost::posix_time::microsec_clock::local_time();
+}
+
+string DataMetrics::Summary() const {
+  const Counters counters = Get();
+  std::ostringstream summary;
+  summary << counters.items_per_second() << " items/s, queue "
+      << counters.mean_queue_depth() << ", forward waited "
+      << counters.consumer_wait.total() / 1000 << " ms (p90 "
+      << counters.consumer_wait.Percentile(90) / 1000 << " ms), prefetch "
+      << "waited " << counters.producer_wait.total() / 1000 << " ms";
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    if (counters.stages[i].count()) {
+      summary << ", " << StageName(i) << " "
+          << counters.stages[i].mean() / 1000 << " ms/batch";
+    }
+  }
+  return summary.str();
+}
+
+}  // namespace caffe
@@ -0,0 +1,57 @@
+#include <string>
+
+#include "caffe/util/datum_cache.hpp"
+
+namespace caffe {
+
+DatumCache::DatumCache(size_t capacity_bytes)
+    : capacity_bytes_(capacity_bytes), size_bytes_(0),
+      hits_(0), misses_(0), evictions_(0) {
+}
+
+size_t DatumCache::EntryBytes(const string& key, const Datum& datum) {
+  // Approximate bookkeeping overhead of the list node and the index entry.
+  const size_t kOverhead = 2 * sizeof(Datum) + 2 * sizeof(string) + 64;
+  return key.size() + datum.data().size()
+      + datum.float_data_size() * sizeof(float) + kOverhead;
+}
+
+bool DatumCache::Get(const string& key, Datum* datum) {
+  std::map<string, EntryList::iterator>::iterator it = index_.find(key);
+  if (it == index_.end()) {
+    ++misses_;
+    return false;
+  }
+  // Move the entry to the front of the list.
+  entries_.splice(entries_.begin(), entries_, it->second);
+  datum->CopyFrom(it->second->second);
+  ++hits_;
+  return true;
+}
+
+void DatumCache::Put(const string& key, const Datum& datum) {
+  const size_t bytes = EntryBytes(key, datum);
+  if (bytes > capacity_bytes_ || index_.count(key)) {
+    return;
+  }
+  while (size_bytes_ + bytes > capacity_bytes_) {
+    const std::pair<string, Datum>& lru = entries_.back();
+    size_bytes_ -= EntryBytes(lru.first, lru.second);
+    index_.erase(lru.first);
+    entries_.pop_back();
+    ++evictions_;
+  }
+  entries_.push_front(std::make_pair(key, datum));
+  index_[key] = entries_.begin();
+  size_bytes_ += bytes;
+}
+
+void DatumCache::LogStats(const string& name) const {
+  const uint64_t lookups = hits_ + misses_;
+  LOG(INFO) << name << " cache: " << size() << " samples, "
+      << (size_bytes_ >> 20) << " of " << (capacity_bytes_ >> 20) << " MB, "
+      << "hit rate " << (lookups ? 100. * hits_ / lookups : 0.) << "%, "
+      << evictions_ << " evictions";
+}
+
+}  // namespace caffe
@@ -1,6 +1,7 @@
 #include "caffe/util/db.hpp"
 #include "caffe/util/db_leveldb.hpp"
 #include "caffe/util/db_lmdb.hpp"
+#include "caffe/util/db_packed.hpp"
 
 #include <string>
 
@@ -16,6 +17,8 @@ DB* GetDB(DataParameter::DB backend) {
   case DataParameter_DB_LMDB:
     return new LMDB();
 #endif  // USE_LMDB
+  case DataParameter_DB_PACKED:
+    return new PackedDB();
   default:
     LOG(FATAL) << "Unknown database backend";
     return NULL;
@@ -33,9 +36,19 @@ DB* GetDB(const string& backend) {
     return new LMDB();
   }
 #endif  // USE_LMDB
+  if (backend == "packed") {
+    return new PackedDB();
+  }
   LOG(FATAL) << "Unknown database backend";
   return NULL;
 }
 
+DB* GetDB(const DataParameter& param) {
+  if (param.backend() == DataParameter_DB_PACKED) {
+    return new PackedDB(param.packed_read_mode());
+  }
+  return GetDB(param.backend());
+}
+
 }  // namespace db
 }  // namespace caffe
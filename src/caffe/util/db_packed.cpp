@@ -0,0 +1,315 @@
+#include "caffe/util/db_packed.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+namespace caffe { namespace db {
+
+namespace {
+
+const char kDataMagic[] = "CAFFEPKD";
+const char kIndexMagic[] = "CAFFEPKI";
+const size_t kMagicSize = 8;
+// Key size, value size and checksum.
+const size_t kHeaderSize = 3 * sizeof(uint32_t);
+// O_DIRECT requires block-aligned buffers, offsets and sizes.
+const size_t kAlignment = 4096;
+const size_t kChunkSize = 4 << 20;
+
+// CRC-32C (Castagnoli) lookup table for the reflected polynomial.
+class Crc32cTable {
+ public:
+  Crc32cTable() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : (c >> 1);
+      }
+      table_[i] = c;
+    }
+  }
+  uint32_t table_[256];
+};
+
+void WriteFully(int fd, const char* data, size_t size, const string& path) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK_GT(n, 0) << "Failed to write " << path << ": " << strerror(errno);
+    data += n;
+    size -= n;
+  }
+}
+
+int CreateFile(const string& path, const char* magic) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0664);
+  CHECK_GE(fd, 0) << "Failed to create " << path << ": " << strerror(errno);
+  WriteFully(fd, magic, kMagicSize, path);
+  return fd;
+}
+
+void CheckMagic(const string& path, const char* magic) {
+  std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+  CHECK(file.is_open()) << "Failed to open " << path;
+  char buffer[kMagicSize];
+  file.read(buffer, kMagicSize);
+  CHECK(file && memcmp(buffer, magic, kMagicSize) == 0)
+      << path << " is not a packed db file";
+}
+
+}  // namespace
+
+uint32_t Crc32c(const char* data, size_t size, uint32_t crc) {
+  crc = ~crc;
+#ifdef __SSE4_2__
+  uint64_t crc64 = crc;
+  for (; size >= 8; size -= 8, data += 8) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = static_cast<uint32_t>(crc64);
+  for (; size > 0; --size, ++data) {
+    crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*data));
+  }
+#else
+  static const Crc32cTable table;
+  for (; size > 0; --size, ++data) {
+    crc = table.table_[(crc ^ static_cast<uint8_t>(*data)) & 0xFF] ^ (crc >> 8);
+  }
+#endif
+  return ~crc;
+}
+
+PackedCursor::PackedCursor(const string& source)
+    : source_(source), index_(0), record_key_(NULL),
+      key_size_(0), value_size_(0) {
+  const string path = source + "/index";
+  CheckMagic(path, kIndexMagic);
+  std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+  file.seekg(0, std::ios::end);
+  const size_t size = static_cast<size_t>(file.tellg()) - kMagicSize;
+  // A trailing partial offset can only come from an interrupted commit.
+  offsets_.resize(size / sizeof(uint64_t));
+  file.seekg(kMagicSize, std::ios::beg);
+  file.read(reinterpret_cast<char*>(offsets_.data()),
+      offsets_.size() * sizeof(uint64_t));
+  CHECK(file) << "Failed to read " << path;
+}
+
+void PackedCursor::Seek(size_t index) {
+  index_ = index;
+  if (!valid()) {
+    return;
+  }
+  const uint64_t offset = offsets_[index_];
+  const char* header = Read(offset, kHeaderSize);
+  uint32_t crc;
+  memcpy(&key_size_, header, sizeof(uint32_t));
+  memcpy(&value_size_, header + sizeof(uint32_t), sizeof(uint32_t));
+  memcpy(&crc, header + 2 * sizeof(uint32_t), sizeof(uint32_t));
+  const char* record = Read(offset, kHeaderSize + key_size_ + value_size_);
+  record_key_ = record + kHeaderSize;
+  CHECK_EQ(Crc32c(record_key_, key_size_ + value_size_), crc)
+      << "Checksum mismatch for record " << index_ << " of " << source_;
+}
+
+PackedMmapCursor::PackedMmapCursor(const string& source)
+    : PackedCursor(source), map_(NULL), map_size_(0) {
+  const string path = source + "/data";
+  int fd = open(path.c_str(), O_RDONLY);
+  CHECK_GE(fd, 0) << "Failed to open " << path << ": " << strerror(errno);
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Failed to stat " << path;
+  map_size_ = st.st_size;
+  void* map = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+  CHECK(map != MAP_FAILED) << "Failed to mmap " << path << ": "
+      << strerror(errno);
+  close(fd);
+  map_ = static_cast<char*>(map);
+  madvise(map_, map_size_, MADV_SEQUENTIAL);
+  SeekToFirst();
+}
+
+PackedMmapCursor::~PackedMmapCursor() {
+  munmap(map_, map_size_);
+}
+
+const char* PackedMmapCursor::Read(uint64_t offset, size_t size) {
+  CHECK_LE(offset + size, map_size_) << "Truncated record in " << source_;
+  return map_ + offset;
+}
+
+PackedStreamCursor::PackedStreamCursor(const string& source, bool direct)
+    : PackedCursor(source), fd_(-1), direct_(false), buffer_(NULL),
+      capacity_(0), buffer_offset_(0), buffer_size_(0) {
+  const string path = source + "/data";
+  if (direct) {
+#ifdef O_DIRECT
+    fd_ = open(path.c_str(), O_RDONLY | O_DIRECT);
+    direct_ = fd_ >= 0;
+#endif
+    LOG_IF(WARNING, !direct_) << "O_DIRECT is not supported for " << path
+        << ", reading through the page cache";
+  }
+  if (fd_ < 0) {
+    fd_ = open(path.c_str(), O_RDONLY);
+  }
+  CHECK_GE(fd_, 0) << "Failed to open " << path << ": " << strerror(errno);
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  SeekToFirst();
+}
+
+PackedStreamCursor::~PackedStreamCursor() {
+  close(fd_);
+  free(buffer_);
+}
+
+const char* PackedStreamCursor::Read(uint64_t offset, size_t size) {
+  if (offset >= buffer_offset_ &&
+      offset + size <= buffer_offset_ + buffer_size_) {
+    return buffer_ + (offset - buffer_offset_);
+  }
+  // Refill from the block containing offset, reading at least one chunk.
+  const uint64_t start = offset & ~static_cast<uint64_t>(kAlignment - 1);
+  const size_t length = std::max(kChunkSize,
+      (offset + size - start + kAlignment - 1) & ~(kAlignment - 1));
+  if (length > capacity_) {
+    free(buffer_);
+    void* buffer;
+    CHECK_EQ(posix_memalign(&buffer, kAlignment, length), 0);
+    buffer_ = static_cast<char*>(buffer);
+    capacity_ = length;
+  }
+  buffer_offset_ = start;
+  buffer_size_ = 0;
+  while (buffer_size_ < length) {
+    ssize_t n = pread(fd_, buffer_ + buffer_size_, length - buffer_size_,
+        start + buffer_size_);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK_GE(n, 0) << "Failed to read " << source_ << ": " << strerror(errno);
+    if (n == 0) {
+      break;
+    }
+    buffer_size_ += n;
+  }
+  CHECK_LE(offset + size, buffer_offset_ + buffer_size_)
+      << "Truncated record in " << source_;
+#ifdef POSIX_FADV_WILLNEED
+  if (!direct_) {
+    // Start reading the next chunk ahead while this one is consumed.
+    posix_fadvise(fd_, start + buffer_size_, kChunkSize, POSIX_FADV_WILLNEED);
+  }
+#endif
+  return buffer_ + (offset - start);
+}
+
+void PackedTransaction::Put(const string& key, const string& value) {
+  uint32_t header[3];
+  header[0] = key.size();
+  header[1] = value.size();
+  header[2] = Crc32c(value.data(), value.size(),
+      Crc32c(key.data(), key.size()));
+  offsets_.push_back(batch_.size());
+  batch_.append(reinterpret_cast<const char*>(header), kHeaderSize);
+  batch_.append(key);
+  batch_.append(value);
+}
+
+void PackedTransaction::Commit() {
+  if (offsets_.empty()) {
+    return;
+  }
+  // Records go to data before their offsets go to index, so that a reader
+  // never sees an offset without its record.
+  WriteFully(data_fd_, batch_.data(), batch_.size(), "packed db data");
+  for (int i = 0; i < offsets_.size(); ++i) {
+    offsets_[i] += *data_size_;
+  }
+  WriteFully(index_fd_, reinterpret_cast<const char*>(offsets_.data()),
+      offsets_.size() * sizeof(uint64_t), "packed db index");
+  *data_size_ += batch_.size();
+  batch_.clear();
+  offsets_.clear();
+}
+
+void PackedDB::Open(const string& source, Mode mode) {
+  source_ = source;
+  const string data_path = source + "/data";
+  const string index_path = source + "/index";
+  if (mode == NEW) {
+    CHECK_EQ(mkdir(source.c_str(), 0744), 0) << "mkdir " << source << " failed";
+    data_fd_ = CreateFile(data_path, kDataMagic);
+    index_fd_ = CreateFile(index_path, kIndexMagic);
+    data_size_ = kMagicSize;
+  } else {
+    CheckMagic(data_path, kDataMagic);
+    CheckMagic(index_path, kIndexMagic);
+    if (mode == WRITE) {
+      data_fd_ = open(data_path.c_str(), O_WRONLY | O_APPEND);
+      CHECK_GE(data_fd_, 0) << "Failed to open " << data_path;
+      index_fd_ = open(index_path.c_str(), O_WRONLY | O_APPEND);
+      CHECK_GE(index_fd_, 0) << "Failed to open " << index_path;
+      struct stat st;
+      CHECK_EQ(fstat(data_fd_, &st), 0);
+      data_size_ = st.st_size;
+      // Drop a partial offset left by an interrupted commit.
+      CHECK_EQ(fstat(index_fd_, &st), 0);
+      const off_t index_size = kMagicSize +
+          (st.st_size - kMagicSize) / sizeof(uint64_t) * sizeof(uint64_t);
+      CHECK_EQ(ftruncate(index_fd_, index_size), 0);
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Opened packed db " << source;
+}
+
+void PackedDB::Close() {
+  if (data_fd_ >= 0) {
+    CHECK_EQ(fsync(data_fd_), 0) << "Failed to sync " << source_;
+    close(data_fd_);
+    data_fd_ = -1;
+  }
+  if (index_fd_ >= 0) {
+    CHECK_EQ(fsync(index_fd_), 0) << "Failed to sync " << source_;
+    close(index_fd_);
+    index_fd_ = -1;
+  }
+}
+
+PackedCursor* PackedDB::NewCursor() {
+  switch (read_mode_) {
+  case DataParameter_PackedReadMode_STREAM:
+    return new PackedStreamCursor(source_, false);
+  case DataParameter_PackedReadMode_DIRECT:
+    return new PackedStreamCursor(source_, true);
+  default:
+    return new PackedMmapCursor(source_);
+  }
+}
+
+PackedTransaction* PackedDB::NewTransaction() {
+  CHECK_GE(data_fd_, 0) << "Packed db " << source_ << " is not open to write";
+  return new PackedTransaction(data_fd_, index_fd_, &data_size_);
+}
+
+}  // namespace db
+}  // namespace caffe
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "caffe/util/gradient_compressor.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Encodings are padded to that many bytes, so that the values of the
+// encodings gathered from all processes stay aligned.
+static const size_t kAlignment = 8;
+
+static size_t Align(size_t size) {
+  return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+template <typename Dtype>
+GradientCompressor<Dtype>* GradientCompressor<Dtype>::Create(
+    const GradientCompressionParameter& param, size_t size) {
+  switch (param.method()) {
+  case GradientCompressionParameter_Method_NONE:
+    return NULL;
+  case GradientCompressionParameter_Method_TOPK:
+    CHECK(param.topk_ratio() > 0 && param.topk_ratio() <= 1)
+        << "topk_ratio must be in (0, 1]";
+    return new TopKCompressor<Dtype>(param.topk_ratio(), size);
+  case GradientCompressionParameter_Method_QUANTIZE_8BIT:
+    return new QuantizeCompressor<Dtype>();
+  default:
+    LOG(FATAL) << "Unknown gradient compression " << param.method();
+  }
+  return NULL;
+}
+
+template <typename Dtype>
+TopKCompressor<Dtype>::TopKCompressor(float ratio, size_t size)
+    : ratio_(ratio), residual_(size) {
+}
+
+template <typename Dtype>
+size_t TopKCompressor<Dtype>::K(size_t count) const {
+  const size_t k = static_cast<size_t>(std::ceil(ratio_ * count));
+  return std::min(count, std::max<size_t>(k, 1));
+}
+
+template <typename Dtype>
+size_t TopKCompressor<Dtype>::CompressedSize(size_t count) const {
+  return Align(K(count) * (sizeof(Dtype) + sizeof(uint32_t)));
+}
+
+// Orders indices by decreasing magnitude of their values.
+template <typename Dtype>
+struct LargerMagnitude {
+  explicit LargerMagnitude(const Dtype* values) : values_(values) {}
+  bool operator()(uint32_t a, uint32_t b) const {
+    return std::fabs(values_[a]) > std::fabs(values_[b]);
+  }
+  const Dtype* values_;
+};
+
+template <typename Dtype>
+void TopKCompressor<Dtype>::Compress(const Dtype* diff, size_t count,
+    size_t offset, char* data) {
+  CHECK_LE(offset + count, residual_.size());
+  Dtype* residual = &residual_[offset];
+  caffe_axpy<Dtype>(count, Dtype(1), diff, residual);
+  const size_t k = K(count);
+  indices_.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    indices_[i] = i;
+  }
+  std::nth_element(indices_.begin(), indices_.begin() + k - 1,
+      indices_.end(), LargerMagnitude<Dtype>(residual));
+  // The values, then their indices
+  Dtype* values = reinterpret_cast<Dtype*>(data);
+  uint32_t* indices = reinterpret_cast<uint32_t*>(values + k);
+  for (size_t i = 0; i < k; ++i) {
+    indices[i] = indices_[i];
+    values[i] = residual[indices_[i]];
+    residual[indices_[i]] = 0;
+  }
+}
+
+template <typename Dtype>
+void TopKCompressor<Dtype>::Accumulate(const char* data, size_t count,
+    Dtype* diff) const {
+  const size_t k = K(count);
+  const Dtype* values = reinterpret_cast<const Dtype*>(data);
+  const uint32_t* indices = reinterpret_cast<const uint32_t*>(values + k);
+  for (size_t i = 0; i < k; ++i) {
+    diff[indices[i]] += values[i];
+  }
+}
+
+template <typename Dtype>
+size_t QuantizeCompressor<Dtype>::CompressedSize(size_t count) const {
+  return Align(sizeof(Dtype) + count);
+}
+
+template <typename Dtype>
+void QuantizeCompressor<Dtype>::Compress(const Dtype* diff, size_t count,
+    size_t offset, char* data) {
+  // The largest magnitude, then the gradients in steps of 1/127 of it
+  Dtype scale = 0;
+  for (size_t i = 0; i < count; ++i) {
+    scale = std::max<Dtype>(scale, std::fabs(diff[i]));
+  }
+  *reinterpret_cast<Dtype*>(data) = scale;
+  int8_t* quantized = reinterpret_cast<int8_t*>(data + sizeof(Dtype));
+  if (scale == 0) {
+    memset(quantized, 0, count);  // NOLINT(caffe/alt_fn)
+    return;
+  }
+  random_.resize(count);
+  caffe_rng_uniform<Dtype>(count, Dtype(0), Dtype(1), &random_[0]);
+  const Dtype steps = Dtype(127) / scale;
+  for (size_t i = 0; i < count; ++i) {
+    // Rounds down with probability 1 - the fractional part.
+    const Dtype q = std::floor(diff[i] * steps + random_[i]);
+    quantized[i] = static_cast<int8_t>(std::min<Dtype>(q, Dtype(127)));
+  }
+}
+
+template <typename Dtype>
+void QuantizeCompressor<Dtype>::Accumulate(const char* data, size_t count,
+    Dtype* diff) const {
+  const Dtype step = *reinterpret_cast<const Dtype*>(data) / 127;
+  const int8_t* quantized =
+      reinterpret_cast<const int8_t*>(data + sizeof(Dtype));
+  for (size_t i = 0; i < count; ++i) {
+    diff[i] += quantized[i] * step;
+  }
+}
+
+INSTANTIATE_CLASS(GradientCompressor);
+INSTANTIATE_CLASS(TopKCompressor);
+INSTANTIATE_CLASS(QuantizeCompressor);
+
+}  // namespace caffe
@@ -1,10 +1,16 @@
 #include "caffe/util/hdf5.hpp"
 
+#include <boost/thread.hpp>
 #include <string>
 #include <vector>
 
 namespace caffe {
 
+boost::mutex& hdf5_mutex() {
+  static boost::mutex mutex;
+  return mutex;
+}
+
 // Verifies format of data stored in HDF5 file and reshapes blob accordingly.
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
@@ -103,6 +109,71 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
 }
 
+vector<hsize_t> hdf5_get_dataset_dims(hid_t file_id,
+    const char* dataset_name_) {
+  CHECK(H5LTfind_dataset(file_id, dataset_name_))
+      << "Failed to find HDF5 dataset " << dataset_name_;
+  int ndims;
+  herr_t status = H5LTget_dataset_ndims(file_id, dataset_name_, &ndims);
+  CHECK_GE(status, 0) << "Failed to get dataset ndims for " << dataset_name_;
+  CHECK_GE(ndims, 1) << "Dataset " << dataset_name_ << " has no rows";
+  vector<hsize_t> dims(ndims);
+  H5T_class_t class_;
+  status = H5LTget_dataset_info(
+      file_id, dataset_name_, dims.data(), &class_, NULL);
+  CHECK_GE(status, 0) << "Failed to get dataset info for " << dataset_name_;
+  CHECK(class_ == H5T_FLOAT || class_ == H5T_INTEGER)
+      << "Unsupported datatype class for " << dataset_name_;
+  return dims;
+}
+
+// Reads a hyperslab of whole rows, converting them to mem_type.
+template <typename Dtype>
+static void hdf5_load_nd_dataset_rows_helper(hid_t file_id,
+    const char* dataset_name_, hsize_t first_row, hsize_t num_rows,
+    hid_t mem_type, Blob<Dtype>* blob) {
+  vector<hsize_t> dims = hdf5_get_dataset_dims(file_id, dataset_name_);
+  CHECK_GT(num_rows, 0);
+  CHECK_LE(first_row + num_rows, dims[0])
+      << "Rows out of range for dataset " << dataset_name_;
+  vector<hsize_t> start(dims.size(), 0);
+  vector<hsize_t> count(dims);
+  start[0] = first_row;
+  count[0] = num_rows;
+  vector<int> blob_dims(count.begin(), count.end());
+  blob->Reshape(blob_dims);
+
+  hid_t dataset = H5Dopen2(file_id, dataset_name_, H5P_DEFAULT);
+  CHECK_GE(dataset, 0) << "Failed to open dataset " << dataset_name_;
+  hid_t file_space = H5Dget_space(dataset);
+  herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET,
+      start.data(), NULL, count.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of dataset " << dataset_name_;
+  hid_t mem_space = H5Screate_simple(count.size(), count.data(), NULL);
+  status = H5Dread(dataset, mem_type, mem_space, file_space, H5P_DEFAULT,
+      blob->mutable_cpu_data());
+  CHECK_GE(status, 0) << "Failed to read rows of dataset " << dataset_name_;
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<float>(hid_t file_id,
+    const char* dataset_name_, hsize_t first_row, hsize_t num_rows,
+    Blob<float>* blob) {
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, first_row,
+      num_rows, H5T_NATIVE_FLOAT, blob);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<double>(hid_t file_id,
+    const char* dataset_name_, hsize_t first_row, hsize_t num_rows,
+    Blob<double>* blob) {
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, first_row,
+      num_rows, H5T_NATIVE_DOUBLE, blob);
+}
+
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
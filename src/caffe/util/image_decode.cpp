@@ -0,0 +1,393 @@
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#ifdef USE_LIBJPEG_TURBO
+#include <jpeglib.h>
+#endif  // USE_LIBJPEG_TURBO
+#ifdef USE_LIBPNG
+#include <png.h>
+#endif  // USE_LIBPNG
+
+#include <algorithm>
+#include <cstring>
+
+#include "caffe/util/image_decode.hpp"
+
+#if defined(USE_LIBJPEG_TURBO) && !defined(LIBJPEG_TURBO_VERSION)
+#error "USE_LIBJPEG_TURBO requires libjpeg-turbo 1.5 or later"
+#endif
+
+namespace caffe {
+
+int JPEGScaleDenom(int height, int width, int min_height, int min_width) {
+  const int side = std::min(height, width);
+  const int min_side = std::max(min_height, min_width);
+  for (int denom = 8; denom > 1; denom /= 2) {
+    if ((side + denom - 1) / denom >= min_side) {
+      return denom;
+    }
+  }
+  return 1;
+}
+
+#ifdef USE_LIBJPEG_TURBO
+namespace {
+
+// Turns libjpeg errors, which exit by default, into a longjmp.
+struct JPEGErrorManager {
+  struct jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+}  // namespace
+
+static void JPEGErrorExit(j_common_ptr cinfo) {
+  longjmp(reinterpret_cast<JPEGErrorManager*>(cinfo->err)->jump, 1);
+}
+
+static void JPEGOutputMessage(j_common_ptr cinfo) {
+  // Corrupt data is reported by the caller.
+}
+
+static unsigned int ReadExif16(const JOCTET* p, bool little_endian) {
+  return little_endian ? p[0] | (p[1] << 8) : (p[0] << 8) | p[1];
+}
+
+static uint32_t ReadExif32(const JOCTET* p, bool little_endian) {
+  return little_endian ?
+      ReadExif16(p, true) | (static_cast<uint32_t>(ReadExif16(p + 2, true))
+          << 16) :
+      (static_cast<uint32_t>(ReadExif16(p, false)) << 16) |
+          ReadExif16(p + 2, false);
+}
+
+// The orientation tag of the first IFD of an APP1 Exif marker, 1 if none.
+static int ExifOrientation(const JOCTET* data, unsigned int length) {
+  if (length < 14 || memcmp(data, "Exif\0\0", 6) != 0) {
+    return 1;
+  }
+  const JOCTET* tiff = data + 6;
+  const uint32_t tiff_length = length - 6;
+  const bool little_endian = tiff[0] == 'I' && tiff[1] == 'I';
+  if (!little_endian && !(tiff[0] == 'M' && tiff[1] == 'M')) {
+    return 1;
+  }
+  const uint32_t ifd = ReadExif32(tiff + 4, little_endian);
+  if (ifd > tiff_length - 2) {
+    return 1;
+  }
+  const unsigned int entries = ReadExif16(tiff + ifd, little_endian);
+  for (unsigned int i = 0; i < entries; ++i) {
+    const uint32_t entry = ifd + 2 + 12 * i;
+    if (entry + 12 > tiff_length) {
+      break;
+    }
+    if (ReadExif16(tiff + entry, little_endian) == 0x0112) {
+      return ReadExif16(tiff + entry + 8, little_endian);
+    }
+  }
+  return 1;
+}
+
+// Reads the header of a JPEG and sets up its decoding to channels at the
+// scale for min_height and min_width; returns false if cv::imdecode would
+// decode it differently.
+static bool SetUpJPEG(j_decompress_ptr cinfo, const char* data, size_t size,
+    int channels, int min_height, int min_width) {
+  jpeg_mem_src(cinfo,
+      reinterpret_cast<unsigned char*>(const_cast<char*>(data)), size);
+  jpeg_save_markers(cinfo, JPEG_APP0 + 1, 0xFFFF);
+  jpeg_read_header(cinfo, TRUE);
+  if (cinfo->jpeg_color_space != JCS_GRAYSCALE &&
+      cinfo->jpeg_color_space != JCS_YCbCr &&
+      cinfo->jpeg_color_space != JCS_RGB) {
+    return false;
+  }
+  // cv::imdecode applies the EXIF orientation, unless it keeps the image
+  // unchanged.
+  if (channels != 0) {
+    for (jpeg_saved_marker_ptr marker = cinfo->marker_list; marker;
+        marker = marker->next) {
+      if (marker->marker == JPEG_APP0 + 1 &&
+          ExifOrientation(marker->data, marker->data_length) > 1) {
+        return false;
+      }
+    }
+  }
+  if (channels == 0) {
+    channels = cinfo->num_components == 1 ? 1 : 3;
+  }
+  cinfo->out_color_space = channels == 1 ? JCS_GRAYSCALE : JCS_EXT_BGR;
+  if (min_height > 0 && min_width > 0) {
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = JPEGScaleDenom(cinfo->image_height,
+        cinfo->image_width, min_height, min_width);
+  }
+  jpeg_calc_output_dimensions(cinfo);
+  return true;
+}
+
+static bool IsJPEG(const char* data, size_t size) {
+  return size >= 3 && static_cast<unsigned char>(data[0]) == 0xFF &&
+      static_cast<unsigned char>(data[1]) == 0xD8 &&
+      static_cast<unsigned char>(data[2]) == 0xFF;
+}
+
+static bool JPEGShape(const char* data, size_t size, int channels,
+    int min_height, int min_width, int* height, int* width,
+    int* decoded_channels) {
+  struct jpeg_decompress_struct cinfo;
+  JPEGErrorManager error;
+  cinfo.err = jpeg_std_error(&error.pub);
+  error.pub.error_exit = JPEGErrorExit;
+  error.pub.output_message = JPEGOutputMessage;
+  jpeg_create_decompress(&cinfo);
+  if (setjmp(error.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  const bool supported = SetUpJPEG(&cinfo, data, size, channels, min_height,
+      min_width);
+  if (supported) {
+    *height = cinfo.output_height;
+    *width = cinfo.output_width;
+    *decoded_channels = cinfo.out_color_components;
+  }
+  jpeg_destroy_decompress(&cinfo);
+  return supported;
+}
+
+static bool DecodeJPEGRegion(const char* data, size_t size, int channels,
+    int min_height, int min_width, int y, int x, int height, int width,
+    unsigned char* region) {
+  struct jpeg_decompress_struct cinfo;
+  JPEGErrorManager error;
+  cinfo.err = jpeg_std_error(&error.pub);
+  error.pub.error_exit = JPEGErrorExit;
+  error.pub.output_message = JPEGOutputMessage;
+  jpeg_create_decompress(&cinfo);
+  if (setjmp(error.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  if (!SetUpJPEG(&cinfo, data, size, channels, min_height, min_width)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  CHECK(y >= 0 && height > 0 && y + height <= cinfo.output_height &&
+      x >= 0 && width > 0 && x + width <= cinfo.output_width)
+      << "Region " << width << "x" << height << "+" << x << "+" << y
+      << " out of a " << cinfo.output_width << "x" << cinfo.output_height
+      << " image";
+  jpeg_start_decompress(&cinfo);
+  // The crop starts at an iMCU boundary and may be wider than the region.
+  // It spans one more pixel on each side, which the chroma upsampling of
+  // the pixels at the edges of the region reads from.
+  JDIMENSION crop_x = std::max(x - 1, 0);
+  JDIMENSION crop_width = std::min<JDIMENSION>(x + width + 1,
+      cinfo.output_width) - crop_x;
+  jpeg_crop_scanline(&cinfo, &crop_x, &crop_width);
+  if (y > 0 &&
+      jpeg_skip_scanlines(&cinfo, y) != static_cast<JDIMENSION>(y)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  const int row_size = width * cinfo.output_components;
+  const int row_offset = (x - crop_x) * cinfo.output_components;
+  // Allocated in the pool of cinfo, which frees it even after an error.
+  JSAMPARRAY row = (*cinfo.mem->alloc_sarray)(
+      reinterpret_cast<j_common_ptr>(&cinfo), JPOOL_IMAGE,
+      crop_width * cinfo.output_components, 1);
+  for (int h = 0; h < height; ++h) {
+    if (jpeg_read_scanlines(&cinfo, row, 1) != 1) {
+      jpeg_destroy_decompress(&cinfo);
+      return false;
+    }
+    memcpy(region + h * row_size, row[0] + row_offset, row_size);
+  }
+  // The rows below the region are not decoded.
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+#endif  // USE_LIBJPEG_TURBO
+
+#ifdef USE_LIBPNG
+namespace {
+
+// The encoded image libpng reads from.
+struct PNGSource {
+  const char* data;
+  size_t size;
+  size_t offset;
+};
+
+}  // namespace
+
+static void PNGRead(png_structp png, png_bytep out, png_size_t length) {
+  PNGSource* source = static_cast<PNGSource*>(png_get_io_ptr(png));
+  if (length > source->size - source->offset) {
+    png_error(png, "Truncated PNG");
+  }
+  memcpy(out, source->data + source->offset, length);
+  source->offset += length;
+}
+
+static void PNGError(png_structp png, png_const_charp message) {
+  png_longjmp(png, 1);
+}
+
+static void PNGWarning(png_structp png, png_const_charp message) {
+}
+
+// Reads the header of a PNG and sets up its decoding to channels; returns
+// the number of channels it decodes to, or 0 if cv::imdecode would decode
+// it differently.
+static int SetUpPNG(png_structp png, png_infop info, int channels) {
+  png_read_info(png, info);
+  if (png_get_bit_depth(png, info) != 8 ||
+      png_get_interlace_type(png, info) != PNG_INTERLACE_NONE ||
+      png_get_valid(png, info, PNG_INFO_tRNS)) {
+    return 0;
+  }
+  int components;
+  switch (png_get_color_type(png, info)) {
+  case PNG_COLOR_TYPE_GRAY:
+    components = 1;
+    break;
+  case PNG_COLOR_TYPE_RGB:
+    components = 3;
+    break;
+  case PNG_COLOR_TYPE_PALETTE:
+    png_set_palette_to_rgb(png);
+    components = 3;
+    break;
+  default:
+    // With alpha.
+    return 0;
+  }
+  if (channels == 0) {
+    channels = components;
+  }
+  if (channels == 3) {
+    if (components == 1) {
+      png_set_gray_to_rgb(png);
+    }
+    png_set_bgr(png);
+  } else if (components == 3) {
+    // The weights cv::imdecode sets.
+    png_set_rgb_to_gray(png, 1, 0.299, 0.587);
+  }
+  png_read_update_info(png, info);
+  return channels;
+}
+
+static bool IsPNG(const char* data, size_t size) {
+  return size >= 8 && png_sig_cmp(
+      reinterpret_cast<png_const_bytep>(data), 0, 8) == 0;
+}
+
+static bool PNGShape(const char* data, size_t size, int channels,
+    int* height, int* width, int* decoded_channels) {
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+      PNGError, PNGWarning);
+  if (!png) {
+    return false;
+  }
+  png_infop info = png_create_info_struct(png);
+  if (!info || setjmp(png_jmpbuf(png))) {
+    png_destroy_read_struct(&png, &info, NULL);
+    return false;
+  }
+  PNGSource source = {data, size, 0};
+  png_set_read_fn(png, &source, PNGRead);
+  *decoded_channels = SetUpPNG(png, info, channels);
+  *height = png_get_image_height(png, info);
+  *width = png_get_image_width(png, info);
+  png_destroy_read_struct(&png, &info, NULL);
+  return *decoded_channels > 0;
+}
+
+static bool DecodePNGRegion(const char* data, size_t size, int channels,
+    int y, int x, int height, int width, unsigned char* region) {
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+      PNGError, PNGWarning);
+  if (!png) {
+    return false;
+  }
+  png_infop info = png_create_info_struct(png);
+  // Set after setjmp, and freed on errors.
+  png_bytep volatile row = NULL;
+  if (!info || setjmp(png_jmpbuf(png))) {
+    png_free(png, row);
+    png_destroy_read_struct(&png, &info, NULL);
+    return false;
+  }
+  PNGSource source = {data, size, 0};
+  png_set_read_fn(png, &source, PNGRead);
+  const int decoded_channels = SetUpPNG(png, info, channels);
+  if (decoded_channels == 0) {
+    png_destroy_read_struct(&png, &info, NULL);
+    return false;
+  }
+  const int image_height = png_get_image_height(png, info);
+  const int image_width = png_get_image_width(png, info);
+  CHECK(y >= 0 && height > 0 && y + height <= image_height &&
+      x >= 0 && width > 0 && x + width <= image_width)
+      << "Region " << width << "x" << height << "+" << x << "+" << y
+      << " out of a " << image_width << "x" << image_height << " image";
+  row = static_cast<png_bytep>(png_malloc(png, png_get_rowbytes(png, info)));
+  for (int h = 0; h < y; ++h) {
+    png_read_row(png, row, NULL);
+  }
+  const int row_size = width * decoded_channels;
+  for (int h = 0; h < height; ++h) {
+    png_read_row(png, row, NULL);
+    memcpy(region + h * row_size, row + x * decoded_channels, row_size);
+  }
+  // The rows below the region are not inflated.
+  png_free(png, row);
+  png_destroy_read_struct(&png, &info, NULL);
+  return true;
+}
+#endif  // USE_LIBPNG
+
+bool DecodedImageShape(const char* data, size_t size, int channels,
+    int min_height, int min_width, int* height, int* width,
+    int* decoded_channels) {
+  CHECK(channels == 0 || channels == 1 || channels == 3)
+      << "Cannot decode images to " << channels << " channels";
+#ifdef USE_LIBJPEG_TURBO
+  if (IsJPEG(data, size)) {
+    return JPEGShape(data, size, channels, min_height, min_width, height,
+        width, decoded_channels);
+  }
+#endif  // USE_LIBJPEG_TURBO
+#ifdef USE_LIBPNG
+  if (IsPNG(data, size)) {
+    return PNGShape(data, size, channels, height, width, decoded_channels);
+  }
+#endif  // USE_LIBPNG
+  return false;
+}
+
+bool DecodeImageRegion(const char* data, size_t size, int channels,
+    int min_height, int min_width, int y, int x, int height, int width,
+    unsigned char* region) {
+  CHECK(channels == 0 || channels == 1 || channels == 3)
+      << "Cannot decode images to " << channels << " channels";
+#ifdef USE_LIBJPEG_TURBO
+  if (IsJPEG(data, size)) {
+    return DecodeJPEGRegion(data, size, channels, min_height, min_width, y,
+        x, height, width, region);
+  }
+#endif  // USE_LIBJPEG_TURBO
+#ifdef USE_LIBPNG
+  if (IsPNG(data, size)) {
+    return DecodePNGRegion(data, size, channels, y, x, height, width,
+        region);
+  }
+#endif  // USE_LIBPNG
+  return false;
+}
+
+}  // namespace caffe
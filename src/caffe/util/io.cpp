@@ -9,14 +9,19 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
 
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/image_decode.hpp"
 #include "caffe/util/io.hpp"
 
 const int kProtoReadBytesLimit = INT_MAX;  // Max size of 2 GB minus 1 byte.
@@ -69,15 +74,117 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   CHECK(proto.SerializeToOstream(&output));
 }
 
+void SyncAndRename(const string& temp, const string& filename) {
+  int fd = open(temp.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "Failed to open " << temp << ": " << strerror(errno);
+  CHECK_EQ(fsync(fd), 0) << "Failed to flush " << temp << ": "
+      << strerror(errno);
+  close(fd);
+  CHECK_EQ(rename(temp.c_str(), filename.c_str()), 0) << "Failed to rename "
+      << temp << " to " << filename << ": " << strerror(errno);
+}
+
 #ifdef USE_OPENCV
+// cv::IMREAD_REDUCED_* decodes JPEGs at a reduced scale since OpenCV 3.2.
+#if CV_MAJOR_VERSION > 3 || (CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 2)
+// Reads the size and the number of components of a baseline, extended or
+// progressive JPEG from its frame header, without decoding it.
+static bool ReadJPEGHeader(const char* data, const size_t size,
+    int* height, int* width, int* components) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  if (size < 4 || p[0] != 0xFF || p[1] != 0xD8) {
+    return false;
+  }
+  size_t i = 2;
+  while (i + 4 <= size && p[i] == 0xFF) {
+    const unsigned char marker = p[i + 1];
+    if (marker == 0xFF) {
+      // Fill byte.
+      ++i;
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+      // Markers without a payload.
+      i += 2;
+      continue;
+    }
+    if (marker >= 0xC0 && marker <= 0xC2) {
+      if (i + 10 > size) {
+        return false;
+      }
+      *height = (p[i + 5] << 8) | p[i + 6];
+      *width = (p[i + 7] << 8) | p[i + 8];
+      *components = p[i + 9];
+      return *height > 0 && *width > 0;
+    }
+    if (marker == 0xD9 || marker == 0xDA || (marker >= 0xC3 &&
+        marker <= 0xCF && marker != 0xC4 && marker != 0xC8 &&
+        marker != 0xCC)) {
+      // End of image or start of scan before any frame header, or a
+      // lossless or arithmetic coded frame: decode it at full size.
+      return false;
+    }
+    i += 2 + ((p[i + 2] << 8) | p[i + 3]);
+  }
+  return false;
+}
+#endif
+
+cv::Mat DecodeImageToCVMat(const char* data, const size_t size,
+    const int cv_read_flag, const int min_height, const int min_width) {
+  int flag = cv_read_flag;
+#if CV_MAJOR_VERSION > 3 || (CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 2)
+  int height, width, components;
+  if (min_height > 0 && min_width > 0 &&
+      ReadJPEGHeader(data, size, &height, &width, &components) &&
+      (cv_read_flag >= 0 || components == 1 || components == 3)) {
+    const int denom = JPEGScaleDenom(height, width, min_height, min_width);
+    if (denom > 1) {
+      flag = (denom == 2 ? cv::IMREAD_REDUCED_GRAYSCALE_2 :
+          denom == 4 ? cv::IMREAD_REDUCED_GRAYSCALE_4 :
+          cv::IMREAD_REDUCED_GRAYSCALE_8);
+      if (cv_read_flag < 0) {
+        // Keep the native channels, and the raw orientation of
+        // CV_LOAD_IMAGE_UNCHANGED.
+        flag |= cv::IMREAD_IGNORE_ORIENTATION;
+        if (components == 3) {
+          flag |= cv::IMREAD_COLOR;
+        }
+      } else if (cv_read_flag == CV_LOAD_IMAGE_COLOR) {
+        flag |= cv::IMREAD_COLOR;
+      }
+    }
+  }
+#endif
+  const cv::Mat buf(1, static_cast<int>(size), CV_8UC1,
+      const_cast<char*>(data));
+  return cv::imdecode(buf, flag);
+}
+
+cv::Mat ReadImageToCVMatAtLeast(const string& filename,
+    const int min_height, const int min_width, const bool is_color) {
+  int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
+    CV_LOAD_IMAGE_GRAYSCALE);
+  cv::Mat cv_img;
+  string buffer;
+  if (min_height > 0 && min_width > 0 && ReadFileToString(filename, &buffer)) {
+    cv_img = DecodeImageToCVMat(buffer.data(), buffer.size(), cv_read_flag,
+        min_height, min_width);
+  } else {
+    cv_img = cv::imread(filename, cv_read_flag);
+  }
+  if (!cv_img.data) {
+    LOG(ERROR) << "Could not open or find file " << filename;
+  }
+  return cv_img;
+}
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color) {
   cv::Mat cv_img;
-  int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
-    CV_LOAD_IMAGE_GRAYSCALE);
-  cv::Mat cv_img_origin = cv::imread(filename, cv_read_flag);
+  cv::Mat cv_img_origin = ReadImageToCVMatAtLeast(filename, height, width,
+      is_color);
   if (!cv_img_origin.data) {
-    LOG(ERROR) << "Could not open or find file " << filename;
     return cv_img_origin;
   }
   if (height > 0 && width > 0) {
@@ -142,18 +249,25 @@ bool ReadImageToDatum(const string& filename, const int label,
 }
 #endif  // USE_OPENCV
 
-bool ReadFileToDatum(const string& filename, const int label,
-    Datum* datum) {
+bool ReadFileToString(const string& filename, string* buffer) {
   std::streampos size;
 
   fstream file(filename.c_str(), ios::in|ios::binary|ios::ate);
   if (file.is_open()) {
     size = file.tellg();
-    std::string buffer(size, ' ');
+    buffer->resize(size);
     file.seekg(0, ios::beg);
-    file.read(&buffer[0], size);
+    file.read(&(*buffer)[0], size);
     file.close();
-    datum->set_data(buffer);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+bool ReadFileToDatum(const string& filename, const int label,
+    Datum* datum) {
+  if (ReadFileToString(filename, datum->mutable_data())) {
     datum->set_label(label);
     datum->set_encoded(true);
     return true;
@@ -163,25 +277,27 @@ bool ReadFileToDatum(const string& filename, const int label,
 }
 
 #ifdef USE_OPENCV
-cv::Mat DecodeDatumToCVMatNative(const Datum& datum) {
+cv::Mat DecodeDatumToCVMatNative(const Datum& datum,
+    const int min_height, const int min_width) {
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
   const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
-  cv_img = cv::imdecode(vec_data, -1);
+  cv_img = DecodeImageToCVMat(data.data(), data.size(), -1,
+      min_height, min_width);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
   return cv_img;
 }
-cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
+cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color,
+    const int min_height, const int min_width) {
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
   const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
   int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
     CV_LOAD_IMAGE_GRAYSCALE);
-  cv_img = cv::imdecode(vec_data, cv_read_flag);
+  cv_img = DecodeImageToCVMat(data.data(), data.size(), cv_read_flag,
+      min_height, min_width);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
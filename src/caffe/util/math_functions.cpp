@@ -1,6 +1,7 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <cstring>
 #include <limits>
 
 #include "caffe/common.hpp"
@@ -382,4 +383,31 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+static inline float round_bf16(float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  // NaNs stay NaNs, instead of rounding to infinity.
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return x;
+  }
+  bits += 0x7fff + ((bits >> 16) & 1);
+  bits &= 0xffff0000;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+template <>
+void caffe_cpu_round_bf16<float>(const int n, float* x) {
+  for (int i = 0; i < n; ++i) {
+    x[i] = round_bf16(x[i]);
+  }
+}
+
+template <>
+void caffe_cpu_round_bf16<double>(const int n, double* x) {
+  for (int i = 0; i < n; ++i) {
+    x[i] = round_bf16(static_cast<float>(x[i]));
+  }
+}
+
 }  // namespace caffe
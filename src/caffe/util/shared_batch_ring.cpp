@@ -0,0 +1,206 @@
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "caffe/util/shared_batch_ring.hpp"
+
+namespace caffe {
+
+// The states of the slots are the reference, the semaphores only wake up the
+// processes waiting for them to change: a worker dying at any point cannot
+// leave a slot unaccounted for.
+struct SharedBatchRing::Header {
+  pthread_mutex_t mutex;
+  sem_t free_slots;
+  sem_t full_slots;
+  int shutdown;
+  uint64_t next_seq;
+};
+
+struct SharedBatchRing::Slot {
+  enum State { FREE = 0, FILLING, FULL, IN_USE };
+  int state;
+  // The process that last took the slot.
+  pid_t owner;
+  // Fill order of full slots.
+  uint64_t seq;
+};
+
+// Slot data is aligned on cache lines.
+static const size_t kAlignment = 64;
+
+static size_t Align(size_t size) {
+  return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+// The absolute time timeout_ms from now, for sem_timedwait.
+static struct timespec Deadline(int timeout_ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  return deadline;
+}
+
+SharedBatchRing::SharedBatchRing(int num_slots, size_t slot_bytes,
+    int num_workers)
+    : num_slots_(num_slots), slot_bytes_(Align(slot_bytes)),
+      num_workers_(num_workers), creator_(getpid()) {
+  CHECK_GT(num_slots, 0);
+  CHECK_GT(num_workers, 0);
+  const size_t header_bytes = Align(sizeof(Header) +
+      num_slots * sizeof(Slot) + num_workers * sizeof(pid_t));
+  mapped_bytes_ = header_bytes + num_slots_ * slot_bytes_;
+  void* memory = mmap(NULL, mapped_bytes_, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  CHECK(memory != MAP_FAILED) << "Could not map " << mapped_bytes_
+      << " bytes of shared memory: " << strerror(errno);
+  header_ = static_cast<Header*>(memory);
+  data_ = static_cast<char*>(memory) + header_bytes;
+
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  CHECK_EQ(pthread_mutex_init(&header_->mutex, &attr), 0);
+  pthread_mutexattr_destroy(&attr);
+  CHECK_EQ(sem_init(&header_->free_slots, 1, num_slots), 0);
+  CHECK_EQ(sem_init(&header_->full_slots, 1, 0), 0);
+  header_->shutdown = 0;
+  header_->next_seq = 0;
+  // The mapping is zero filled: every slot is free, no worker is known.
+}
+
+SharedBatchRing::~SharedBatchRing() {
+  if (getpid() == creator_) {
+    sem_destroy(&header_->free_slots);
+    sem_destroy(&header_->full_slots);
+    pthread_mutex_destroy(&header_->mutex);
+  }
+  munmap(header_, mapped_bytes_);
+}
+
+SharedBatchRing::Slot* SharedBatchRing::slots() const {
+  return reinterpret_cast<Slot*>(header_ + 1);
+}
+
+pid_t* SharedBatchRing::worker_pids() const {
+  return reinterpret_cast<pid_t*>(slots() + num_slots_);
+}
+
+void SharedBatchRing::Lock() {
+  const int result = pthread_mutex_lock(&header_->mutex);
+  if (result == EOWNERDEAD) {
+    // The owner died between two consistent updates of the slots.
+    pthread_mutex_consistent(&header_->mutex);
+  } else {
+    CHECK_EQ(result, 0) << strerror(result);
+  }
+}
+
+void SharedBatchRing::Unlock() {
+  pthread_mutex_unlock(&header_->mutex);
+}
+
+int SharedBatchRing::Take(int state, int new_state) {
+  Lock();
+  int slot = -1;
+  for (int i = 0; i < num_slots_; ++i) {
+    if (slots()[i].state == state &&
+        (slot < 0 || slots()[i].seq < slots()[slot].seq)) {
+      slot = i;
+    }
+  }
+  if (slot >= 0) {
+    slots()[slot].state = new_state;
+    slots()[slot].owner = getpid();
+  }
+  Unlock();
+  return slot;
+}
+
+void SharedBatchRing::Wait(sem_t* sem, int timeout_ms) {
+  const struct timespec deadline = Deadline(timeout_ms);
+  if (sem_timedwait(sem, &deadline) != 0) {
+    CHECK(errno == ETIMEDOUT || errno == EINTR) << strerror(errno);
+  }
+}
+
+int SharedBatchRing::AcquireFree() {
+  // Wake up regularly to notice a shutdown.
+  while (!shutting_down()) {
+    const int slot = Take(Slot::FREE, Slot::FILLING);
+    if (slot >= 0) {
+      return slot;
+    }
+    Wait(&header_->free_slots, 100);
+  }
+  return -1;
+}
+
+void SharedBatchRing::PushFull(int slot) {
+  Lock();
+  CHECK_EQ(slots()[slot].state, Slot::FILLING);
+  slots()[slot].state = Slot::FULL;
+  slots()[slot].seq = header_->next_seq++;
+  Unlock();
+  sem_post(&header_->full_slots);
+}
+
+int SharedBatchRing::PopFull(int timeout_ms) {
+  int slot = Take(Slot::FULL, Slot::IN_USE);
+  if (slot < 0) {
+    Wait(&header_->full_slots, timeout_ms);
+    slot = Take(Slot::FULL, Slot::IN_USE);
+  }
+  return slot;
+}
+
+void SharedBatchRing::Release(int slot) {
+  Lock();
+  CHECK_EQ(slots()[slot].state, Slot::IN_USE);
+  slots()[slot].state = Slot::FREE;
+  Unlock();
+  sem_post(&header_->free_slots);
+}
+
+void SharedBatchRing::Reclaim(pid_t pid) {
+  Lock();
+  for (int i = 0; i < num_slots_; ++i) {
+    if (slots()[i].state == Slot::FILLING && slots()[i].owner == pid) {
+      slots()[i].state = Slot::FREE;
+    }
+  }
+  Unlock();
+  sem_post(&header_->free_slots);
+}
+
+void SharedBatchRing::Shutdown() {
+  __atomic_store_n(&header_->shutdown, 1, __ATOMIC_RELEASE);
+}
+
+bool SharedBatchRing::shutting_down() const {
+  return __atomic_load_n(&header_->shutdown, __ATOMIC_ACQUIRE);
+}
+
+void SharedBatchRing::set_worker_pid(int worker, pid_t pid) {
+  CHECK_LT(worker, num_workers_);
+  __atomic_store_n(&worker_pids()[worker], pid, __ATOMIC_RELEASE);
+}
+
+pid_t SharedBatchRing::worker_pid(int worker) const {
+  CHECK_LT(worker, num_workers_);
+  return __atomic_load_n(&worker_pids()[worker], __ATOMIC_ACQUIRE);
+}
+
+}  // namespace caffe
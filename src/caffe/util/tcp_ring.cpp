@@ -0,0 +1,313 @@
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/format.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/tcp_ring.hpp"
+
+namespace caffe {
+
+// How long to wait for the other processes to start.
+static const int kConnectTimeoutMs = 600000;
+static const int kRetryMs = 100;
+// Broadcast is pipelined down the ring in chunks of that many bytes.
+static const size_t kBroadcastChunk = 1 << 20;
+
+static void ParseAddress(const string& address, string* host, int* port) {
+  const size_t colon = address.rfind(':');
+  CHECK(colon != string::npos && colon + 1 < address.size())
+      << "Expected host:port, got '" << address << "'";
+  *host = address.substr(0, colon);
+  *port = atoi(address.c_str() + colon + 1);
+  CHECK_GT(*port, 0) << "Invalid port in '" << address << "'";
+}
+
+// Listens on all interfaces, on port or on any free port if 0, and returns
+// the socket and the port.
+static int Listen(int* port) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  CHECK_GE(fd, 0) << "Failed to create socket: " << strerror(errno);
+  const int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(*port);
+  CHECK_EQ(bind(fd, reinterpret_cast<struct sockaddr*>(&address),
+      sizeof(address)), 0) << "Failed to bind port " << *port << ": "
+      << strerror(errno);
+  CHECK_EQ(listen(fd, 1), 0) << "Failed to listen: " << strerror(errno);
+  socklen_t length = sizeof(address);
+  CHECK_EQ(getsockname(fd, reinterpret_cast<struct sockaddr*>(&address),
+      &length), 0) << strerror(errno);
+  *port = ntohs(address.sin_port);
+  return fd;
+}
+
+// Returns a socket connected to host:port, or -1.
+static int TryConnect(const string& host, int port) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* addresses;
+  if (getaddrinfo(host.c_str(), format_int(port).c_str(), &hints,
+      &addresses) != 0) {
+    return -1;
+  }
+  int fd = -1;
+  for (struct addrinfo* a = addresses; a && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  return fd;
+}
+
+// Reads the address a process published in a rendezvous file, if it did.
+static bool ReadAddress(const string& filename, string* host, int* port) {
+  std::ifstream file(filename.c_str());
+  string address;
+  if (!(file >> address)) {
+    return false;
+  }
+  ParseAddress(address, host, port);
+  return true;
+}
+
+static void SetNoDelay(int fd) {
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+TCPRing::TCPRing(int rank, int world, const string& rendezvous)
+    : rank_(rank), world_(world), next_(-1), prev_(-1), bytes_sent_(0) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, world);
+  if (world == 1) {
+    return;
+  }
+  const int next = (rank + 1) % world;
+  const int prev = (rank + world - 1) % world;
+  const string kFile = "file:";
+  const bool from_file = rendezvous.compare(0, kFile.size(), kFile) == 0;
+  vector<string> addresses;
+  string host;
+  int port = 0;
+  if (!from_file) {
+    for (size_t begin = 0; begin <= rendezvous.size();) {
+      size_t end = rendezvous.find(',', begin);
+      end = end == string::npos ? rendezvous.size() : end;
+      addresses.push_back(rendezvous.substr(begin, end - begin));
+      begin = end + 1;
+    }
+    CHECK_EQ(addresses.size(), world)
+        << "Expected the host:port of each of the " << world << " processes";
+    ParseAddress(addresses[rank], &host, &port);
+  }
+  const int listen_fd = Listen(&port);
+  string prefix;
+  if (from_file) {
+    // Publish our address, atomically for the other processes polling.
+    prefix = rendezvous.substr(kFile.size());
+    char hostname[256];
+    CHECK_EQ(gethostname(hostname, sizeof(hostname)), 0) << strerror(errno);
+    hostname[sizeof(hostname) - 1] = 0;
+    published_ = prefix + "." + format_int(rank);
+    const string temp = published_ + ".tmp";
+    {
+      std::ofstream file(temp.c_str());
+      file << hostname << ":" << port << std::endl;
+      CHECK(file.good()) << "Failed to write " << temp;
+    }
+    CHECK_EQ(rename(temp.c_str(), published_.c_str()), 0)
+        << "Failed to write " << published_ << ": " << strerror(errno);
+  }
+  // Every process listens before connecting, so connections complete in the
+  // listen backlog before the previous rank is accepted. The rendezvous file
+  // is read again on every attempt, as it may be left from an earlier job.
+  for (int waited = 0; next_ < 0; waited += kRetryMs) {
+    string next_host;
+    int next_port;
+    bool known = true;
+    if (from_file) {
+      known = ReadAddress(prefix + "." + format_int(next), &next_host,
+          &next_port);
+    } else {
+      ParseAddress(addresses[next], &next_host, &next_port);
+    }
+    if (known) {
+      next_ = TryConnect(next_host, next_port);
+    }
+    if (next_ < 0) {
+      CHECK_LT(waited, kConnectTimeoutMs) << "Timed out connecting to rank "
+          << next;
+      usleep(kRetryMs * 1000);
+    }
+  }
+  SetNoDelay(next_);
+  const int32_t me = rank;
+  SendRecv(&me, sizeof(me), NULL, 0);
+  prev_ = accept(listen_fd, NULL, NULL);
+  CHECK_GE(prev_, 0) << "Failed to accept rank " << prev << ": "
+      << strerror(errno);
+  close(listen_fd);
+  SetNoDelay(prev_);
+  int32_t them;
+  SendRecv(NULL, 0, &them, sizeof(them));
+  CHECK_EQ(them, prev) << "Rank " << rank << " was connected to by rank "
+      << them << " instead of " << prev;
+  bytes_sent_ = 0;
+}
+
+TCPRing::~TCPRing() {
+  if (next_ >= 0) {
+    close(next_);
+  }
+  if (prev_ >= 0) {
+    close(prev_);
+  }
+  if (!published_.empty()) {
+    remove(published_.c_str());
+  }
+}
+
+void TCPRing::SendRecv(const void* send_data, size_t send_size,
+    void* recv_data, size_t recv_size) {
+  const char* send_bytes = static_cast<const char*>(send_data);
+  char* recv_bytes = static_cast<char*>(recv_data);
+  size_t sent = 0;
+  size_t received = 0;
+  while (sent < send_size || received < recv_size) {
+    struct pollfd fds[2];
+    int num_fds = 0;
+    if (sent < send_size) {
+      fds[num_fds].fd = next_;
+      fds[num_fds].events = POLLOUT;
+      fds[num_fds++].revents = 0;
+    }
+    if (received < recv_size) {
+      fds[num_fds].fd = prev_;
+      fds[num_fds].events = POLLIN;
+      fds[num_fds++].revents = 0;
+    }
+    if (poll(fds, num_fds, -1) < 0) {
+      CHECK_EQ(errno, EINTR) << "Failed to poll: " << strerror(errno);
+      continue;
+    }
+    for (int i = 0; i < num_fds; ++i) {
+      if (!fds[i].revents) {
+        continue;
+      }
+      ssize_t result;
+      if (fds[i].fd == next_) {
+        result = send(next_, send_bytes + sent, send_size - sent,
+            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (result > 0) {
+          sent += result;
+        }
+      } else {
+        result = recv(prev_, recv_bytes + received, recv_size - received,
+            MSG_DONTWAIT);
+        CHECK_NE(result, 0) << "Rank " << (rank_ + world_ - 1) % world_
+            << " closed its connection";
+        if (result > 0) {
+          received += result;
+        }
+      }
+      CHECK(result >= 0 || errno == EAGAIN || errno == EWOULDBLOCK ||
+          errno == EINTR) << "Failed to exchange with the ring: "
+          << strerror(errno);
+    }
+  }
+  bytes_sent_ += send_size;
+}
+
+template <typename Dtype>
+void TCPRing::Broadcast(Dtype* data, size_t count) {
+  if (world_ == 1) {
+    return;
+  }
+  char* bytes = reinterpret_cast<char*>(data);
+  const size_t size = count * sizeof(Dtype);
+  const bool send = rank_ + 1 < world_;
+  for (size_t offset = 0; offset < size; offset += kBroadcastChunk) {
+    const size_t chunk = std::min(kBroadcastChunk, size - offset);
+    if (rank_ > 0) {
+      SendRecv(NULL, 0, bytes + offset, chunk);
+    }
+    if (send) {
+      SendRecv(bytes + offset, chunk, NULL, 0);
+    }
+  }
+}
+
+template <typename Dtype>
+void TCPRing::AllReduce(Dtype* data, size_t count) {
+  if (world_ == 1 || count == 0) {
+    return;
+  }
+  // The buffer is cut in world parts, part i starting at begin[i].
+  vector<size_t> begin(world_ + 1);
+  for (int i = 0; i <= world_; ++i) {
+    begin[i] = count * i / world_;
+  }
+  buffer_.resize((count + world_ - 1) / world_ * sizeof(Dtype));
+  Dtype* received = reinterpret_cast<Dtype*>(&buffer_[0]);
+  // Reduce-scatter: at step s, each rank adds the part it receives to its
+  // own, and passes it on at step s + 1. After world - 1 steps, rank holds
+  // the sum of part rank + 1.
+  for (int s = 0; s < world_ - 1; ++s) {
+    const int send = (rank_ - s + world_) % world_;
+    const int recv = (rank_ - s - 1 + world_) % world_;
+    const size_t n = begin[recv + 1] - begin[recv];
+    SendRecv(data + begin[send], (begin[send + 1] - begin[send]) *
+        sizeof(Dtype), received, n * sizeof(Dtype));
+    caffe_axpy<Dtype>(n, Dtype(1), received, data + begin[recv]);
+  }
+  // All-gather: the sums go around the ring.
+  for (int s = 0; s < world_ - 1; ++s) {
+    const int send = (rank_ + 1 - s + world_) % world_;
+    const int recv = (rank_ - s + world_) % world_;
+    SendRecv(data + begin[send], (begin[send + 1] - begin[send]) *
+        sizeof(Dtype), data + begin[recv], (begin[recv + 1] - begin[recv]) *
+        sizeof(Dtype));
+  }
+}
+
+void TCPRing::AllGather(const char* data, size_t size, char* gathered) {
+  if (gathered + rank_ * size != data) {
+    memcpy(gathered + rank_ * size, data, size);  // NOLINT(caffe/alt_fn)
+  }
+  // At step s, each rank passes on the block it received at step s - 1.
+  for (int s = 0; s < world_ - 1; ++s) {
+    const int send = (rank_ - s + world_) % world_;
+    const int recv = (rank_ - s - 1 + world_) % world_;
+    SendRecv(gathered + send * size, size, gathered + recv * size, size);
+  }
+}
+
+template void TCPRing::Broadcast<float>(float* data, size_t count);
+template void TCPRing::Broadcast<double>(double* data, size_t count);
+template void TCPRing::AllReduce<float>(float* data, size_t count);
+template void TCPRing::AllReduce<double>(double* data, size_t count);
+
+}  // namespace caffe
@@ -6,6 +6,7 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <cstdlib>
 #include <cstring>
 #include <map>
 #include <string>
@@ -30,6 +31,20 @@ DEFINE_string(gpu, "",
     "Optional; run in GPU mode on given device IDs separated by ','."
     "Use '-gpu all' to run on all available GPUs. The effective training "
     "batch size is multiplied by the number of devices.");
+DEFINE_int32(threads, 1,
+    "Optional; train in CPU mode on that many threads, each running a "
+    "replica of the net. The effective training batch size is multiplied by "
+    "the number of threads.");
+DEFINE_bool(hogwild, false,
+    "Optional; with -threads, train asynchronously instead: each thread "
+    "runs a solver of its own, and updates the shared weights without "
+    "locks.");
+DEFINE_string(rendezvous, "",
+    "Optional; train in CPU mode in several processes connected over TCP, "
+    "ranked by the CAFFE_RANK and CAFFE_WORLD_SIZE environment variables. "
+    "Either 'file:' and a path prefix all the processes can write, or the "
+    "host:port of each process by rank, separated by ','. The effective "
+    "training batch size is multiplied by the number of processes.");
 DEFINE_string(solver, "",
     "The solver definition protocol buffer text file.");
 DEFINE_string(model, "",
@@ -207,10 +222,25 @@ int train() {
 
   vector<int> gpus;
   get_gpus(&gpus);
+  CHECK_GE(FLAGS_threads, 1) << "Need at least one thread to train.";
   if (gpus.size() == 0) {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    Caffe::set_solver_count(FLAGS_threads);
+    if (FLAGS_rendezvous.size()) {
+      CHECK_EQ(FLAGS_threads, 1) << "Train with either threads or processes.";
+      const char* rank = getenv("CAFFE_RANK");
+      const char* world = getenv("CAFFE_WORLD_SIZE");
+      CHECK(rank && world) << "Set CAFFE_RANK and CAFFE_WORLD_SIZE to train "
+          "in several processes.";
+      Caffe::set_solver_count(boost::lexical_cast<int>(world));
+      Caffe::set_solver_rank(boost::lexical_cast<int>(rank));
+      Caffe::set_multiprocess(true);
+      LOG(INFO) << "Process " << rank << " of " << world;
+    }
   } else {
+    CHECK_EQ(FLAGS_threads, 1) << "Multi-threaded training is CPU only.";
+    CHECK_EQ(FLAGS_rendezvous.size(), 0) << "TCP training is CPU only.";
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
       s << (i ? ", " : "") << gpus[i];
@@ -253,6 +283,15 @@ int train() {
 #else
     LOG(FATAL) << "Multi-GPU execution not available - rebuild with USE_NCCL";
 #endif
+  } else if (FLAGS_rendezvous.size()) {
+    caffe::TCPComm<float> comm(solver, FLAGS_rendezvous);
+    comm.Run();
+  } else if (FLAGS_threads > 1 && FLAGS_hogwild) {
+    caffe::Hogwild<float> hogwild(solver);
+    hogwild.Run();
+  } else if (FLAGS_threads > 1) {
+    caffe::CPUParallel<float> parallel(solver);
+    parallel.Run();
   } else {
     solver->Solve();
   }
@@ -421,6 +460,21 @@ int time() {
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  if (caffe_net.checkpoint_activations()) {
+    // The layers above ran once each, while Backward recomputes activations.
+    Timer net_timer;
+    net_timer.Start();
+    for (int j = 0; j < FLAGS_iterations; ++j) {
+      caffe_net.Forward();
+      caffe_net.Backward();
+    }
+    LOG(INFO) << "Average Forward-Backward with recomputation: "
+      << net_timer.MilliSeconds() / FLAGS_iterations << " ms.";
+    size_t total, peak;
+    caffe_net.ActivationMemory(&total, &peak);
+    LOG(INFO) << "Activation memory: " << peak / 1048576. << " MB at once "
+      << "instead of " << total / 1048576. << " MB.";
+  }
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <string>
 #include <utility>
@@ -9,6 +10,7 @@
 #include "glog/logging.h"
 
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/compression.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
 
@@ -19,7 +21,130 @@ using std::pair;
 using boost::scoped_ptr;
 
 DEFINE_string(backend, "lmdb",
-        "The backend {leveldb, lmdb} containing the images");
+        "The backend {leveldb, lmdb, packed} containing the images");
+DEFINE_int32(threads, 0,
+    "Number of threads decoding and summing images; 0 to use one per core");
+DEFINE_bool(channel_mean, false,
+    "Only compute the mean of each channel, as used by mean_value, without "
+    "a mean image. Images may then be of different sizes");
+
+#ifdef USE_OPENCV
+// Sums the images of every step-th record of a db, starting with the
+// first-th, in double precision. Bytes are first summed into 32-bit
+// integers, in loops simple enough for the compiler to vectorize.
+class MeanAccumulator {
+ public:
+  MeanAccumulator(db::Cursor* cursor, int first, int step, int channels,
+      int data_size, boost::mutex* progress_mutex, int* progress)
+      : cursor_(cursor), first_(first), step_(step), channels_(channels),
+        data_size_(data_size), count_(0), pixels_(0), unflushed_(0),
+        progress_mutex_(progress_mutex), progress_(progress) {
+    if (FLAGS_channel_mean) {
+      sum_.resize(channels, 0.);
+    } else {
+      sum_.resize(data_size, 0.);
+      byte_sum_.resize(data_size, 0);
+    }
+  }
+
+  void Run() {
+    for (int i = 0; i < first_ && cursor_->valid(); ++i) {
+      cursor_->Next();
+    }
+    Datum datum;
+    while (cursor_->valid()) {
+      datum.ParseFromString(cursor_->value());
+      DecodeDatumNative(&datum);
+      DecompressDatum(&datum);
+      Add(datum);
+      if (++count_ % 1000 == 0) {
+        boost::mutex::scoped_lock lock(*progress_mutex_);
+        *progress_ += 1000;
+        if (*progress_ % 10000 == 0) {
+          LOG(INFO) << "Processed " << *progress_ << " files.";
+        }
+      }
+      for (int i = 0; i < step_ && cursor_->valid(); ++i) {
+        cursor_->Next();
+      }
+    }
+    Flush();
+  }
+
+  const std::vector<double>& sum() const { return sum_; }
+  int count() const { return count_; }
+  int64_t pixels() const { return pixels_; }
+
+ protected:
+  // byte_sum_ cannot overflow before 2^32 / 255 images are summed.
+  static const int kFlushEvery = 1 << 24;
+
+  void Add(const Datum& datum) {
+    const std::string& data = datum.data();
+    const int size_in_datum = max<int>(data.size(), datum.float_data_size());
+    if (FLAGS_channel_mean) {
+      CHECK_EQ(datum.channels(), channels_) << "Incorrect number of channels "
+          << datum.channels();
+      CHECK_EQ(size_in_datum % channels_, 0) << "Incorrect data field size "
+          << size_in_datum;
+    } else {
+      CHECK_EQ(size_in_datum, data_size_) << "Incorrect data field size "
+          << size_in_datum;
+    }
+    if (data.size() != 0) {
+      CHECK_EQ(data.size(), size_in_datum);
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+      if (FLAGS_channel_mean) {
+        const int dim = size_in_datum / channels_;
+        for (int c = 0; c < channels_; ++c) {
+          uint64_t channel_sum = 0;
+          for (int i = 0; i < dim; ++i) {
+            channel_sum += bytes[c * dim + i];
+          }
+          sum_[c] += channel_sum;
+        }
+        pixels_ += dim;
+      } else {
+        uint32_t* byte_sum = &byte_sum_[0];
+        for (int i = 0; i < size_in_datum; ++i) {
+          byte_sum[i] += bytes[i];
+        }
+        if (++unflushed_ == kFlushEvery) {
+          Flush();
+        }
+      }
+    } else {
+      CHECK_EQ(datum.float_data_size(), size_in_datum);
+      const int dim = FLAGS_channel_mean ? size_in_datum / channels_ : 1;
+      for (int i = 0; i < size_in_datum; ++i) {
+        sum_[FLAGS_channel_mean ? i / dim : i] += datum.float_data(i);
+      }
+      pixels_ += dim;
+    }
+  }
+
+  void Flush() {
+    for (int i = 0; i < byte_sum_.size(); ++i) {
+      sum_[i] += byte_sum_[i];
+      byte_sum_[i] = 0;
+    }
+    unflushed_ = 0;
+  }
+
+  db::Cursor* cursor_;
+  const int first_;
+  const int step_;
+  const int channels_;
+  const int data_size_;
+  std::vector<double> sum_;
+  std::vector<uint32_t> byte_sum_;
+  int count_;
+  int64_t pixels_;
+  int unflushed_;
+  boost::mutex* progress_mutex_;
+  int* progress_;
+};
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -42,13 +167,14 @@ int main(int argc, char** argv) {
     gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/compute_image_mean");
     return 1;
   }
+  CHECK(!FLAGS_channel_mean || argc == 2)
+      << "No mean image is computed with --channel_mean";
 
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[1], db::READ);
   scoped_ptr<db::Cursor> cursor(db->NewCursor());
 
   BlobProto sum_blob;
-  int count = 0;
   // load first datum
   Datum datum;
   datum.ParseFromString(cursor->value());
@@ -56,67 +182,77 @@ int main(int argc, char** argv) {
   if (DecodeDatumNative(&datum)) {
     LOG(INFO) << "Decoding Datum";
   }
+  if (DecompressDatum(&datum)) {
+    LOG(INFO) << "Decompressing Datum";
+  }
 
   sum_blob.set_num(1);
   sum_blob.set_channels(datum.channels());
   sum_blob.set_height(datum.height());
   sum_blob.set_width(datum.width());
+  const int channels = datum.channels();
   const int data_size = datum.channels() * datum.height() * datum.width();
-  int size_in_datum = std::max<int>(datum.data().size(),
-                                    datum.float_data_size());
-  for (int i = 0; i < size_in_datum; ++i) {
-    sum_blob.add_data(0.);
+
+  int num_threads = FLAGS_threads;
+  if (num_threads <= 0) {
+    num_threads = max<int>(1, boost::thread::hardware_concurrency());
   }
-  LOG(INFO) << "Starting iteration";
-  while (cursor->valid()) {
-    Datum datum;
-    datum.ParseFromString(cursor->value());
-    DecodeDatumNative(&datum);
+  // Each thread reads its own share of the records with its own cursor.
+  std::vector<shared_ptr<db::Cursor> > cursors;
+  std::vector<shared_ptr<MeanAccumulator> > accumulators;
+  boost::mutex progress_mutex;
+  int progress = 0;
+  for (int i = 0; i < num_threads; ++i) {
+    cursors.push_back(shared_ptr<db::Cursor>(db->NewCursor()));
+    accumulators.push_back(shared_ptr<MeanAccumulator>(new MeanAccumulator(
+        cursors[i].get(), i, num_threads, channels, data_size,
+        &progress_mutex, &progress)));
+  }
+  LOG(INFO) << "Starting iteration on " << num_threads << " threads";
+  boost::thread_group threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.add_thread(new boost::thread(&MeanAccumulator::Run,
+        accumulators[i].get()));
+  }
+  threads.join_all();
 
-    const std::string& data = datum.data();
-    size_in_datum = std::max<int>(datum.data().size(),
-        datum.float_data_size());
-    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
-        size_in_datum;
-    if (data.size() != 0) {
-      CHECK_EQ(data.size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) + (uint8_t)data[i]);
-      }
-    } else {
-      CHECK_EQ(datum.float_data_size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) +
-            static_cast<float>(datum.float_data(i)));
-      }
-    }
-    ++count;
-    if (count % 10000 == 0) {
-      LOG(INFO) << "Processed " << count << " files.";
+  // Reduce the sums of the threads.
+  std::vector<double> sum(accumulators[0]->sum().size(), 0.);
+  int count = 0;
+  int64_t pixels = 0;
+  for (int i = 0; i < num_threads; ++i) {
+    const std::vector<double>& thread_sum = accumulators[i]->sum();
+    for (int j = 0; j < sum.size(); ++j) {
+      sum[j] += thread_sum[j];
     }
-    cursor->Next();
+    count += accumulators[i]->count();
+    pixels += accumulators[i]->pixels();
   }
+  LOG(INFO) << "Processed " << count << " files.";
 
-  if (count % 10000 != 0) {
-    LOG(INFO) << "Processed " << count << " files.";
+  LOG(INFO) << "Number of channels: " << channels;
+  if (FLAGS_channel_mean) {
+    for (int c = 0; c < channels; ++c) {
+      LOG(INFO) << "mean_value channel [" << c << "]: " << sum[c] / pixels;
+    }
+    return 0;
   }
-  for (int i = 0; i < sum_blob.data_size(); ++i) {
-    sum_blob.set_data(i, sum_blob.data(i) / count);
+  for (int i = 0; i < data_size; ++i) {
+    sum_blob.add_data(sum[i] / count);
   }
   // Write to disk
   if (argc == 3) {
     LOG(INFO) << "Write to " << argv[2];
     WriteProtoToBinaryFile(sum_blob, argv[2]);
   }
-  const int channels = sum_blob.channels();
   const int dim = sum_blob.height() * sum_blob.width();
-  std::vector<float> mean_values(channels, 0.0);
-  LOG(INFO) << "Number of channels: " << channels;
   for (int c = 0; c < channels; ++c) {
+    double mean_value = 0;
     for (int i = 0; i < dim; ++i) {
-      mean_values[c] += sum_blob.data(dim * c + i);
+      mean_value += sum[dim * c + i];
     }
-    LOG(INFO) << "mean_value channel [" << c << "]: " << mean_values[c] / dim;
+    LOG(INFO) << "mean_value channel [" << c << "]: "
+        << mean_value / count / dim;
   }
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
@@ -1,5 +1,5 @@
-// This program converts a set of images to a lmdb/leveldb by storing them
-// as Datum proto buffers.
+// This program converts a set of images to a lmdb/leveldb/packed db by
+// storing them as Datum proto buffers.
 // Usage:
 //   convert_imageset [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME
 //
@@ -7,7 +7,13 @@
 // should be a list of files as well as their labels, in the format as
 //   subfolder1/file1.JPEG 7
 //   ....
+//
+// Images are read, resized and encoded on --threads threads, and written to
+// the db in the order of LISTFILE by the main thread, so the db does not
+// depend on the number of threads.
 
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
@@ -18,7 +24,10 @@
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
+#include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/compression.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
@@ -33,7 +42,7 @@ DEFINE_bool(gray, false,
 DEFINE_bool(shuffle, false,
     "Randomly shuffle the order of images and their labels");
 DEFINE_string(backend, "lmdb",
-        "The backend {lmdb, leveldb} for storing the result");
+        "The backend {lmdb, leveldb, packed} for storing the result");
 DEFINE_int32(resize_width, 0, "Width images are resized to");
 DEFINE_int32(resize_height, 0, "Height images are resized to");
 DEFINE_bool(check_size, false,
@@ -42,6 +51,103 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_string(compression, "",
+    "Optional: compress the pixels of images that are not encoded, with "
+    "'lz4' or 'zstd'");
+DEFINE_int32(compression_level, 0,
+    "Compression level of --compression=zstd; 0 for its default");
+DEFINE_int32(threads, 0,
+    "Number of threads reading, resizing and encoding images; 0 to use one "
+    "per core");
+DEFINE_int32(txn_mb, 256,
+    "Commit the db every time this many MB of images have been put");
+DEFINE_bool(legacy_commits, false,
+    "Commit the db every 1000 images, as earlier versions did, so that the "
+    "db files are byte-identical to theirs");
+
+#ifdef USE_OPENCV
+// Reads, resizes and encodes every step-th image, starting with the
+// first-th, into the Datums of free(), and passes them on, in order, to
+// full(). A Datum without data is passed on for images that cannot be read.
+class ImageConverter {
+ public:
+  ImageConverter(const std::vector<std::pair<std::string, int> >& lines,
+      const string& root_folder, int first, int step,
+      Datum_Compression compression)
+      : lines_(lines), root_folder_(root_folder), first_(first),
+        step_(step), compression_(compression) {
+    // Bounds how far ahead of the writer the thread runs.
+    for (int i = 0; i < kQueueSize; ++i) {
+      free_.push(new Datum());
+    }
+    thread_.reset(new boost::thread(&ImageConverter::Entry, this));
+  }
+  ~ImageConverter() {
+    thread_->interrupt();
+    thread_->join();
+    Datum* datum;
+    while (free_.try_pop(&datum)) {
+      delete datum;
+    }
+    while (full_.try_pop(&datum)) {
+      delete datum;
+    }
+  }
+
+  BlockingQueue<Datum*>& free() { return free_; }
+  BlockingQueue<Datum*>& full() { return full_; }
+
+ protected:
+  static const int kQueueSize = 16;
+
+  void Entry() {
+    try {
+      for (int line_id = first_; line_id < lines_.size(); line_id += step_) {
+        Datum* datum = free_.pop();
+        datum->Clear();
+        ReadImage(lines_[line_id], datum);
+        full_.push(datum);
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  void ReadImage(const std::pair<std::string, int>& line, Datum* datum) {
+    std::string enc = FLAGS_encode_type;
+    if (FLAGS_encoded && !enc.size()) {
+      // Guess the encoding type from the file name
+      string fn = line.first;
+      size_t p = fn.rfind('.');
+      if ( p == fn.npos )
+        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+      enc = fn.substr(p);
+      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+    }
+    if (!ReadImageToDatum(root_folder_ + line.first, line.second,
+        std::max<int>(0, FLAGS_resize_height),
+        std::max<int>(0, FLAGS_resize_width), !FLAGS_gray, enc, datum)) {
+      datum->Clear();
+    } else if (compression_ != Datum::NONE) {
+      CompressDatum(compression_, FLAGS_compression_level, datum);
+    }
+  }
+
+  const std::vector<std::pair<std::string, int> >& lines_;
+  const string root_folder_;
+  const int first_;
+  const int step_;
+  const Datum_Compression compression_;
+  BlockingQueue<Datum*> free_;
+  BlockingQueue<Datum*> full_;
+  scoped_ptr<boost::thread> thread_;
+};
+
+static double ElapsedSeconds(const boost::posix_time::ptime& start) {
+  return (boost::posix_time::microsec_clock::local_time() - start)
+      .total_microseconds() / 1e6;
+}
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -53,7 +159,7 @@ int main(int argc, char** argv) {
   namespace gflags = google;
 #endif
 
-  gflags::SetUsageMessage("Convert a set of images to the leveldb/lmdb\n"
+  gflags::SetUsageMessage("Convert a set of images to the leveldb/lmdb/packed\n"
         "format used as input for Caffe.\n"
         "Usage:\n"
         "    convert_imageset [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME\n"
@@ -66,7 +172,6 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  const bool is_color = !FLAGS_gray;
   const bool check_size = FLAGS_check_size;
   const bool encoded = FLAGS_encoded;
   const string encode_type = FLAGS_encode_type;
@@ -91,8 +196,27 @@ int main(int argc, char** argv) {
   if (encode_type.size() && !encoded)
     LOG(INFO) << "encode_type specified, assuming encoded=true.";
 
-  int resize_height = std::max<int>(0, FLAGS_resize_height);
-  int resize_width = std::max<int>(0, FLAGS_resize_width);
+  Datum_Compression compression = Datum::NONE;
+  if (FLAGS_compression.size()) {
+    string name = FLAGS_compression;
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    CHECK(Datum_Compression_Parse(name, &compression))
+        << "Unknown compression: " << FLAGS_compression;
+    CHECK(!encoded && !encode_type.size())
+        << "compression only applies to images that are not encoded";
+    CHECK(CompressionAvailable(compression)) << "Caffe was built without "
+        << FLAGS_compression << " support";
+  }
+
+  int num_threads = FLAGS_threads;
+  if (num_threads <= 0) {
+    num_threads = std::max<int>(1, boost::thread::hardware_concurrency());
+  }
+  CHECK_GT(FLAGS_txn_mb, 0) << "txn_mb must be positive";
+  const size_t txn_bytes = static_cast<size_t>(FLAGS_txn_mb) << 20;
+  LOG(INFO) << "Converting images on " << num_threads << " threads, "
+      << (FLAGS_legacy_commits ? string("committing every 1000 images") :
+          "committing every " + format_int(FLAGS_txn_mb) + " MB");
 
   // Create new DB
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
@@ -101,33 +225,35 @@ int main(int argc, char** argv) {
 
   // Storing to db
   std::string root_folder(argv[1]);
-  Datum datum;
+  std::vector<shared_ptr<ImageConverter> > converters;
+  for (int i = 0; i < num_threads; ++i) {
+    converters.push_back(shared_ptr<ImageConverter>(
+        new ImageConverter(lines, root_folder, i, num_threads, compression)));
+  }
   int count = 0;
   int data_size = 0;
   bool data_size_initialized = false;
+  size_t uncommitted_bytes = 0;
+  const boost::posix_time::ptime start_time =
+      boost::posix_time::microsec_clock::local_time();
 
   for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+    // Each image is taken from the thread that converted it, in order.
+    ImageConverter* converter = converters[line_id % num_threads].get();
+    Datum* datum = converter->full().pop();
+    if (!datum->has_data()) {
+      converter->free().push(datum);
+      continue;
     }
-    status = ReadImageToDatum(root_folder + lines[line_id].first,
-        lines[line_id].second, resize_height, resize_width, is_color,
-        enc, &datum);
-    if (status == false) continue;
     if (check_size) {
       if (!data_size_initialized) {
-        data_size = datum.channels() * datum.height() * datum.width();
+        data_size = datum->channels() * datum->height() * datum->width();
         data_size_initialized = true;
+      } else if (datum->compression() != Datum::NONE) {
+        const int size = datum->channels() * datum->height() * datum->width();
+        CHECK_EQ(size, data_size) << "Incorrect data field size " << size;
       } else {
-        const std::string& data = datum.data();
+        const std::string& data = datum->data();
         CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
             << data.size();
       }
@@ -137,21 +263,29 @@ int main(int argc, char** argv) {
 
     // Put in db
     string out;
-    CHECK(datum.SerializeToString(&out));
+    CHECK(datum->SerializeToString(&out));
+    converter->free().push(datum);
     txn->Put(key_str, out);
+    uncommitted_bytes += key_str.size() + out.size();
 
-    if (++count % 1000 == 0) {
+    ++count;
+    if (FLAGS_legacy_commits ? count % 1000 == 0 :
+        uncommitted_bytes >= txn_bytes) {
       // Commit db
       txn->Commit();
       txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
+      uncommitted_bytes = 0;
+      LOG(INFO) << "Processed " << count << " files ("
+          << count / ElapsedSeconds(start_time) << " files/s).";
     }
   }
   // write the last batch
-  if (count % 1000 != 0) {
+  if (FLAGS_legacy_commits ? count % 1000 != 0 : uncommitted_bytes > 0) {
     txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
   }
+  const double seconds = ElapsedSeconds(start_time);
+  LOG(INFO) << "Processed " << count << " files in " << seconds << " s ("
+      << count / seconds << " files/s).";
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
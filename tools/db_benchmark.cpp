@@ -0,0 +1,125 @@
+// This program measures the sequential read throughput of a database, to
+// compare backends (e.g. lmdb vs. packed) on the same dataset.
+// Usage:
+//   db_benchmark [FLAGS] DB_NAME
+//
+// Every record is read through a db::Cursor and parsed into a Datum, as the
+// DataLayer does, and records/s and MB/s are reported for each pass. With
+// --decode, encoded images are decoded and compressed Datums decompressed
+// too, as the DataTransformer does, to compare storage formats (raw, lz4,
+// zstd, jpg) of the same images by size and throughput.
+
+#include <stdint.h>
+#include <algorithm>
+#include <cctype>
+#include <string>
+
+#include "boost/scoped_ptr.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/compression.hpp"
+#include "caffe/util/db.hpp"
+#include "caffe/util/io.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using boost::scoped_ptr;
+
+DEFINE_string(backend, "lmdb",
+    "The backend {lmdb, leveldb, packed} containing the records");
+DEFINE_string(packed_read_mode, "mmap",
+    "How a packed db is read {mmap, stream, direct}");
+DEFINE_int32(passes, 2,
+    "Number of passes over the db; the first one may read from disk and "
+    "the following ones from the page cache");
+DEFINE_int32(max_records, 0,
+    "Optional: stop each pass after this many records");
+DEFINE_bool(decode, false,
+    "Also decode encoded images and decompress compressed Datums");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Measure the sequential read throughput of a db.\n"
+        "Usage:\n"
+        "    db_benchmark [FLAGS] DB_NAME\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 2) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/db_benchmark");
+    return 1;
+  }
+
+  DataParameter param;
+  if (FLAGS_backend == "packed") {
+    param.set_backend(DataParameter_DB_PACKED);
+    DataParameter::PackedReadMode read_mode;
+    string mode = FLAGS_packed_read_mode;
+    std::transform(mode.begin(), mode.end(), mode.begin(), ::toupper);
+    CHECK(DataParameter::PackedReadMode_Parse(mode, &read_mode))
+        << "Unknown packed read mode " << FLAGS_packed_read_mode;
+    param.set_packed_read_mode(read_mode);
+  }
+  scoped_ptr<db::DB> db(param.has_backend() ? db::GetDB(param) :
+      db::GetDB(FLAGS_backend));
+  db->Open(argv[1], db::READ);
+
+  Datum datum;
+  Datum uncompressed;
+  CPUTimer timer;
+  for (int pass = 0; pass < FLAGS_passes; ++pass) {
+    timer.Start();
+    scoped_ptr<db::Cursor> cursor(db->NewCursor());
+    int64_t count = 0;
+    int64_t bytes = 0;
+    int64_t decoded_bytes = 0;
+    for (; cursor->valid(); cursor->Next()) {
+      const string value = cursor->value();
+      CHECK(datum.ParseFromString(value)) << "Failed to parse record "
+          << count;
+      bytes += value.size();
+      if (FLAGS_decode) {
+        if (datum.compression() != Datum::NONE) {
+          DecompressDatum(datum, &uncompressed);
+          decoded_bytes += uncompressed.data().size() +
+              uncompressed.float_data_size() * sizeof(float);
+        } else {
+          if (datum.encoded()) {
+#ifdef USE_OPENCV
+            DecodeDatumNative(&datum);
+#else
+            LOG(FATAL) << "Encoded datum requires OpenCV; compile with "
+                << "USE_OPENCV.";
+#endif  // USE_OPENCV
+          }
+          decoded_bytes += datum.data().size() +
+              datum.float_data_size() * sizeof(float);
+        }
+      }
+      if (++count == FLAGS_max_records) {
+        break;
+      }
+    }
+    timer.Stop();
+    const double seconds = timer.Seconds();
+    LOG(INFO) << "Pass " << pass << ": " << count << " records, "
+        << bytes / 1e6 << " MB in " << seconds << " s: "
+        << count / seconds << " records/s, "
+        << bytes / 1e6 / seconds << " MB/s";
+    if (FLAGS_decode) {
+      LOG(INFO) << "Pass " << pass << ": decoded " << decoded_bytes / 1e6
+          << " MB, " << decoded_bytes / 1e6 / seconds << " MB/s, "
+          << "stored at " << static_cast<double>(bytes) / decoded_bytes
+          << " of the decoded size";
+    }
+  }
+  return 0;
+}